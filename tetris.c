@@ -1,6 +1,19 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 // --- DEFINIÇÕES GLOBAIS E ESTRUTURAS ---
 
@@ -8,6 +21,20 @@
 #define FILA_MAX 5
 #define PILHA_MAX 3
 
+// Códigos das ações do menu (valores de 'opcao' no switch de main).
+#define ACAO_SAIR 0
+#define ACAO_JOGAR 1
+#define ACAO_RESERVAR 2
+#define ACAO_USAR_RESERVA 3
+#define ACAO_TROCAR 4
+#define ACAO_TROCA_MULTIPLA 5
+#define NUM_ACOES 6
+
+// Tipos de peça; o índice de cada letra nesta string é o "tipo compactado"
+// usado nas observações, tabelas e arquivos binários.
+#define NUM_TIPOS 7
+static const char TIPOS_PECA[] = "IOTLSZJ";
+
 /**
  * @brief Estrutura que representa uma peça do jogo.
  *
@@ -42,6 +69,33 @@ typedef struct {
     int topo;
 } Pilha;
 
+/**
+ * @brief Gerador de peças com estado próprio.
+ *
+ * Cada sessão carrega o seu gerador, o que permite semear e simular várias
+ * partidas independentes ao mesmo tempo. O tipo da peça k é função só de
+ * (semente, k), e 'proximo_id' é o k da próxima peça (ver tipoNaPosicao).
+ */
+typedef struct {
+    uint64_t semente;
+    int proximo_id;
+    // Opcional: tipos pré-gerados da mesma semente (ver usarSequencia),
+    // PECAS_POR_PALAVRA por palavra; 'pecas_sequencia' é 0 sem sequência.
+    const uint64_t *sequencia;
+    uint64_t pecas_sequencia;
+} GeradorPecas;
+
+#define PECAS_POR_PALAVRA 21 // 21 tipos de 3 bits em cada uint64_t
+
+/**
+ * @brief Partida completa sem interface: fila, pilha e gerador de peças.
+ */
+typedef struct {
+    Fila fila;
+    Pilha pilha;
+    GeradorPecas gerador;
+} Sessao;
+
 // --- FUNÇÕES DA FILA ---
 
 void inicializarFila(Fila *f) {
@@ -115,20 +169,215 @@ Peca popPilha(Pilha *p) {
 }
 
 
+// --- AÇÕES LEGAIS ---
+
+/**
+ * @brief Calcula a máscara de ações legais para um estado.
+ *
+ * O bit (1 << ACAO_x) fica ligado quando a ação x é permitida, usando as
+ * mesmas condições testadas no switch de main, mas sem desvios: cada
+ * comparação vira 0 ou 1 e é deslocada para a sua posição.
+ *
+ * @return Máscara de bits (cabe em um unsigned char).
+ */
+unsigned acoesLegais(const Fila *f, const Pilha *p) {
+    unsigned temFila = f->total > 0;
+    unsigned temPilha = p->topo >= 0;
+    unsigned pilhaLivre = p->topo < PILHA_MAX - 1;
+    unsigned multipla = (unsigned)(f->total >= 3) & (unsigned)(p->topo >= 2);
+
+    return (1u << ACAO_SAIR)
+         | (temFila << ACAO_JOGAR)
+         | ((temFila & pilhaLivre) << ACAO_RESERVAR)
+         | (temPilha << ACAO_USAR_RESERVA)
+         | ((temFila & temPilha) << ACAO_TROCAR)
+         | (multipla << ACAO_TROCA_MULTIPLA);
+}
+
+/**
+ * @brief Versão em lote de acoesLegais para várias sessões.
+ *
+ * filas[i] e pilhas[i] formam o estado da sessão i; a máscara resultante
+ * é gravada em mascaras[i]. O laço não tem desvios dependentes dos dados,
+ * o que permite ao compilador vetorizá-lo.
+ */
+void acoesLegaisLote(const Fila *filas, const Pilha *pilhas, unsigned char *mascaras, int n) {
+    for (int i = 0; i < n; i++) {
+        mascaras[i] = (unsigned char)acoesLegais(&filas[i], &pilhas[i]);
+    }
+}
+
+
 // --- FUNÇÕES DO JOGO ---
 
+/**
+ * @brief Converte a letra de uma peça no seu tipo compactado (0 a 6).
+ */
+static inline int tipoDaLetra(char nome) {
+    static const unsigned char indice[128] = {
+        ['I'] = 0, ['O'] = 1, ['T'] = 2, ['L'] = 3, ['S'] = 4, ['Z'] = 5, ['J'] = 6
+    };
+    return indice[(unsigned char)nome & 127];
+}
+
+#define PASSO_GERADOR 0x9E3779B97F4A7C15ULL
+
+// Finalizador do SplitMix64: espalha os bits de z.
+static inline uint64_t misturar64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Tipo (0 a 6) da k-ésima peça de uma partida com a semente dada.
+ *
+ * O gerador é baseado em contador: a peça k depende só de (semente, k),
+ * então qualquer posição da sequência é calculada em O(1), sem gerar as
+ * anteriores. gerarPecaDe usa esta mesma função, então o resultado é
+ * idêntico ao da geração sequencial.
+ */
+static inline int tipoNaPosicao(uint64_t semente, uint64_t k) {
+    uint64_t z = misturar64(semente + (k + 1) * PASSO_GERADOR);
+    return (int)(((z >> 32) * NUM_TIPOS) >> 32); // faixa [0, 7) sem divisão
+}
+
+/**
+ * @brief Peça completa (tipo e ID) na posição k; o ID de uma peça é k.
+ */
+Peca pecaNaPosicao(uint64_t semente, int k) {
+    Peca p;
+    p.nome = TIPOS_PECA[tipoNaPosicao(semente, (uint64_t)k)];
+    p.id = k;
+    return p;
+}
+
+/**
+ * @brief Tipos das peças k0 .. k0 + n - 1, para dividir uma sequência
+ * entre vários trabalhadores.
+ */
+void tiposNoIntervalo(uint64_t semente, uint64_t k0, uint8_t *tipos, uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+        tipos[i] = (uint8_t)tipoNaPosicao(semente, k0 + i);
+    }
+}
+
+void semearGerador(GeradorPecas *g, uint64_t semente) {
+    g->semente = semente;
+    g->proximo_id = 0;
+    g->sequencia = NULL;
+    g->pecas_sequencia = 0;
+}
+
+// Tipo da peça k em uma sequência empacotada.
+static inline int tipoNaSequencia(const uint64_t *palavras, uint64_t k) {
+    return (int)((palavras[k / PECAS_POR_PALAVRA] >> (k % PECAS_POR_PALAVRA * 3)) & 7);
+}
+
+/**
+ * @brief Gera a próxima peça de um gerador semeado.
+ *
+ * Mesma interface de gerarPeca; o ID vem do contador do próprio gerador.
+ * Dentro de uma sequência pré-gerada o tipo é lido dela; depois do fim,
+ * volta a ser calculado.
+ */
+Peca gerarPecaDe(GeradorPecas *g) {
+    uint64_t k = (uint64_t)g->proximo_id;
+    if (k < g->pecas_sequencia) {
+        Peca p;
+        p.nome = TIPOS_PECA[tipoNaSequencia(g->sequencia, k)];
+        p.id = g->proximo_id++;
+        return p;
+    }
+    return pecaNaPosicao(g->semente, g->proximo_id++);
+}
+
+// Gerador usado pelo jogo interativo (semeado em main).
+static GeradorPecas geradorDoJogo;
+
 /**
  * @brief Gera uma nova peça com um tipo aleatório e um ID sequencial.
  *
  * @return A peça gerada.
  */
 Peca gerarPeca() {
-    static int id_contador = 0; // 'static' mantém o valor entre chamadas
-    Peca p;
-    char tipos[] = "IOTLSZJ";
-    p.nome = tipos[rand() % 7];
-    p.id = id_contador++;
-    return p;
+    return gerarPecaDe(&geradorDoJogo);
+}
+
+// Troca a frente da fila com o topo da pilha (opção 4).
+void trocarFrenteComTopo(Fila *f, Pilha *p) {
+    Peca temp = f->itens[f->inicio];
+    f->itens[f->inicio] = p->itens[p->topo];
+    p->itens[p->topo] = temp;
+}
+
+// Troca as 3 primeiras peças da fila com as 3 da pilha (opção 5).
+void trocarTresPrimeiros(Fila *f, Pilha *p) {
+    for (int i = 0; i < 3; i++) {
+        // Calcula o índice na fila circular
+        int idx_fila = (f->inicio + i) % FILA_MAX;
+        // O índice na pilha é mais simples
+        int idx_pilha = p->topo - i;
+
+        // Troca
+        Peca temp = f->itens[idx_fila];
+        f->itens[idx_fila] = p->itens[idx_pilha];
+        p->itens[idx_pilha] = temp;
+    }
+}
+
+/**
+ * @brief Aplica uma ação do menu sem nenhuma saída em tela.
+ *
+ * É a mesma lógica do switch de main, usada pelas simulações. Novas
+ * peças vêm do gerador 'g'.
+ *
+ * @return 1 se a ação foi aplicada, 0 se era ilegal (estado inalterado).
+ */
+int aplicarAcao(Fila *f, Pilha *p, GeradorPecas *g, int acao) {
+    if (acao < 0 || acao >= NUM_ACOES || !((acoesLegais(f, p) >> acao) & 1u)) {
+        return 0;
+    }
+    switch (acao) {
+        case ACAO_JOGAR:
+            removerFila(f);
+            inserirFila(f, gerarPecaDe(g));
+            break;
+        case ACAO_RESERVAR:
+            pushPilha(p, removerFila(f));
+            inserirFila(f, gerarPecaDe(g));
+            break;
+        case ACAO_USAR_RESERVA:
+            popPilha(p);
+            break;
+        case ACAO_TROCAR:
+            trocarFrenteComTopo(f, p);
+            break;
+        case ACAO_TROCA_MULTIPLA:
+            trocarTresPrimeiros(f, p);
+            break;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reinicia fila, pilha e gerador e preenche a fila inicial.
+ */
+void iniciarPartida(Fila *f, Pilha *p, GeradorPecas *g, uint64_t semente) {
+    inicializarFila(f);
+    inicializarPilha(p);
+    semearGerador(g, semente);
+    for (int i = 0; i < FILA_MAX; i++) {
+        inserirFila(f, gerarPecaDe(g));
+    }
+}
+
+void iniciarSessao(Sessao *s, uint64_t semente) {
+    iniciarPartida(&s->fila, &s->pilha, &s->gerador, semente);
+}
+
+int aplicarAcaoSessao(Sessao *s, int acao) {
+    return aplicarAcao(&s->fila, &s->pilha, &s->gerador, acao);
 }
 
 /**
@@ -175,105 +424,9129 @@ void exibirMenu() {
     printf("Opcao escolhida: ");
 }
 
-// --- LÓGICA PRINCIPAL ---
+// --- SEQUÊNCIAS DE PEÇAS PRÉ-GERADAS ---
 
-int main() {
-    // Inicializa o gerador de números aleatórios
-    srand(time(NULL));
+// Arquivo: cabeçalho e os tipos das peças 0 .. num_pecas - 1 de uma
+// semente, PECAS_POR_PALAVRA por uint64_t (peça k nos bits 3(k % 21)).
+// Processos que mapeiam o mesmo arquivo compartilham as páginas do cache.
+#define SEQUENCIA_MAGICA "TSSEQPC"
+#define SEQUENCIA_VERSAO 1
 
-    // Declara e inicializa as estruturas do jogo
-    Fila filaDePecas;
-    Pilha pilhaDeReserva;
-    inicializarFila(&filaDePecas);
-    inicializarPilha(&pilhaDeReserva);
+typedef struct {
+    char magica[8];
+    uint32_t versao;
+    uint32_t reservado;
+    uint64_t semente;
+    uint64_t num_pecas;
+} CabecalhoSequencia;
 
-    // Preenche a fila inicial com 5 peças
-    for (int i = 0; i < FILA_MAX; i++) {
-        inserirFila(&filaDePecas, gerarPeca());
+typedef struct {
+    void *mapa;
+    size_t tamanho;
+    uint64_t semente;
+    uint64_t num_pecas;
+    const uint64_t *palavras;
+} SequenciaPecas;
+
+/**
+ * @brief Grava as 'num_pecas' primeiras peças da semente em um arquivo.
+ *
+ * @return 0 em caso de sucesso, -1 em erro.
+ */
+int materializarSequencia(const char *caminho, uint64_t semente, uint64_t num_pecas) {
+    FILE *arq = fopen(caminho, "wb");
+    if (!arq) {
+        return -1;
     }
+    CabecalhoSequencia cab;
+    memset(&cab, 0, sizeof(cab));
+    memcpy(cab.magica, SEQUENCIA_MAGICA, sizeof(SEQUENCIA_MAGICA));
+    cab.versao = SEQUENCIA_VERSAO;
+    cab.semente = semente;
+    cab.num_pecas = num_pecas;
+    int ok = fwrite(&cab, sizeof(cab), 1, arq) == 1;
 
-    int opcao;
-    do {
-        exibirEstado(&filaDePecas, &pilhaDeReserva);
-        exibirMenu();
-        scanf("%d", &opcao);
+    enum { PALAVRAS_POR_BLOCO = 4096 };
+    uint64_t bloco[PALAVRAS_POR_BLOCO];
+    uint64_t num_palavras = (num_pecas + PECAS_POR_PALAVRA - 1) / PECAS_POR_PALAVRA;
+    for (uint64_t w0 = 0; ok && w0 < num_palavras; w0 += PALAVRAS_POR_BLOCO) {
+        size_t n = num_palavras - w0 < PALAVRAS_POR_BLOCO ? (size_t)(num_palavras - w0) : PALAVRAS_POR_BLOCO;
+        for (size_t w = 0; w < n; w++) {
+            uint64_t palavra = 0;
+            uint64_t k0 = (w0 + w) * PECAS_POR_PALAVRA;
+            for (int j = 0; j < PECAS_POR_PALAVRA && k0 + j < num_pecas; j++) {
+                palavra |= (uint64_t)tipoNaPosicao(semente, k0 + j) << (3 * j);
+            }
+            bloco[w] = palavra;
+        }
+        ok = fwrite(bloco, sizeof(uint64_t), n, arq) == n;
+    }
+    ok = fclose(arq) == 0 && ok;
+    return ok ? 0 : -1;
+}
 
-        switch (opcao) {
-            case 1: // Jogar peça
-                if (!filaVazia(&filaDePecas)) {
-                    Peca jogada = removerFila(&filaDePecas);
-                    printf("\nAcao: Peca [%c%d] jogada.\n", jogada.nome, jogada.id);
-                    // Adiciona uma nova peça para manter a fila cheia
-                    inserirFila(&filaDePecas, gerarPeca());
-                } else {
-                    printf("\nAcao: Fila vazia, impossivel jogar.\n");
-                }
-                break;
+void sequenciaFechar(SequenciaPecas *s) {
+    if (s->mapa) {
+        munmap(s->mapa, s->tamanho);
+    }
+    s->mapa = NULL;
+}
 
-            case 2: // Reservar peça
-                if (pilhaCheia(&pilhaDeReserva)) {
-                    printf("\nAcao: Pilha de reserva cheia! Impossivel reservar.\n");
-                } else if (filaVazia(&filaDePecas)) {
-                    printf("\nAcao: Fila vazia, impossivel reservar.\n");
-                } else {
-                    Peca reservada = removerFila(&filaDePecas);
-                    pushPilha(&pilhaDeReserva, reservada);
-                    printf("\nAcao: Peca [%c%d] movida para a reserva.\n", reservada.nome, reservada.id);
-                    inserirFila(&filaDePecas, gerarPeca());
-                }
-                break;
+/**
+ * @brief Mapeia um arquivo de sequência (somente leitura, compartilhado).
+ *
+ * @return 0 em caso de sucesso, -1 se o arquivo for inválido.
+ */
+int sequenciaAbrir(SequenciaPecas *s, const char *caminho) {
+    memset(s, 0, sizeof(*s));
+    int fd = open(caminho, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CabecalhoSequencia)) {
+        close(fd);
+        return -1;
+    }
+    void *mapa = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapa == MAP_FAILED) {
+        return -1;
+    }
+    s->mapa = mapa;
+    s->tamanho = st.st_size;
+    const CabecalhoSequencia *cab = mapa;
+    uint64_t num_palavras = (cab->num_pecas + PECAS_POR_PALAVRA - 1) / PECAS_POR_PALAVRA;
+    if (memcmp(cab->magica, SEQUENCIA_MAGICA, sizeof(SEQUENCIA_MAGICA)) != 0 || cab->versao != SEQUENCIA_VERSAO
+        || sizeof(CabecalhoSequencia) + num_palavras * sizeof(uint64_t) != s->tamanho) {
+        sequenciaFechar(s);
+        return -1;
+    }
+    s->semente = cab->semente;
+    s->num_pecas = cab->num_pecas;
+    s->palavras = (const uint64_t *)(cab + 1);
+    return 0;
+}
 
-            case 3: // Usar peça reservada
-                if (!pilhaVazia(&pilhaDeReserva)) {
-                    Peca usada = popPilha(&pilhaDeReserva);
-                    printf("\nAcao: Peca [%c%d] da reserva foi usada.\n", usada.nome, usada.id);
-                } else {
-                    printf("\nAcao: Pilha de reserva vazia!\n");
-                }
-                break;
+/**
+ * @brief Faz o gerador ler os tipos da sequência mapeada.
+ *
+ * A sequência precisa continuar aberta enquanto o gerador for usado.
+ *
+ * @return 0 em caso de sucesso, -1 se a semente não for a da sequência.
+ */
+int usarSequencia(GeradorPecas *g, const SequenciaPecas *s) {
+    if (g->semente != s->semente) {
+        return -1;
+    }
+    g->sequencia = s->palavras;
+    g->pecas_sequencia = s->num_pecas;
+    return 0;
+}
 
-            case 4: // Trocar peça atual com topo da pilha
-                if (filaVazia(&filaDePecas) || pilhaVazia(&pilhaDeReserva)) {
-                    printf("\nAcao: E preciso ter pecas na fila E na pilha para trocar.\n");
-                } else {
-                    // Realiza a troca direta nos arrays
-                    Peca temp = filaDePecas.itens[filaDePecas.inicio];
-                    filaDePecas.itens[filaDePecas.inicio] = pilhaDeReserva.itens[pilhaDeReserva.topo];
-                    pilhaDeReserva.itens[pilhaDeReserva.topo] = temp;
-                    printf("\nAcao: Troca realizada entre a frente da fila e o topo da pilha.\n");
-                }
-                break;
+// --- AMBIENTE VETORIZADO (APRENDIZADO POR REFORÇO) ---
 
-            case 5: // Troca múltipla
-                // Verifica se ambas as estruturas têm pelo menos 3 peças
-                if (filaDePecas.total < 3 || pilhaDeReserva.topo < 2) {
-                    printf("\nAcao: E preciso ter 3 pecas na fila E 3 na pilha para a troca multipla.\n");
-                } else {
-                    for (int i = 0; i < 3; i++) {
-                        // Calcula o índice na fila circular
-                        int idx_fila = (filaDePecas.inicio + i) % FILA_MAX;
-                        // O índice na pilha é mais simples
-                        int idx_pilha = pilhaDeReserva.topo - i;
-
-                        // Troca
-                        Peca temp = filaDePecas.itens[idx_fila];
-                        filaDePecas.itens[idx_fila] = pilhaDeReserva.itens[idx_pilha];
-                        pilhaDeReserva.itens[idx_pilha] = temp;
-                    }
-                    printf("\nAcao: Troca realizada entre os 3 primeiros da fila e os 3 da pilha.\n");
-                }
-                break;
+// Layout da observação de cada ambiente, em bytes consecutivos:
+// tipos da fila (frente -> fim), tipos da pilha (base -> topo),
+// total da fila e quantidade de peças na pilha. Posições sem peça
+// recebem OBS_VAZIO.
+#define OBS_TAMANHO (FILA_MAX + PILHA_MAX + 2)
+#define OBS_VAZIO NUM_TIPOS
 
-            case 0: // Sair
-                printf("\nEncerrando o jogo Tetris Stack. Ate a proxima!\n");
-                break;
+#define RECOMPENSA_PECA_JOGADA 1.0f
+#define RECOMPENSA_ACAO_ILEGAL -1.0f
 
-            default:
-                printf("\nOpcao invalida. Tente novamente.\n");
-                break;
+/**
+ * @brief Conjunto de N partidas simuladas em paralelo.
+ *
+ * Os estados ficam em arrays paralelos (fila, pilha e gerador de cada
+ * ambiente), alocados uma única vez em ambienteCriar; reset e passo só
+ * escrevem nos buffers fornecidos por quem chama.
+ */
+typedef struct {
+    int n;
+    int max_passos;      // 0 = sem limite de passos por episódio
+    Fila *filas;
+    Pilha *pilhas;
+    GeradorPecas *geradores;
+    uint64_t *sementes;  // semente do episódio atual de cada ambiente
+    int *passos;
+    const SequenciaPecas *sequencias; // opcional: ver ambienteUsarSequencias
+    int num_sequencias;
+} AmbienteVetorizado;
+
+void ambienteDestruir(AmbienteVetorizado *amb) {
+    free(amb->filas);
+    free(amb->pilhas);
+    free(amb->geradores);
+    free(amb->sementes);
+    free(amb->passos);
+    amb->filas = NULL;
+    amb->pilhas = NULL;
+    amb->geradores = NULL;
+    amb->sementes = NULL;
+    amb->passos = NULL;
+    amb->n = 0;
+}
+
+/**
+ * @brief Aloca N ambientes. Devem ser resetados antes do primeiro passo.
+ *
+ * @return 0 em caso de sucesso, -1 se faltar memória.
+ */
+int ambienteCriar(AmbienteVetorizado *amb, int n, int max_passos) {
+    amb->n = n;
+    amb->max_passos = max_passos;
+    amb->filas = malloc(sizeof(Fila) * n);
+    amb->pilhas = malloc(sizeof(Pilha) * n);
+    amb->geradores = malloc(sizeof(GeradorPecas) * n);
+    amb->sementes = malloc(sizeof(uint64_t) * n);
+    amb->passos = malloc(sizeof(int) * n);
+    amb->sequencias = NULL;
+    amb->num_sequencias = 0;
+    if (!amb->filas || !amb->pilhas || !amb->geradores || !amb->sementes || !amb->passos) {
+        ambienteDestruir(amb);
+        return -1;
+    }
+    return 0;
+}
+
+// Escreve a observação de um ambiente em obs[0 .. OBS_TAMANHO).
+static void escreverObservacao(const Fila *f, const Pilha *p, unsigned char *obs) {
+    int idx = f->inicio;
+    for (int i = 0; i < FILA_MAX; i++) {
+        obs[i] = i < f->total ? (unsigned char)tipoDaLetra(f->itens[idx].nome) : OBS_VAZIO;
+        idx = idx + 1 == FILA_MAX ? 0 : idx + 1;
+    }
+    for (int i = 0; i < PILHA_MAX; i++) {
+        obs[FILA_MAX + i] = i <= p->topo ? (unsigned char)tipoDaLetra(p->itens[i].nome) : OBS_VAZIO;
+    }
+    obs[FILA_MAX + PILHA_MAX] = (unsigned char)f->total;
+    obs[FILA_MAX + PILHA_MAX + 1] = (unsigned char)(p->topo + 1);
+}
+
+// Liga o gerador à sequência da sua semente, se houver uma.
+static void anexarSequencia(const AmbienteVetorizado *amb, GeradorPecas *g) {
+    for (int j = 0; j < amb->num_sequencias; j++) {
+        if (usarSequencia(g, &amb->sequencias[j]) == 0) {
+            return;
         }
+    }
+}
 
-    } while (opcao != 0);
+/**
+ * @brief Reinicia todos os ambientes com as sementes dadas.
+ *
+ * @param obs Buffer com n * OBS_TAMANHO bytes (pode ser NULL).
+ */
+void ambienteResetar(AmbienteVetorizado *amb, const uint64_t *sementes, unsigned char *obs) {
+    for (int i = 0; i < amb->n; i++) {
+        amb->sementes[i] = sementes[i];
+        amb->passos[i] = 0;
+        iniciarPartida(&amb->filas[i], &amb->pilhas[i], &amb->geradores[i], sementes[i]);
+        anexarSequencia(amb, &amb->geradores[i]);
+        if (obs) {
+            escreverObservacao(&amb->filas[i], &amb->pilhas[i], obs + (size_t)i * OBS_TAMANHO);
+        }
+    }
+}
+
+/**
+ * @brief Sequências pré-geradas usadas pelos episódios com a mesma semente.
+ *
+ * As sequências precisam continuar abertas enquanto o ambiente for usado.
+ */
+void ambienteUsarSequencias(AmbienteVetorizado *amb, const SequenciaPecas *sequencias, int n) {
+    amb->sequencias = sequencias;
+    amb->num_sequencias = n;
+}
+
+/**
+ * @brief Executa um passo em todos os ambientes.
+ *
+ * Ações ilegais não mudam o estado e recebem RECOMPENSA_ACAO_ILEGAL;
+ * jogar uma peça (opções 1 e 3) vale RECOMPENSA_PECA_JOGADA. Um episódio
+ * termina com ACAO_SAIR ou ao atingir max_passos; nesse caso o ambiente
+ * é reiniciado automaticamente com uma semente derivada da anterior e a
+ * observação devolvida já é a do novo episódio.
+ *
+ * @param acoes       n ações (0 a 5).
+ * @param obs         n * OBS_TAMANHO bytes de saída.
+ * @param recompensas n recompensas de saída.
+ * @param terminou    n flags de fim de episódio (0 ou 1).
+ */
+void ambientePassar(AmbienteVetorizado *amb, const unsigned char *acoes, unsigned char *obs,
+                    float *recompensas, unsigned char *terminou) {
+    for (int i = 0; i < amb->n; i++) {
+        Fila *f = &amb->filas[i];
+        Pilha *p = &amb->pilhas[i];
+        int acao = acoes[i];
+
+        int aplicada = aplicarAcao(f, p, &amb->geradores[i], acao);
+        int jogou = acao == ACAO_JOGAR || acao == ACAO_USAR_RESERVA;
+        recompensas[i] = aplicada ? (jogou ? RECOMPENSA_PECA_JOGADA : 0.0f) : RECOMPENSA_ACAO_ILEGAL;
+
+        amb->passos[i]++;
+        int fim = acao == ACAO_SAIR || (amb->max_passos > 0 && amb->passos[i] >= amb->max_passos);
+        terminou[i] = (unsigned char)fim;
+        if (fim) {
+            // Nova semente derivada da anterior: a sequência de episódios
+            // continua reproduzível a partir das sementes do reset.
+            amb->sementes[i] = misturar64(amb->sementes[i] + PASSO_GERADOR);
+            amb->passos[i] = 0;
+            iniciarPartida(f, p, &amb->geradores[i], amb->sementes[i]);
+            anexarSequencia(amb, &amb->geradores[i]);
+        }
+        escreverObservacao(f, p, obs + (size_t)i * OBS_TAMANHO);
+    }
+}
+
+/**
+ * @brief Máscaras de ações legais de todos os ambientes (ver acoesLegais).
+ */
+void ambienteAcoesLegais(const AmbienteVetorizado *amb, unsigned char *mascaras) {
+    acoesLegaisLote(amb->filas, amb->pilhas, mascaras, amb->n);
+}
+
+
+// --- ÍNDICE DENSO DE ESTADOS ---
+
+// Depois do preenchimento inicial a fila sempre tem FILA_MAX peças e a
+// pilha de 0 a PILHA_MAX. Como os IDs não influenciam as regras, um estado
+// é definido apenas pelos tipos: 7^5 filas x (1 + 7 + 49 + 343) pilhas.
+#define ESTADOS_FILA 16807L  // 7^FILA_MAX
+#define ESTADOS_PILHA 400L   // soma de 7^k para k = 0..PILHA_MAX
+#define NUM_ESTADOS (ESTADOS_FILA * ESTADOS_PILHA)
+
+// Estados que são o próprio espelho (só I, O e T): 3^5 filas x 40 pilhas.
+// Os demais formam pares, então há (NUM_ESTADOS + simétricos) / 2 classes.
+#define ESTADOS_SIMETRICOS (243L * 40L)
+#define NUM_CLASSES ((NUM_ESTADOS + ESTADOS_SIMETRICOS) / 2)
+
+// Primeiro código de pilha com k peças.
+static const int INICIO_PILHA[PILHA_MAX + 2] = {0, 1, 8, 57, 400};
+
+// Potências de 7 usadas pelos dígitos da fila (a frente é o mais
+// significativo, então a peça nova entra no dígito menos significativo).
+static const int POT7[FILA_MAX + 1] = {1, 7, 49, 343, 2401, 16807};
+
+/**
+ * @brief Estado compacto (só os tipos) usado pelo rank/unrank.
+ *
+ * fila[] em ordem lógica (frente -> fim), pilha[] da base para o topo;
+ * posições de pilha acima de num_pilha valem 0.
+ */
+typedef struct {
+    uint8_t fila[FILA_MAX];
+    uint8_t pilha[PILHA_MAX];
+    uint8_t num_pilha;
+} EstadoCompacto;
+
+void compactarEstado(const Fila *f, const Pilha *p, EstadoCompacto *e) {
+    int idx = f->inicio;
+    for (int i = 0; i < FILA_MAX; i++) {
+        e->fila[i] = (uint8_t)tipoDaLetra(f->itens[idx].nome);
+        idx = (idx + 1) % FILA_MAX;
+    }
+    for (int i = 0; i < PILHA_MAX; i++) {
+        e->pilha[i] = i <= p->topo ? (uint8_t)tipoDaLetra(p->itens[i].nome) : 0;
+    }
+    e->num_pilha = (uint8_t)(p->topo + 1);
+}
+
+/**
+ * @brief Reconstrói fila e pilha a partir do estado compacto.
+ *
+ * Os IDs não fazem parte do estado; as peças recebem IDs 0, 1, 2...
+ * na ordem pilha (base -> topo) e depois fila (frente -> fim).
+ */
+void expandirEstado(const EstadoCompacto *e, Fila *f, Pilha *p) {
+    int id = 0;
+    inicializarPilha(p);
+    for (int i = 0; i < e->num_pilha; i++) {
+        Peca peca = {TIPOS_PECA[e->pilha[i]], id++};
+        pushPilha(p, peca);
+    }
+    inicializarFila(f);
+    for (int i = 0; i < FILA_MAX; i++) {
+        Peca peca = {TIPOS_PECA[e->fila[i]], id++};
+        inserirFila(f, peca);
+    }
+}
 
+/**
+ * @brief Rank: estado compacto -> índice denso em [0, NUM_ESTADOS).
+ *
+ * Sem desvios: cada dígito da pilha só entra no código se estiver abaixo
+ * de num_pilha (multiplicador 7 ou 1, parcela d ou 0).
+ */
+static inline uint32_t rankEstado(const EstadoCompacto *e) {
+    uint32_t fila = 0;
+    for (int i = 0; i < FILA_MAX; i++) {
+        fila = fila * NUM_TIPOS + e->fila[i];
+    }
+    uint32_t pilha = 0;
+    for (int i = 0; i < PILHA_MAX; i++) {
+        uint32_t usa = (uint32_t)(i < e->num_pilha);
+        pilha = pilha * (1 + 6 * usa) + e->pilha[i] * usa;
+    }
+    pilha += INICIO_PILHA[e->num_pilha];
+    return pilha * (uint32_t)ESTADOS_FILA + fila;
+}
+
+// Dígitos pré-calculados para o unrank: cada código de fila vira 5 tipos
+// e cada código de pilha vira 3 tipos + quantidade (preenchidos uma vez).
+static uint8_t DIGITOS_FILA[ESTADOS_FILA][8];
+static uint8_t DIGITOS_PILHA[ESTADOS_PILHA][4];
+
+// Espelhar o tabuleiro troca L <-> J e S <-> Z; I, O e T não mudam.
+// Como as ações do menu só dependem das posições na fila e na pilha,
+// estados espelhados têm o mesmo valor e a mesma jogada ótima.
+static const uint8_t ESPELHO_TIPO[NUM_TIPOS] = {0, 1, 2, 6, 5, 4, 3};
+
+// Códigos de fila e de pilha espelhados.
+static uint16_t ESPELHO_FILA[ESTADOS_FILA];
+static uint16_t ESPELHO_PILHA[ESTADOS_PILHA];
+
+// Índice denso das classes {estado, espelho}: uma pilha sem I, O e T só
+// aparece no par com o menor código e ocupa ESTADOS_FILA classes; uma pilha
+// simétrica ocupa uma classe por par de filas (CLASSE_FILA).
+static uint32_t INICIO_CLASSE[ESTADOS_PILHA];
+static uint16_t CLASSE_FILA[ESTADOS_FILA];
+
+static void prepararTabelasIndice(void) {
+    static int prontas = 0;
+    if (prontas) {
+        return;
+    }
+    for (int c = 0; c < ESTADOS_FILA; c++) {
+        int resto = c;
+        for (int i = FILA_MAX - 1; i >= 0; i--) {
+            DIGITOS_FILA[c][i] = (uint8_t)(resto % NUM_TIPOS);
+            resto /= NUM_TIPOS;
+        }
+    }
+    for (int c = 0; c < ESTADOS_PILHA; c++) {
+        int k = (c >= INICIO_PILHA[1]) + (c >= INICIO_PILHA[2]) + (c >= INICIO_PILHA[3]);
+        // Alinha os k dígitos à esquerda (base no dígito mais significativo)
+        int resto = (c - INICIO_PILHA[k]) * POT7[PILHA_MAX - k];
+        for (int i = PILHA_MAX - 1; i >= 0; i--) {
+            DIGITOS_PILHA[c][i] = (uint8_t)(resto % NUM_TIPOS);
+            resto /= NUM_TIPOS;
+        }
+        DIGITOS_PILHA[c][PILHA_MAX] = (uint8_t)k;
+    }
+    for (int c = 0; c < ESTADOS_FILA; c++) {
+        int espelho = 0;
+        for (int i = 0; i < FILA_MAX; i++) {
+            espelho = espelho * NUM_TIPOS + ESPELHO_TIPO[DIGITOS_FILA[c][i]];
+        }
+        ESPELHO_FILA[c] = (uint16_t)espelho;
+    }
+    for (int c = 0; c < ESTADOS_PILHA; c++) {
+        int k = DIGITOS_PILHA[c][PILHA_MAX];
+        int espelho = 0;
+        for (int i = 0; i < k; i++) {
+            espelho = espelho * NUM_TIPOS + ESPELHO_TIPO[DIGITOS_PILHA[c][i]];
+        }
+        ESPELHO_PILHA[c] = (uint16_t)(INICIO_PILHA[k] + espelho);
+    }
+    int filas_canonicas = 0;
+    for (int c = 0; c < ESTADOS_FILA; c++) {
+        CLASSE_FILA[c] = ESPELHO_FILA[c] >= c ? (uint16_t)filas_canonicas++ : CLASSE_FILA[ESPELHO_FILA[c]];
+    }
+    uint32_t classes = 0;
+    for (int c = 0; c < ESTADOS_PILHA; c++) {
+        if (ESPELHO_PILHA[c] < c) {
+            INICIO_CLASSE[c] = INICIO_CLASSE[ESPELHO_PILHA[c]];
+            continue;
+        }
+        INICIO_CLASSE[c] = classes;
+        classes += ESPELHO_PILHA[c] == c ? (uint32_t)filas_canonicas : (uint32_t)ESTADOS_FILA;
+    }
+    prontas = 1;
+}
+
+/**
+ * @brief Unrank: índice denso -> estado compacto (inversa de rankEstado).
+ *
+ * Uma divisão e duas consultas a tabela; prepararTabelasIndice precisa
+ * ter sido chamada antes.
+ */
+static inline void unrankEstado(uint32_t indice, EstadoCompacto *e) {
+    uint32_t pilha = indice / (uint32_t)ESTADOS_FILA;
+    uint32_t fila = indice - pilha * (uint32_t)ESTADOS_FILA;
+    memcpy(e->fila, DIGITOS_FILA[fila], FILA_MAX);
+    memcpy(e->pilha, DIGITOS_PILHA[pilha], PILHA_MAX);
+    e->num_pilha = DIGITOS_PILHA[pilha][PILHA_MAX];
+}
+
+/**
+ * @brief Versões em lote de rank/unrank (laços simples, vetorizáveis).
+ */
+void rankLote(const EstadoCompacto *estados, uint32_t *indices, int n) {
+    for (int i = 0; i < n; i++) {
+        indices[i] = rankEstado(&estados[i]);
+    }
+}
+
+void unrankLote(const uint32_t *indices, EstadoCompacto *estados, int n) {
+    prepararTabelasIndice();
+    for (int i = 0; i < n; i++) {
+        unrankEstado(indices[i], &estados[i]);
+    }
+}
+
+/**
+ * @brief Índice denso do estado (fila, pilha) na tabela.
+ *
+ * @return Índice em [0, NUM_ESTADOS), ou -1 se a fila não estiver cheia.
+ */
+long indiceEstado(const Fila *f, const Pilha *p) {
+    if (f->total != FILA_MAX) {
+        return -1;
+    }
+    EstadoCompacto e;
+    compactarEstado(f, p, &e);
+    return rankEstado(&e);
+}
+
+// --- SIMETRIA DE ESPELHO ---
+
+/**
+ * @brief Índice do estado espelhado, sem decodificar o estado.
+ */
+static inline uint32_t espelharIndice(uint32_t indice) {
+    uint32_t pilha = indice / (uint32_t)ESTADOS_FILA;
+    uint32_t fila = indice - pilha * (uint32_t)ESTADOS_FILA;
+    return ESPELHO_PILHA[pilha] * (uint32_t)ESTADOS_FILA + ESPELHO_FILA[fila];
+}
+
+/**
+ * @brief Representante canônico da classe {estado, espelho}: o menor índice.
+ */
+static inline uint32_t indiceCanonico(uint32_t indice) {
+    uint32_t espelho = espelharIndice(indice);
+    return espelho < indice ? espelho : indice;
+}
+
+/**
+ * @brief Índice da classe {estado, espelho} em [0, NUM_CLASSES).
+ *
+ * Estado e espelho dão a mesma classe; a ordem das classes é a dos seus
+ * representantes canônicos. prepararTabelasIndice precisa ter sido chamada.
+ */
+static inline uint32_t classeDoIndice(uint32_t indice) {
+    uint32_t pilha = indice / (uint32_t)ESTADOS_FILA;
+    uint32_t fila = indice - pilha * (uint32_t)ESTADOS_FILA;
+    uint32_t espelho = ESPELHO_PILHA[pilha];
+    if (espelho == pilha) {
+        return INICIO_CLASSE[pilha] + CLASSE_FILA[fila];
+    }
+    if (espelho < pilha) {
+        pilha = espelho;
+        fila = ESPELHO_FILA[fila];
+    }
+    return INICIO_CLASSE[pilha] + fila;
+}
+
+
+// --- TABELA DE FINAIS (SOLUCIONADOR EXAUSTIVO) ---
+
+#define OBJETIVO_JOGAR_I 0        // +1 para cada peça I jogada
+#define OBJETIVO_I_DISPONIVEL 1   // +1 por peça jogada deixando um I na frente ou no topo
+
+#define TABELA_MAGICA "TSTABELA"
+#define TABELA_VERSAO 2
+
+/**
+ * @brief Cabeçalho do arquivo da tabela; a política vem logo depois,
+ * um byte (ação ótima) por classe de espelho (ver classeDoIndice).
+ */
+typedef struct {
+    char magica[8];
+    uint32_t versao;
+    uint32_t objetivo;
+    uint64_t num_estados;
+    float gama;
+    uint32_t iteracoes;
+    char reservado[32];
+} CabecalhoTabela;
+
+/**
+ * @brief Tabela aberta com mmap para consulta em O(1).
+ */
+typedef struct {
+    void *mapa;
+    size_t tamanho;
+    const CabecalhoTabela *cabecalho;
+    const unsigned char *politica;
+} TabelaPolitica;
+
+// Quantidade de peças na pilha a partir do código da pilha.
+static inline int pecasNaPilha(int pilha) {
+    return (pilha >= INICIO_PILHA[1]) + (pilha >= INICIO_PILHA[2]) + (pilha >= INICIO_PILHA[3]);
+}
+
+/**
+ * @brief Sucessores e recompensa de uma ação sobre um estado codificado.
+ *
+ * Para as opções 1 e 2, a peça nova é aleatória: os 7 sucessores são
+ * base + 0 .. base + 6 (contíguos). Para as demais, há um único sucessor.
+ *
+ * @return Índice base do(s) sucessor(es), ou -1 se a ação for ilegal.
+ */
+static long sucessorTabela(long estado, int acao, int objetivo, int *aleatorio, float *recompensa) {
+    int pilha = (int)(estado / ESTADOS_FILA);
+    int fila = (int)(estado % ESTADOS_FILA);
+    int k = pecasNaPilha(pilha);
+    int digitos = pilha - INICIO_PILHA[k];   // tipos da pilha, base -> topo
+    int frente = fila / POT7[FILA_MAX - 1];
+    int topo = digitos % NUM_TIPOS;
+    int resto = fila % POT7[FILA_MAX - 1];   // fila sem a frente
+    int disponivelI;
+
+    *aleatorio = 0;
+    switch (acao) {
+        case ACAO_JOGAR:
+            *aleatorio = 1;
+            disponivelI = resto / POT7[FILA_MAX - 2] == 0 || (k > 0 && topo == 0);
+            *recompensa = objetivo == OBJETIVO_JOGAR_I ? (frente == 0) : disponivelI;
+            return (long)pilha * ESTADOS_FILA + (long)resto * NUM_TIPOS;
+        case ACAO_RESERVAR:
+            if (k == PILHA_MAX) {
+                return -1;
+            }
+            *aleatorio = 1;
+            *recompensa = 0.0f;
+            pilha = INICIO_PILHA[k + 1] + digitos * NUM_TIPOS + frente;
+            return (long)pilha * ESTADOS_FILA + (long)resto * NUM_TIPOS;
+        case ACAO_USAR_RESERVA:
+            if (k == 0) {
+                return -1;
+            }
+            pilha = INICIO_PILHA[k - 1] + digitos / NUM_TIPOS;
+            disponivelI = frente == 0 || (k > 1 && (digitos / NUM_TIPOS) % NUM_TIPOS == 0);
+            *recompensa = objetivo == OBJETIVO_JOGAR_I ? (topo == 0) : disponivelI;
+            return (long)pilha * ESTADOS_FILA + fila;
+        case ACAO_TROCAR:
+            if (k == 0) {
+                return -1;
+            }
+            *recompensa = 0.0f;
+            pilha += frente - topo;
+            fila = topo * POT7[FILA_MAX - 1] + resto;
+            return (long)pilha * ESTADOS_FILA + fila;
+        case ACAO_TROCA_MULTIPLA: {
+            if (k < 3) {
+                return -1;
+            }
+            // Pilha (base, meio, topo) = (b, m, t); fila = (q0, q1, q2, ...).
+            int b = digitos / 49, m = (digitos / 7) % 7, t = digitos % 7;
+            int q0 = frente, q1 = (fila / POT7[3]) % 7, q2 = (fila / POT7[2]) % 7;
+            *recompensa = 0.0f;
+            pilha = INICIO_PILHA[3] + q2 * 49 + q1 * 7 + q0;
+            fila = t * POT7[4] + m * POT7[3] + b * POT7[2] + fila % POT7[2];
+            return (long)pilha * ESTADOS_FILA + fila;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Resolve o jogo por iteração de valor (Gauss-Seidel, com desconto).
+ *
+ * Estado e espelho têm o mesmo valor e a mesma jogada, então valores e
+ * política guardam uma entrada por classe (ver classeDoIndice): só os
+ * estados canônicos (ver indiceCanonico) são atualizados, e os sucessores
+ * são lidos na classe deles.
+ *
+ * @param politica Saída: NUM_CLASSES bytes com a melhor ação de cada classe.
+ * @return Número de varreduras feitas, ou -1 se faltar memória.
+ */
+int resolverTabela(int objetivo, float gama, float tolerancia, int max_iteracoes, unsigned char *politica) {
+    float *valor = calloc(NUM_CLASSES, sizeof(float));
+    if (!valor) {
+        return -1;
+    }
+
+    prepararTabelasIndice();
+    int it;
+    for (it = 1; it <= max_iteracoes; it++) {
+        float maior_delta = 0.0f;
+        for (long s = 0; s < NUM_ESTADOS; s++) {
+            if (indiceCanonico((uint32_t)s) != (uint32_t)s) {
+                continue;
+            }
+            uint32_t classe = classeDoIndice((uint32_t)s);
+            float melhor = -1.0f;
+            int melhor_acao = ACAO_JOGAR;
+            for (int a = ACAO_JOGAR; a <= ACAO_TROCA_MULTIPLA; a++) {
+                int aleatorio;
+                float r;
+                long base = sucessorTabela(s, a, objetivo, &aleatorio, &r);
+                if (base < 0) {
+                    continue;
+                }
+                float futuro = valor[classeDoIndice((uint32_t)base)];
+                if (aleatorio) {
+                    futuro = 0.0f;
+                    for (int x = 0; x < NUM_TIPOS; x++) {
+                        futuro += valor[classeDoIndice((uint32_t)(base + x))];
+                    }
+                    futuro /= NUM_TIPOS;
+                }
+                float q = r + gama * futuro;
+                if (q > melhor) {
+                    melhor = q;
+                    melhor_acao = a;
+                }
+            }
+            float delta = melhor - valor[classe];
+            if (delta < 0) delta = -delta;
+            if (delta > maior_delta) maior_delta = delta;
+            valor[classe] = melhor;
+            politica[classe] = (unsigned char)melhor_acao;
+        }
+        if (maior_delta < tolerancia) {
+            break;
+        }
+    }
+    free(valor);
+    return it > max_iteracoes ? max_iteracoes : it;
+}
+
+/**
+ * @brief Grava a política em arquivo (cabeçalho + um byte por classe).
+ *
+ * @return 0 em caso de sucesso, -1 em erro de escrita.
+ */
+int salvarTabela(const char *caminho, int objetivo, float gama, int iteracoes, const unsigned char *politica) {
+    FILE *arq = fopen(caminho, "wb");
+    if (!arq) {
+        return -1;
+    }
+    CabecalhoTabela cab;
+    memset(&cab, 0, sizeof(cab));
+    memcpy(cab.magica, TABELA_MAGICA, sizeof(cab.magica));
+    cab.versao = TABELA_VERSAO;
+    cab.objetivo = (uint32_t)objetivo;
+    cab.num_estados = NUM_CLASSES;
+    cab.gama = gama;
+    cab.iteracoes = (uint32_t)iteracoes;
+    int ok = fwrite(&cab, sizeof(cab), 1, arq) == 1
+          && fwrite(politica, 1, NUM_CLASSES, arq) == (size_t)NUM_CLASSES;
+    ok = fclose(arq) == 0 && ok;
+    return ok ? 0 : -1;
+}
+
+void fecharTabela(TabelaPolitica *t) {
+    if (t->mapa) {
+        munmap(t->mapa, t->tamanho);
+    }
+    t->mapa = NULL;
+}
+
+/**
+ * @brief Mapeia um arquivo de tabela em memória (somente leitura).
+ *
+ * @return 0 em caso de sucesso, -1 se o arquivo não existir ou for inválido.
+ */
+int abrirTabela(TabelaPolitica *t, const char *caminho) {
+    int fd = open(caminho, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != sizeof(CabecalhoTabela) + NUM_CLASSES) {
+        close(fd);
+        return -1;
+    }
+    void *mapa = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapa == MAP_FAILED) {
+        return -1;
+    }
+    t->mapa = mapa;
+    t->tamanho = st.st_size;
+    t->cabecalho = mapa;
+    t->politica = (const unsigned char *)mapa + sizeof(CabecalhoTabela);
+    if (memcmp(t->cabecalho->magica, TABELA_MAGICA, 8) != 0 || t->cabecalho->versao != TABELA_VERSAO
+        || t->cabecalho->num_estados != (uint64_t)NUM_CLASSES) {
+        fecharTabela(t);
+        return -1;
+    }
+    prepararTabelasIndice();
+    return 0;
+}
+
+/**
+ * @brief Melhor ação para o estado atual, segundo a tabela.
+ *
+ * @return Ação de 1 a 5, ou -1 se o estado não estiver na tabela.
+ */
+int consultarTabela(const TabelaPolitica *t, const Fila *f, const Pilha *p) {
+    long s = indiceEstado(f, p);
+    return s < 0 ? -1 : t->politica[classeDoIndice((uint32_t)s)];
+}
+
+
+// --- REPLAYS COM QUADROS-CHAVE ---
+
+// Formato do arquivo de replay:
+//   CabecalhoReplay
+//   QuadroChave (turno 0), ações 0 .. K-1 (um byte cada), elos 0 .. K-1,
+//   QuadroChave (turno K), ações K .. 2K-1, elos K .. 2K-1, ...
+//   QuadroChave (turno num_turnos), se num_turnos não for múltiplo de K
+//   IndiceQuadro[num_quadros]
+//   RodapeReplay
+// onde K é o intervalo entre quadros-chave. Para chegar ao turno N basta
+// carregar o quadro anterior a N e reaplicar no máximo K - 1 ações. O
+// quadro de fechamento deixa toda ação entre dois quadros, então as
+// últimas ações também são conferidas pela verificação.
+//
+// Cada quadro também guarda a cadeia de hashes do estado depois de cada
+// ação até o seu turno; duas partidas que divergem em algum turno têm
+// cadeias diferentes em todos os quadros seguintes. O elo t (uint32_t) é
+// a parte baixa da cadeia depois da ação t, então dentro de um bloco o
+// turno da divergência também sai de uma busca binária nos dados gravados.
+#define REPLAY_MAGICA "TSREPLAY"
+#define REPLAY_FIM "TSRPFIM"
+#define REPLAY_VERSAO 4
+#define REPLAY_INTERVALO_PADRAO 256
+
+typedef struct {
+    char magica[8];
+    uint32_t versao;
+    uint32_t intervalo;
+    uint64_t semente;
+} CabecalhoReplay;
+
+/**
+ * @brief Fotografia completa de uma sessão: fila e pilha (tipos, IDs e
+ * posições físicas) e o gerador. Campos sem peça ficam zerados, para que
+ * estados iguais tenham bytes iguais.
+ */
+typedef struct {
+    uint64_t turno;
+    uint64_t hash_cadeia;
+    uint64_t semente;
+    int32_t proximo_id;
+    int32_t fila_inicio;
+    int32_t fila_total;
+    int32_t pilha_topo;
+    int32_t fila_ids[FILA_MAX];
+    int32_t pilha_ids[PILHA_MAX];
+    char fila_nomes[FILA_MAX];
+    char pilha_nomes[PILHA_MAX];
+} QuadroChave;
+
+typedef struct {
+    uint64_t turno;
+    uint64_t posicao; // deslocamento do QuadroChave no arquivo
+} IndiceQuadro;
+
+typedef struct {
+    uint64_t num_turnos;
+    uint64_t num_quadros;
+    uint64_t posicao_indice;
+    char magica[8];
+} RodapeReplay;
+
+/**
+ * @brief Hash do conteúdo lógico da fila e da pilha (tipos e IDs).
+ */
+uint64_t hashSessao(const Sessao *s) {
+    uint64_t h = misturar64((uint64_t)s->fila.total << 8 | (uint64_t)(s->pilha.topo + 1));
+    int idx = s->fila.inicio;
+    for (int i = 0; i < s->fila.total; i++) {
+        h = misturar64(h ^ ((uint64_t)(uint32_t)s->fila.itens[idx].id << 8 | (unsigned char)s->fila.itens[idx].nome));
+        idx = (idx + 1) % FILA_MAX;
+    }
+    for (int i = 0; i <= s->pilha.topo; i++) {
+        h = misturar64(h ^ ((uint64_t)(uint32_t)s->pilha.itens[i].id << 8 | (unsigned char)s->pilha.itens[i].nome));
+    }
+    return h;
+}
+
+// Elo da cadeia de hashes: combina a cadeia até o turno anterior com o
+// hash do estado depois da ação.
+static inline uint64_t encadearHash(uint64_t cadeia, uint64_t estado) {
+    return misturar64(cadeia ^ (estado + PASSO_GERADOR));
+}
+
+void capturarQuadro(const Sessao *s, uint64_t turno, uint64_t hash_cadeia, QuadroChave *q) {
+    memset(q, 0, sizeof(*q));
+    q->turno = turno;
+    q->hash_cadeia = hash_cadeia;
+    q->semente = s->gerador.semente;
+    q->proximo_id = s->gerador.proximo_id;
+    q->fila_inicio = s->fila.inicio;
+    q->fila_total = s->fila.total;
+    q->pilha_topo = s->pilha.topo;
+    int idx = s->fila.inicio;
+    for (int i = 0; i < s->fila.total; i++) {
+        q->fila_ids[idx] = s->fila.itens[idx].id;
+        q->fila_nomes[idx] = s->fila.itens[idx].nome;
+        idx = (idx + 1) % FILA_MAX;
+    }
+    for (int i = 0; i <= s->pilha.topo; i++) {
+        q->pilha_ids[i] = s->pilha.itens[i].id;
+        q->pilha_nomes[i] = s->pilha.itens[i].nome;
+    }
+}
+
+void restaurarQuadro(const QuadroChave *q, Sessao *s) {
+    memset(s, 0, sizeof(*s));
+    s->gerador.semente = q->semente;
+    s->gerador.proximo_id = q->proximo_id;
+    s->fila.inicio = q->fila_inicio;
+    s->fila.total = q->fila_total;
+    s->fila.fim = (q->fila_inicio + q->fila_total) % FILA_MAX;
+    s->pilha.topo = q->pilha_topo;
+    for (int i = 0; i < FILA_MAX; i++) {
+        s->fila.itens[i].nome = q->fila_nomes[i];
+        s->fila.itens[i].id = q->fila_ids[i];
+    }
+    for (int i = 0; i < PILHA_MAX; i++) {
+        s->pilha.itens[i].nome = q->pilha_nomes[i];
+        s->pilha.itens[i].id = q->pilha_ids[i];
+    }
+}
+
+/**
+ * @brief Gravação incremental de um replay.
+ */
+typedef struct {
+    FILE *arq;
+    uint32_t intervalo;
+    uint64_t turnos;
+    uint64_t hash_cadeia;
+    Sessao ultima; // estado depois da última ação, para o quadro de fechamento
+    uint32_t *elos; // elos do bloco atual, gravados antes do próximo quadro
+    uint32_t num_elos;
+    IndiceQuadro *indice;
+    uint64_t num_quadros;
+    uint64_t capacidade;
+} GravadorReplay;
+
+static int gravarQuadro(GravadorReplay *g, const Sessao *s) {
+    if (g->num_quadros == g->capacidade) {
+        uint64_t nova = g->capacidade ? g->capacidade * 2 : 64;
+        IndiceQuadro *indice = realloc(g->indice, sizeof(IndiceQuadro) * nova);
+        if (!indice) {
+            return -1;
+        }
+        g->indice = indice;
+        g->capacidade = nova;
+    }
+    if (fwrite(g->elos, sizeof(uint32_t), g->num_elos, g->arq) != g->num_elos) {
+        return -1;
+    }
+    g->num_elos = 0;
+    QuadroChave q;
+    capturarQuadro(s, g->turnos, g->hash_cadeia, &q);
+    g->indice[g->num_quadros].turno = g->turnos;
+    g->indice[g->num_quadros].posicao = (uint64_t)ftell(g->arq);
+    g->num_quadros++;
+    return fwrite(&q, sizeof(q), 1, g->arq) == 1 ? 0 : -1;
+}
+
+/**
+ * @brief Cria o arquivo e grava o cabeçalho e o quadro do turno 0.
+ *
+ * @return 0 em caso de sucesso, -1 em erro.
+ */
+int gravadorAbrir(GravadorReplay *g, const char *caminho, const Sessao *inicial, uint32_t intervalo) {
+    memset(g, 0, sizeof(*g));
+    g->intervalo = intervalo ? intervalo : REPLAY_INTERVALO_PADRAO;
+    g->elos = malloc(sizeof(uint32_t) * g->intervalo);
+    g->arq = g->elos ? fopen(caminho, "wb") : NULL;
+    if (!g->arq) {
+        free(g->elos);
+        g->elos = NULL;
+        return -1;
+    }
+    CabecalhoReplay cab;
+    memset(&cab, 0, sizeof(cab));
+    memcpy(cab.magica, REPLAY_MAGICA, sizeof(cab.magica));
+    cab.versao = REPLAY_VERSAO;
+    cab.intervalo = g->intervalo;
+    cab.semente = inicial->gerador.semente;
+    g->hash_cadeia = hashSessao(inicial);
+    g->ultima = *inicial;
+    if (fwrite(&cab, sizeof(cab), 1, g->arq) != 1 || gravarQuadro(g, inicial) != 0) {
+        fclose(g->arq);
+        g->arq = NULL;
+        free(g->elos);
+        free(g->indice);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Registra a ação de um turno; 'depois' é a sessão já com a ação
+ * aplicada, gravada como quadro-chave a cada 'intervalo' turnos.
+ */
+int gravadorRegistrar(GravadorReplay *g, int acao, const Sessao *depois) {
+    if (fputc(acao, g->arq) == EOF) {
+        return -1;
+    }
+    g->turnos++;
+    g->hash_cadeia = encadearHash(g->hash_cadeia, hashSessao(depois));
+    g->elos[g->num_elos++] = (uint32_t)g->hash_cadeia;
+    g->ultima = *depois;
+    if (g->turnos % g->intervalo == 0) {
+        return gravarQuadro(g, depois);
+    }
+    return 0;
+}
+
+/**
+ * @brief Grava o quadro de fechamento (se o último turno não tiver um),
+ * o índice e o rodapé e fecha o arquivo.
+ */
+int gravadorFechar(GravadorReplay *g) {
+    int ok = g->turnos % g->intervalo == 0 || gravarQuadro(g, &g->ultima) == 0;
+    RodapeReplay rodape;
+    memset(&rodape, 0, sizeof(rodape));
+    rodape.num_turnos = g->turnos;
+    rodape.num_quadros = g->num_quadros;
+    rodape.posicao_indice = (uint64_t)ftell(g->arq);
+    memcpy(rodape.magica, REPLAY_FIM, sizeof(REPLAY_FIM));
+    ok = ok && fwrite(g->indice, sizeof(IndiceQuadro), g->num_quadros, g->arq) == g->num_quadros
+          && fwrite(&rodape, sizeof(rodape), 1, g->arq) == 1;
+    ok = fclose(g->arq) == 0 && ok;
+    free(g->elos);
+    free(g->indice);
+    memset(g, 0, sizeof(*g));
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Replay aberto com mmap.
+ */
+typedef struct {
+    void *mapa;
+    size_t tamanho;
+    const CabecalhoReplay *cabecalho;
+    const IndiceQuadro *indice;
+    uint64_t num_quadros;
+    uint64_t num_turnos;
+} Replay;
+
+// Quadro-chave q do replay.
+static inline const QuadroChave *replayQuadro(const Replay *r, uint64_t q) {
+    return (const QuadroChave *)((const char *)r->mapa + r->indice[q].posicao);
+}
+
+void replayFechar(Replay *r) {
+    if (r->mapa) {
+        munmap(r->mapa, r->tamanho);
+    }
+    r->mapa = NULL;
+}
+
+// Turno do quadro q: múltiplo do intervalo, exceto o último (fechamento).
+static inline uint64_t turnoDoQuadro(const Replay *r, uint64_t q) {
+    return q + 1 < r->num_quadros ? q * r->cabecalho->intervalo : r->num_turnos;
+}
+
+// Campos de um quadro-chave que restaurarQuadro usa como índices.
+static int quadroValido(const QuadroChave *q, uint64_t turno, uint64_t semente) {
+    return q->turno == turno && q->semente == semente && q->proximo_id >= 0
+        && q->fila_inicio >= 0 && q->fila_inicio < FILA_MAX
+        && q->fila_total >= 0 && q->fila_total <= FILA_MAX
+        && q->pilha_topo >= -1 && q->pilha_topo < PILHA_MAX;
+}
+
+/**
+ * @brief Mapeia um replay e valida cabeçalho, rodapé e índice.
+ *
+ * O layout é todo determinado pelo intervalo e pelo número de turnos:
+ * cada entrada do índice precisa apontar para o quadro do seu turno, na
+ * posição em que o gravador o teria escrito, e os campos de cada quadro
+ * precisam estar nas faixas válidas. Assim um índice corrompido é
+ * recusado aqui, em vez de levar a leituras fora do arquivo.
+ *
+ * @return 0 em caso de sucesso, -1 se o arquivo for inválido.
+ */
+int replayAbrir(Replay *r, const char *caminho) {
+    memset(r, 0, sizeof(*r));
+    int fd = open(caminho, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CabecalhoReplay) + sizeof(RodapeReplay)) {
+        close(fd);
+        return -1;
+    }
+    void *mapa = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapa == MAP_FAILED) {
+        return -1;
+    }
+    r->mapa = mapa;
+    r->tamanho = st.st_size;
+    r->cabecalho = mapa;
+
+    const RodapeReplay *rodape = (const RodapeReplay *)((const char *)mapa + r->tamanho - sizeof(RodapeReplay));
+    uint64_t intervalo = r->cabecalho->intervalo;
+    if (memcmp(r->cabecalho->magica, REPLAY_MAGICA, 8) != 0 || r->cabecalho->versao != REPLAY_VERSAO
+        || intervalo == 0 || memcmp(rodape->magica, REPLAY_FIM, sizeof(REPLAY_FIM)) != 0
+        || rodape->num_turnos > r->tamanho
+        || rodape->num_quadros != (rodape->num_turnos + intervalo - 1) / intervalo + 1
+        || rodape->posicao_indice > r->tamanho
+        || rodape->posicao_indice + rodape->num_quadros * sizeof(IndiceQuadro) + sizeof(RodapeReplay) != r->tamanho) {
+        replayFechar(r);
+        return -1;
+    }
+    r->indice = (const IndiceQuadro *)((const char *)mapa + rodape->posicao_indice);
+    r->num_quadros = rodape->num_quadros;
+    r->num_turnos = rodape->num_turnos;
+
+    // Quadro q no turno q * intervalo (o último, em num_turnos), logo
+    // depois das ações do anterior.
+    uint64_t posicao = sizeof(CabecalhoReplay);
+    for (uint64_t q = 0; q < r->num_quadros; q++) {
+        uint64_t turno = turnoDoQuadro(r, q);
+        uint64_t proximo = q + 1 < r->num_quadros ? turnoDoQuadro(r, q + 1) : r->num_turnos;
+        if (r->indice[q].turno != turno || r->indice[q].posicao != posicao
+            || posicao + sizeof(QuadroChave) > rodape->posicao_indice
+            || !quadroValido(replayQuadro(r, q), turno, r->cabecalho->semente)) {
+            replayFechar(r);
+            return -1;
+        }
+        posicao += sizeof(QuadroChave) + (proximo - turno) * (1 + sizeof(uint32_t));
+    }
+    if (posicao != rodape->posicao_indice) {
+        replayFechar(r);
+        return -1;
+    }
+    return 0;
+}
+
+// Ação do turno t (0 <= t < num_turnos), que leva do estado t ao t + 1.
+static inline int replayAcao(const Replay *r, uint64_t t) {
+    uint64_t q = t / r->cabecalho->intervalo;
+    const unsigned char *acoes = (const unsigned char *)replayQuadro(r, q) + sizeof(QuadroChave);
+    return acoes[t - r->indice[q].turno];
+}
+
+// Elo gravado depois da ação t (0 <= t < num_turnos): cadeia truncada.
+static inline uint32_t replayElo(const Replay *r, uint64_t t) {
+    uint64_t q = t / r->cabecalho->intervalo;
+    uint64_t acoes = turnoDoQuadro(r, q + 1) - r->indice[q].turno;
+    const unsigned char *elos = (const unsigned char *)replayQuadro(r, q) + sizeof(QuadroChave) + acoes;
+    uint32_t elo;
+    memcpy(&elo, elos + (t - r->indice[q].turno) * sizeof(uint32_t), sizeof(elo));
+    return elo;
+}
+
+/**
+ * @brief Reconstrói a sessão no início do turno dado.
+ *
+ * Carrega o último quadro-chave até 'turno' e reaplica as ações seguintes
+ * (no máximo intervalo - 1).
+ *
+ * @return 0 em caso de sucesso, -1 se o turno estiver fora do replay.
+ */
+int replayBuscar(const Replay *r, uint64_t turno, Sessao *s) {
+    if (turno > r->num_turnos) {
+        return -1;
+    }
+    uint64_t q = turno / r->cabecalho->intervalo;
+    if (q >= r->num_quadros) {
+        q = r->num_quadros - 1;
+    }
+    restaurarQuadro(replayQuadro(r, q), s);
+    for (uint64_t t = r->indice[q].turno; t < turno; t++) {
+        aplicarAcaoSessao(s, replayAcao(r, t));
+    }
+    return 0;
+}
+
+
+// --- VERIFICAÇÃO PARALELA DE REPLAYS ---
+
+/**
+ * @brief Verificação de vários replays dividida por segmentos.
+ *
+ * Um segmento é o trecho entre dois quadros-chave consecutivos: parte do
+ * quadro q, reaplica as ações e compara o estado final com o quadro q + 1.
+ * O quadro de fechamento cobre as últimas ações, e o quadro 0 é comparado
+ * com o início de partida da semente do cabeçalho.
+ * Os segmentos de todos os replays formam uma única lista de trabalho,
+ * consumida em blocos pelas threads através de um contador atômico.
+ */
+typedef struct {
+    const Replay *replays;
+    int num_replays;
+    const uint64_t *primeiro_segmento; // prefixo: 1º segmento global de cada replay
+    uint64_t total_segmentos;
+    atomic_uint_fast64_t proximo;
+    atomic_uint_fast64_t *divergencias;    // por replay
+    atomic_uint_fast64_t *primeira_falha;  // por replay: menor segmento divergente
+} VerificacaoReplays;
+
+#define VERIFICACAO_BLOCO 16
+
+// Reexecuta o segmento q, conferindo os elos gravados, e compara com o
+// quadro q + 1. Retorna 1 se bater.
+static int verificarSegmento(const Replay *r, uint64_t q) {
+    Sessao s;
+    restaurarQuadro(replayQuadro(r, q), &s);
+    uint64_t cadeia = replayQuadro(r, q)->hash_cadeia;
+    uint64_t fim = r->indice[q + 1].turno;
+    for (uint64_t t = r->indice[q].turno; t < fim; t++) {
+        aplicarAcaoSessao(&s, replayAcao(r, t));
+        cadeia = encadearHash(cadeia, hashSessao(&s));
+        if ((uint32_t)cadeia != replayElo(r, t)) {
+            return 0;
+        }
+    }
+    QuadroChave obtido;
+    capturarQuadro(&s, fim, cadeia, &obtido);
+    return memcmp(&obtido, replayQuadro(r, q + 1), sizeof(QuadroChave)) == 0;
+}
+
+// Compara o quadro 0 com iniciarSessao(semente). Retorna 1 se bater.
+static int verificarQuadroInicial(const Replay *r) {
+    Sessao s;
+    iniciarSessao(&s, r->cabecalho->semente);
+    QuadroChave esperado;
+    capturarQuadro(&s, 0, hashSessao(&s), &esperado);
+    return memcmp(&esperado, replayQuadro(r, 0), sizeof(QuadroChave)) == 0;
+}
+
+static void *threadVerificacao(void *arg) {
+    VerificacaoReplays *v = arg;
+    for (;;) {
+        uint64_t inicio = atomic_fetch_add(&v->proximo, VERIFICACAO_BLOCO);
+        if (inicio >= v->total_segmentos) {
+            break;
+        }
+        uint64_t fim = inicio + VERIFICACAO_BLOCO;
+        if (fim > v->total_segmentos) {
+            fim = v->total_segmentos;
+        }
+        // Replay que contém o segmento 'inicio' (busca binária no prefixo)
+        int lo = 0, hi = v->num_replays - 1;
+        while (lo < hi) {
+            int meio = (lo + hi + 1) / 2;
+            if (v->primeiro_segmento[meio] <= inicio) {
+                lo = meio;
+            } else {
+                hi = meio - 1;
+            }
+        }
+        for (uint64_t g = inicio; g < fim; g++) {
+            while (g >= v->primeiro_segmento[lo + 1]) {
+                lo++;
+            }
+            uint64_t q = g - v->primeiro_segmento[lo];
+            if (!verificarSegmento(&v->replays[lo], q)) {
+                atomic_fetch_add(&v->divergencias[lo], 1);
+                uint64_t atual = atomic_load(&v->primeira_falha[lo]);
+                while (q < atual && !atomic_compare_exchange_weak(&v->primeira_falha[lo], &atual, q)) {
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Verifica todos os replays com 'num_threads' threads.
+ *
+ * @param divergencias   Saída: segmentos divergentes de cada replay, mais 1
+ *                       se o quadro 0 não for o início da semente.
+ * @param primeira_falha Saída: turno inicial do primeiro segmento divergente
+ *                       (0 se o quadro 0 divergir, UINT64_MAX se não houver).
+ * @return 0 em caso de sucesso, -1 se faltar memória ou recursos.
+ */
+int verificarReplays(const Replay *replays, int n, int num_threads,
+                     uint64_t *divergencias, uint64_t *primeira_falha) {
+    VerificacaoReplays v;
+    uint64_t *prefixo = malloc(sizeof(uint64_t) * (n + 1));
+    v.divergencias = malloc(sizeof(atomic_uint_fast64_t) * n);
+    v.primeira_falha = malloc(sizeof(atomic_uint_fast64_t) * n);
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+    if (!prefixo || !v.divergencias || !v.primeira_falha || !threads) {
+        free(prefixo);
+        free(v.divergencias);
+        free(v.primeira_falha);
+        free(threads);
+        return -1;
+    }
+    prefixo[0] = 0;
+    for (int i = 0; i < n; i++) {
+        prefixo[i + 1] = prefixo[i] + replays[i].num_quadros - 1;
+        int inicial_ok = verificarQuadroInicial(&replays[i]);
+        atomic_init(&v.divergencias[i], inicial_ok ? 0 : 1);
+        atomic_init(&v.primeira_falha[i], inicial_ok ? UINT64_MAX : 0);
+    }
+    v.replays = replays;
+    v.num_replays = n;
+    v.primeiro_segmento = prefixo;
+    v.total_segmentos = prefixo[n];
+    atomic_init(&v.proximo, 0);
+
+    int criadas = 0;
+    for (; criadas < num_threads; criadas++) {
+        if (pthread_create(&threads[criadas], NULL, threadVerificacao, &v) != 0) {
+            break;
+        }
+    }
+    if (criadas == 0) {
+        threadVerificacao(&v); // sem threads extras, verifica na thread atual
+    }
+    for (int i = 0; i < criadas; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < n; i++) {
+        divergencias[i] = atomic_load(&v.divergencias[i]);
+        uint64_t q = atomic_load(&v.primeira_falha[i]);
+        primeira_falha[i] = q == UINT64_MAX ? UINT64_MAX : replays[i].indice[q].turno;
+    }
+    free(prefixo);
+    free(v.divergencias);
+    free(v.primeira_falha);
+    free(threads);
+    return 0;
+}
+
+
+// --- DIFERENÇA ENTRE REPLAYS ---
+
+/**
+ * @brief Quadros-chave que a e b têm no mesmo turno (todos, menos talvez
+ * o de fechamento do mais curto).
+ */
+static uint64_t quadrosEmComum(const Replay *a, const Replay *b) {
+    uint64_t n = a->num_quadros < b->num_quadros ? a->num_quadros : b->num_quadros;
+    while (n > 0 && a->indice[n - 1].turno != b->indice[n - 1].turno) {
+        n--;
+    }
+    return n;
+}
+
+/**
+ * @brief Primeiro quadro-chave em que as cadeias de hash de a e b diferem.
+ *
+ * Como a cadeia acumula todos os estados anteriores, "diferente" é uma
+ * propriedade monotônica ao longo dos quadros e a busca é binária.
+ *
+ * @return Índice do quadro, ou o número de quadros em comum se todos baterem.
+ */
+uint64_t primeiroQuadroDivergente(const Replay *a, const Replay *b) {
+    uint64_t lo = 0;
+    uint64_t hi = quadrosEmComum(a, b);
+    while (lo < hi) {
+        uint64_t meio = lo + (hi - lo) / 2;
+        if (replayQuadro(a, meio)->hash_cadeia != replayQuadro(b, meio)->hash_cadeia) {
+            hi = meio;
+        } else {
+            lo = meio + 1;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Primeiro turno em que os estados gravados em dois replays diferem.
+ *
+ * Só compara o que foi gravado, sem reexecutar nada, então encontra a
+ * divergência entre gravações de versões diferentes do motor mesmo que
+ * as ações sejam as mesmas. Localiza o bloco pela busca binária nas
+ * cadeias dos quadros e depois faz outra busca binária nos elos do bloco
+ * (depois do último quadro em comum, nos elos dos turnos em comum).
+ *
+ * @return Turno do primeiro estado diferente (0 = estados iniciais), -1 se
+ *         os replays coincidirem no trecho em comum, -2 se os intervalos
+ *         entre quadros forem diferentes.
+ */
+int64_t primeiroTurnoDivergente(const Replay *a, const Replay *b) {
+    if (a->cabecalho->intervalo != b->cabecalho->intervalo) {
+        return -2;
+    }
+    uint64_t comuns = quadrosEmComum(a, b);
+    uint64_t q = primeiroQuadroDivergente(a, b);
+    if (q == 0) {
+        return 0;
+    }
+    // Ações [lo, hi) do bloco que começa no quadro q - 1
+    uint64_t lo = a->indice[q - 1].turno;
+    uint64_t hi = q < comuns ? a->indice[q].turno
+                             : (a->num_turnos < b->num_turnos ? a->num_turnos : b->num_turnos);
+    uint64_t fim = hi;
+    while (lo < hi) {
+        uint64_t meio = lo + (hi - lo) / 2;
+        if (replayElo(a, meio) != replayElo(b, meio)) {
+            hi = meio;
+        } else {
+            lo = meio + 1;
+        }
+    }
+    if (lo < fim) {
+        return (int64_t)(lo + 1);
+    }
+    // Elos iguais até o fim do bloco: só o quadro q difere (colisão dos
+    // 32 bits baixos), ou não há divergência no trecho em comum.
+    return q < comuns ? (int64_t)fim : -1;
+}
+
+/**
+ * @brief Compara um replay com a reexecução contínua pelo motor atual.
+ *
+ * A simulação parte do quadro 0 e segue só pelas ações; a cada turno a
+ * cadeia calculada é comparada com o elo gravado e, a cada quadro, com a
+ * cadeia completa.
+ *
+ * @param turno Saída: primeiro estado divergente (0 = estado inicial).
+ * @return 1 se houve divergência, 0 se o replay bate com o motor.
+ */
+int divergenciaAoVivo(const Replay *r, uint64_t *turno) {
+    Sessao s;
+    restaurarQuadro(replayQuadro(r, 0), &s);
+    uint64_t cadeia = hashSessao(&s);
+    if (cadeia != replayQuadro(r, 0)->hash_cadeia) {
+        *turno = 0;
+        return 1;
+    }
+    for (uint64_t q = 1; q < r->num_quadros; q++) {
+        for (uint64_t t = r->indice[q - 1].turno; t < r->indice[q].turno; t++) {
+            aplicarAcaoSessao(&s, replayAcao(r, t));
+            cadeia = encadearHash(cadeia, hashSessao(&s));
+            if ((uint32_t)cadeia != replayElo(r, t)) {
+                *turno = t + 1;
+                return 1;
+            }
+        }
+        if (cadeia != replayQuadro(r, q)->hash_cadeia) {
+            *turno = r->indice[q].turno;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// --- COMPRESSÃO DE REPLAYS (rANS) ---
+
+// Um replay compactado guarda só o quadro inicial e as ações: os demais
+// quadros-chave, a cadeia de hashes e o índice são recalculados na
+// descompactação, que reproduz o arquivo original byte a byte.
+//
+//   CabecalhoCompactado
+//   QuadroChave (turno 0)
+//   para cada bloco: CabecalhoBlocoRans + bytes rANS
+//
+// As ações de cada bloco são codificadas com rANS de 16 estados
+// intercalados e frequências próprias do bloco (modelo adaptado bloco a
+// bloco), o que aproveita a distribuição desigual das opções do menu.
+#define COMPACTADO_MAGICA "TSRPZIP"
+#define COMPACTADO_VERSAO 1
+#define RANS_BLOCO 65536
+#define RANS_BITS_PROB 12
+#define RANS_TOTAL (1u << RANS_BITS_PROB)
+#define RANS_L (1u << 16)  // estados em [2^16, 2^32), renormalização de 16 bits
+#define RANS_SIMBOLOS 8   // ações cabem em 3 bits
+#define RANS_ESTADOS 16   // estados intercalados: a ação i usa o estado i % 16
+
+typedef struct {
+    char magica[8];
+    uint32_t versao;
+    uint32_t intervalo;
+    uint64_t num_turnos;
+    uint64_t num_blocos;
+} CabecalhoCompactado;
+
+typedef struct {
+    uint32_t num_simbolos;
+    uint32_t num_bytes;
+    uint16_t freq[RANS_SIMBOLOS];
+} CabecalhoBlocoRans;
+
+// Normaliza as contagens para somarem RANS_TOTAL, sem zerar símbolos presentes.
+static void normalizarFrequencias(const uint32_t *contagem, uint32_t n, uint16_t *freq) {
+    uint32_t soma = 0;
+    int maior = 0;
+    for (int s = 0; s < RANS_SIMBOLOS; s++) {
+        freq[s] = 0;
+        if (contagem[s]) {
+            uint64_t f = (uint64_t)contagem[s] * RANS_TOTAL / n;
+            freq[s] = (uint16_t)(f ? f : 1);
+        }
+        soma += freq[s];
+        if (contagem[s] > contagem[maior]) {
+            maior = s;
+        }
+    }
+    // Acerta a diferença no símbolo mais frequente (sempre sobra >= 1).
+    freq[maior] = (uint16_t)(freq[maior] + (int32_t)RANS_TOTAL - (int32_t)soma);
+}
+
+/**
+ * @brief Codifica n ações (n <= RANS_BLOCO) em 'saida'.
+ *
+ * @param saida Buffer com pelo menos 2 * n + 64 bytes.
+ * @return Número de bytes escritos.
+ */
+uint32_t ransCodificar(const uint8_t *acoes, uint32_t n, CabecalhoBlocoRans *cab, uint8_t *saida, uint32_t capacidade) {
+    uint32_t contagem[RANS_SIMBOLOS] = {0};
+    for (uint32_t i = 0; i < n; i++) {
+        contagem[acoes[i] & (RANS_SIMBOLOS - 1)]++;
+    }
+    normalizarFrequencias(contagem, n ? n : 1, cab->freq);
+    uint32_t inicio[RANS_SIMBOLOS];
+    uint32_t acumulado = 0;
+    for (int s = 0; s < RANS_SIMBOLOS; s++) {
+        inicio[s] = acumulado;
+        acumulado += cab->freq[s];
+    }
+
+    // Codifica de trás para frente, escrevendo do fim do buffer para o início,
+    // para que o decodificador leia as palavras na ordem crescente das ações.
+    uint32_t x[RANS_ESTADOS];
+    for (int k = 0; k < RANS_ESTADOS; k++) {
+        x[k] = RANS_L;
+    }
+    uint8_t *p = saida + capacidade;
+    for (uint32_t i = n; i-- > 0;) {
+        int s = acoes[i] & (RANS_SIMBOLOS - 1);
+        uint32_t f = cab->freq[s];
+        uint32_t *xi = &x[i % RANS_ESTADOS];
+        // Em 64 bits: com f == RANS_TOTAL (bloco de um só símbolo) o limite
+        // é 2^32 e não cabe em uint32_t.
+        if (*xi >= ((uint64_t)(RANS_L >> RANS_BITS_PROB) << 16) * f) {
+            p -= 2;
+            p[0] = (uint8_t)*xi;
+            p[1] = (uint8_t)(*xi >> 8);
+            *xi >>= 16;
+        }
+        *xi = ((*xi / f) << RANS_BITS_PROB) + (*xi % f) + inicio[s];
+    }
+    for (int k = RANS_ESTADOS - 1; k >= 0; k--) {
+        p -= 4;
+        p[0] = (uint8_t)x[k];
+        p[1] = (uint8_t)(x[k] >> 8);
+        p[2] = (uint8_t)(x[k] >> 16);
+        p[3] = (uint8_t)(x[k] >> 24);
+    }
+    uint32_t tamanho = (uint32_t)(saida + capacidade - p);
+    memmove(saida, p, tamanho);
+    cab->num_simbolos = n;
+    cab->num_bytes = tamanho;
+    return tamanho;
+}
+
+// Um passo de decodificação do estado x; renormaliza lendo no máximo uma
+// palavra de 16 bits. A palavra só é lida se couber antes de
+// 'fim'; sem ela, p passa de 'fim' e quem chama detecta o fluxo truncado.
+static inline uint8_t ransPasso(uint32_t *x, const uint32_t *tabela, const uint8_t **p, const uint8_t *fim) {
+    uint32_t e = tabela[*x & (RANS_TOTAL - 1)];
+    uint32_t v = (e >> 19) * (*x >> RANS_BITS_PROB) + ((e >> 3) & (RANS_TOTAL - 1));
+    uint32_t le = v < RANS_L;
+    uint32_t palavra = fim - *p >= 2 ? (uint32_t)(*p)[0] | (uint32_t)(*p)[1] << 8 : 0;
+    *x = v << (16 * le) | (palavra & (0u - le));
+    *p += 2 * le;
+    return (uint8_t)(e & 7);
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// Para cada máscara de estados que precisam de renormalização, a posição
+// de cada estado dentro das palavras lidas (quantos bits ligados abaixo).
+static uint32_t PERMUTA_RANS[256][8];
+
+static void prepararPermutaRans(void) {
+    for (int m = 0; m < 256; m++) {
+        int pos = 0;
+        for (int j = 0; j < 8; j++) {
+            PERMUTA_RANS[m][j] = (uint32_t)pos;
+            pos += (m >> j) & 1;
+        }
+    }
+}
+
+// Decodifica 8 ações com 8 estados em um registrador AVX2 e lê as
+// palavras de renormalização dos estados que precisarem, em ordem.
+__attribute__((target("avx2")))
+static inline __m256i ransPassoAvx2(__m256i x, const uint32_t *tabela, const uint8_t **p, uint8_t *acoes) {
+    const __m256i mascara = _mm256_set1_epi32(RANS_TOTAL - 1);
+    const __m256i vies = _mm256_set1_epi32((int)0x80000000u);
+    const __m256i limite = _mm256_set1_epi32((int)(RANS_L ^ 0x80000000u));
+    const __m256i bytes_baixos = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                  0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i junta = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+
+    __m256i e = _mm256_i32gather_epi32((const int *)tabela, _mm256_and_si256(x, mascara), 4);
+    __m256i f = _mm256_srli_epi32(e, 19);
+    __m256i desl = _mm256_and_si256(_mm256_srli_epi32(e, 3), mascara);
+    x = _mm256_add_epi32(_mm256_mullo_epi32(f, _mm256_srli_epi32(x, RANS_BITS_PROB)), desl);
+
+    __m256i s = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(e, bytes_baixos), junta);
+    uint64_t simbolos = (uint64_t)_mm_cvtsi128_si64(_mm256_castsi256_si128(s)) & 0x0707070707070707ULL;
+    memcpy(acoes, &simbolos, 8);
+
+    __m256i precisa = _mm256_cmpgt_epi32(limite, _mm256_xor_si256(x, vies));
+    int m = _mm256_movemask_ps(_mm256_castsi256_ps(precisa));
+    __m256i palavras = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)*p));
+    palavras = _mm256_permutevar8x32_epi32(palavras, _mm256_loadu_si256((const __m256i *)PERMUTA_RANS[m]));
+    *p += 2 * __builtin_popcount((unsigned)m);
+    return _mm256_blendv_epi8(x, _mm256_or_si256(_mm256_slli_epi32(x, 16), palavras), precisa);
+}
+
+/**
+ * @brief Decodifica grupos de 16 ações com os estados em dois registradores
+ * AVX2, para que as latências de um se sobreponham às do outro.
+ *
+ * Para quando faltarem menos de 32 bytes no fluxo (cada meio grupo lê 16
+ * bytes de uma vez); o restante fica para o laço escalar.
+ *
+ * @return Número de ações decodificadas (múltiplo de 16).
+ */
+__attribute__((target("avx2")))
+static uint32_t ransDecodificarAvx2(uint32_t *estados, const uint32_t *tabela, const uint8_t **pp,
+                                    const uint8_t *fim, uint8_t *acoes, uint32_t n) {
+    const uint8_t *p = *pp;
+    __m256i a = _mm256_loadu_si256((const __m256i *)estados);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(estados + 8));
+    uint32_t i = 0;
+    for (; i + RANS_ESTADOS <= n && fim - p >= 32; i += RANS_ESTADOS) {
+        a = ransPassoAvx2(a, tabela, &p, acoes + i);
+        b = ransPassoAvx2(b, tabela, &p, acoes + i + 8);
+    }
+    _mm256_storeu_si256((__m256i *)estados, a);
+    _mm256_storeu_si256((__m256i *)(estados + 8), b);
+    *pp = p;
+    return i;
+}
+#endif
+
+/**
+ * @brief Decodifica um bloco produzido por ransCodificar.
+ *
+ * Cada posição da tabela de decodificação (RANS_TOTAL entradas) guarda
+ * frequência, deslocamento dentro do símbolo e o símbolo, então cada
+ * ação custa uma consulta, uma multiplicação e uma renormalização. Com
+ * AVX2 os estados avançam de 8 em 8; o laço escalar lê o mesmo fluxo.
+ * Nenhuma leitura passa de dados + num_bytes: um bloco corrompido para
+ * assim que o fluxo acaba.
+ *
+ * @return Número de bytes consumidos (igual a num_bytes se o bloco estiver
+ *         íntegro), ou UINT32_MAX se as frequências forem inválidas ou o
+ *         fluxo acabar antes das ações.
+ */
+uint32_t ransDecodificar(const CabecalhoBlocoRans *cab, const uint8_t *dados, uint8_t *acoes) {
+    uint32_t soma = 0;
+    for (int s = 0; s < RANS_SIMBOLOS; s++) {
+        soma += cab->freq[s];
+    }
+    if (soma != RANS_TOTAL || cab->num_bytes < 4 * RANS_ESTADOS) {
+        return UINT32_MAX;
+    }
+    const uint8_t *fim = dados + cab->num_bytes;
+    uint32_t tabela[RANS_TOTAL];
+    uint32_t inicio = 0;
+    for (uint32_t s = 0; s < RANS_SIMBOLOS; s++) {
+        for (uint32_t j = 0; j < cab->freq[s]; j++) {
+            tabela[inicio + j] = (uint32_t)cab->freq[s] << 19 | j << 3 | s;
+        }
+        inicio += cab->freq[s];
+    }
+
+    const uint8_t *p = dados;
+    uint32_t x[RANS_ESTADOS];
+    for (int k = 0; k < RANS_ESTADOS; k++) {
+        x[k] = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+        p += 4;
+    }
+    uint32_t n = cab->num_simbolos;
+    uint32_t i = 0;
+#if defined(__GNUC__) && defined(__x86_64__)
+    static int avx2 = -1;
+    if (avx2 < 0) {
+        prepararPermutaRans();
+        avx2 = __builtin_cpu_supports("avx2");
+    }
+    if (avx2) {
+        i = ransDecodificarAvx2(x, tabela, &p, fim, acoes, n);
+    }
+#endif
+    for (; i < n && p <= fim; i++) {
+        acoes[i] = ransPasso(&x[i % RANS_ESTADOS], tabela, &p, fim);
+    }
+    return p <= fim && i == n ? (uint32_t)(p - dados) : UINT32_MAX;
+}
+
+/**
+ * @brief Compacta um replay aberto em 'caminho'.
+ *
+ * @return 0 em caso de sucesso, -1 em erro.
+ */
+int compactarReplay(const Replay *r, const char *caminho) {
+    FILE *arq = fopen(caminho, "wb");
+    if (!arq) {
+        return -1;
+    }
+    uint8_t *acoes = malloc(RANS_BLOCO);
+    uint32_t capacidade = 2 * RANS_BLOCO + 64;
+    uint8_t *saida = malloc(capacidade);
+    if (!acoes || !saida) {
+        free(acoes);
+        free(saida);
+        fclose(arq);
+        return -1;
+    }
+
+    CabecalhoCompactado cab;
+    memset(&cab, 0, sizeof(cab));
+    memcpy(cab.magica, COMPACTADO_MAGICA, sizeof(COMPACTADO_MAGICA));
+    cab.versao = COMPACTADO_VERSAO;
+    cab.intervalo = r->cabecalho->intervalo;
+    cab.num_turnos = r->num_turnos;
+    cab.num_blocos = (r->num_turnos + RANS_BLOCO - 1) / RANS_BLOCO;
+    int ok = fwrite(&cab, sizeof(cab), 1, arq) == 1
+          && fwrite(replayQuadro(r, 0), sizeof(QuadroChave), 1, arq) == 1;
+
+    for (uint64_t b = 0; ok && b < cab.num_blocos; b++) {
+        uint64_t t0 = b * RANS_BLOCO;
+        uint32_t n = (uint32_t)(r->num_turnos - t0 < RANS_BLOCO ? r->num_turnos - t0 : RANS_BLOCO);
+        for (uint32_t i = 0; i < n; i++) {
+            acoes[i] = (uint8_t)replayAcao(r, t0 + i);
+        }
+        CabecalhoBlocoRans bloco;
+        memset(&bloco, 0, sizeof(bloco));
+        uint32_t tamanho = ransCodificar(acoes, n, &bloco, saida, capacidade);
+        ok = fwrite(&bloco, sizeof(bloco), 1, arq) == 1 && fwrite(saida, 1, tamanho, arq) == tamanho;
+    }
+    ok = fclose(arq) == 0 && ok;
+    free(acoes);
+    free(saida);
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Replay compactado aberto com mmap.
+ */
+typedef struct {
+    void *mapa;
+    size_t tamanho;
+    const CabecalhoCompactado *cabecalho;
+    const QuadroChave *inicial;
+} ReplayCompactado;
+
+void compactadoFechar(ReplayCompactado *c) {
+    if (c->mapa) {
+        munmap(c->mapa, c->tamanho);
+    }
+    c->mapa = NULL;
+}
+
+int compactadoAbrir(ReplayCompactado *c, const char *caminho) {
+    memset(c, 0, sizeof(*c));
+    int fd = open(caminho, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CabecalhoCompactado) + sizeof(QuadroChave)) {
+        close(fd);
+        return -1;
+    }
+    void *mapa = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapa == MAP_FAILED) {
+        return -1;
+    }
+    c->mapa = mapa;
+    c->tamanho = st.st_size;
+    c->cabecalho = mapa;
+    c->inicial = (const QuadroChave *)(c->cabecalho + 1);
+    if (memcmp(c->cabecalho->magica, COMPACTADO_MAGICA, sizeof(COMPACTADO_MAGICA)) != 0
+        || c->cabecalho->versao != COMPACTADO_VERSAO) {
+        compactadoFechar(c);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Decodifica todas as ações de um replay compactado, bloco a bloco.
+ *
+ * Para cada bloco chama 'consumir(contexto, t0, acoes, n)'; se retornar
+ * diferente de 0 a leitura para.
+ *
+ * @return 0 em caso de sucesso, -1 se o arquivo estiver truncado ou
+ *         corrompido, ou o valor devolvido por 'consumir'.
+ */
+int compactadoLerAcoes(const ReplayCompactado *c,
+                       int (*consumir)(void *contexto, uint64_t t0, const uint8_t *acoes, uint32_t n),
+                       void *contexto) {
+    uint8_t *acoes = malloc(RANS_BLOCO);
+    if (!acoes) {
+        return -1;
+    }
+    const uint8_t *p = (const uint8_t *)(c->inicial + 1);
+    const uint8_t *fim = (const uint8_t *)c->mapa + c->tamanho;
+    uint64_t t0 = 0;
+    int res = 0;
+    for (uint64_t b = 0; b < c->cabecalho->num_blocos && res == 0; b++) {
+        const CabecalhoBlocoRans *bloco = (const CabecalhoBlocoRans *)p;
+        if ((size_t)(fim - p) < sizeof(*bloco) || bloco->num_simbolos > RANS_BLOCO) {
+            res = -1;
+            break;
+        }
+        uint32_t num_bytes = bloco->num_bytes;
+        if ((size_t)(fim - p) - sizeof(*bloco) < num_bytes
+            || ransDecodificar(bloco, p + sizeof(*bloco), acoes) != num_bytes) {
+            res = -1;
+            break;
+        }
+        res = consumir(contexto, t0, acoes, bloco->num_simbolos);
+        t0 += bloco->num_simbolos;
+        p += sizeof(*bloco) + num_bytes;
+    }
+    free(acoes);
+    return res;
+}
+
+
+// --- ÍNDICE DE N-GRAMAS DO ACERVO DE REPLAYS ---
+
+// O índice guarda duas sequências de símbolos por replay:
+//   eventos: um por turno, acao * 8 + tipo da peça que a ação pegou
+//            (frente da fila nas opções 1, 2, 4 e 5; topo da pilha na 3;
+//            7 quando a ação foi ilegal);
+//   peças:   o tipo de cada peça gerada na partida.
+// Para cada sequência há listas de posições de todos os trigramas. Uma
+// consulta busca as posições do trigrama mais raro do padrão e confere o
+// padrão inteiro direto nas sequências guardadas no próprio índice.
+#define NGRAMA_MAGICA "TSNGRAMA"
+#define NGRAMA_VERSAO 1
+#define NGRAMA_EVENTOS (NUM_ACOES * 8)
+#define NGRAMA_SEM_PECA 7
+#define NGRAMA_CHAVES_EVENTOS (NGRAMA_EVENTOS * NGRAMA_EVENTOS * NGRAMA_EVENTOS)
+#define NGRAMA_CHAVES_PECAS (NUM_TIPOS * NUM_TIPOS * NUM_TIPOS)
+
+typedef struct {
+    char magica[8];
+    uint32_t versao;
+    uint32_t num_replays;
+    uint64_t num_eventos;
+    uint64_t num_pecas;
+    uint64_t pos_replays;
+    uint64_t pos_nomes;
+    uint64_t pos_eventos;
+    uint64_t pos_pecas;
+    uint64_t pos_chaves_eventos; // NGRAMA_CHAVES_EVENTOS + 1 deslocamentos
+    uint64_t pos_lista_eventos;
+    uint64_t pos_chaves_pecas;   // NGRAMA_CHAVES_PECAS + 1 deslocamentos
+    uint64_t pos_lista_pecas;
+} CabecalhoIndiceNgrama;
+
+typedef struct {
+    uint64_t inicio_eventos;
+    uint64_t num_eventos;
+    uint64_t inicio_pecas;
+    uint64_t num_pecas;
+    uint64_t pos_nome;
+} ReplayIndexado;
+
+// Evento do turno: a ação e o tipo da peça que ela pegaria.
+static inline uint8_t eventoDoTurno(const Sessao *s, int acao, int aplicada) {
+    int tipo = NGRAMA_SEM_PECA;
+    if (aplicada && acao == ACAO_USAR_RESERVA) {
+        tipo = tipoDaLetra(s->pilha.itens[s->pilha.topo].nome);
+    } else if (aplicada && acao != ACAO_SAIR) {
+        tipo = tipoDaLetra(s->fila.itens[s->fila.inicio].nome);
+    }
+    return (uint8_t)(acao * 8 + tipo);
+}
+
+/**
+ * @brief Lista de posições por trigrama, por ordenação por contagem.
+ *
+ * 'limites' tem num_replays + 1 entradas com o início de cada replay na
+ * sequência; trigramas que cruzam replays são ignorados.
+ *
+ * @param chaves Saída: num_chaves + 1 deslocamentos em 'lista'.
+ * @param lista  Saída: posições, agrupadas por trigrama e crescentes.
+ * @return 0 em caso de sucesso, -1 se faltar memória.
+ */
+static int montarTrigramas(const uint8_t *seq, const uint64_t *limites, int num_replays, int base,
+                            uint64_t *chaves, uint64_t num_chaves, uint64_t *lista) {
+    memset(chaves, 0, sizeof(uint64_t) * (num_chaves + 1));
+    for (int r = 0; r < num_replays; r++) {
+        for (uint64_t i = limites[r]; i + 2 < limites[r + 1]; i++) {
+            chaves[((uint64_t)seq[i] * base + seq[i + 1]) * base + seq[i + 2] + 1]++;
+        }
+    }
+    for (uint64_t k = 0; k < num_chaves; k++) {
+        chaves[k + 1] += chaves[k];
+    }
+    uint64_t *cursor = malloc(sizeof(uint64_t) * num_chaves);
+    if (!cursor) {
+        return -1;
+    }
+    memcpy(cursor, chaves, sizeof(uint64_t) * num_chaves);
+    for (int r = 0; r < num_replays; r++) {
+        for (uint64_t i = limites[r]; i + 2 < limites[r + 1]; i++) {
+            lista[cursor[((uint64_t)seq[i] * base + seq[i + 1]) * base + seq[i + 2]]++] = i;
+        }
+    }
+    free(cursor);
+    return 0;
+}
+
+// Escreve 'n' bytes e completa com zeros até múltiplo de 8.
+static int escreverAlinhado(FILE *arq, const void *dados, size_t n, uint64_t *pos) {
+    static const char zeros[8] = {0};
+    size_t resto = (8 - n % 8) % 8;
+    int ok = fwrite(dados, 1, n, arq) == n && fwrite(zeros, 1, resto, arq) == resto;
+    *pos += n + resto;
+    return ok;
+}
+
+/**
+ * @brief Reexecuta os replays e grava o índice de n-gramas.
+ *
+ * @return 0 em caso de sucesso, -1 em erro.
+ */
+int indexarReplays(const Replay *replays, const char *const *nomes, int n, const char *caminho) {
+    uint64_t total_eventos = 0, total_pecas = 0, total_nomes = 0;
+    uint64_t *limites_ev = malloc(sizeof(uint64_t) * (n + 1));
+    uint64_t *limites_pc = malloc(sizeof(uint64_t) * (n + 1));
+    ReplayIndexado *tabela = calloc(n, sizeof(ReplayIndexado));
+    if (!limites_ev || !limites_pc || !tabela) {
+        free(limites_ev);
+        free(limites_pc);
+        free(tabela);
+        return -1;
+    }
+    for (int r = 0; r < n; r++) {
+        Sessao fim;
+        replayBuscar(&replays[r], replays[r].num_turnos, &fim);
+        tabela[r].inicio_eventos = limites_ev[r] = total_eventos;
+        tabela[r].num_eventos = replays[r].num_turnos;
+        tabela[r].inicio_pecas = limites_pc[r] = total_pecas;
+        tabela[r].num_pecas = (uint64_t)fim.gerador.proximo_id;
+        tabela[r].pos_nome = total_nomes;
+        total_eventos += tabela[r].num_eventos;
+        total_pecas += tabela[r].num_pecas;
+        total_nomes += strlen(nomes[r]) + 1;
+    }
+    limites_ev[n] = total_eventos;
+    limites_pc[n] = total_pecas;
+
+    uint8_t *eventos = malloc(total_eventos + 1);
+    uint8_t *pecas = malloc(total_pecas + 1);
+    char *blob = malloc(total_nomes + 1);
+    uint64_t *chaves_ev = malloc(sizeof(uint64_t) * (NGRAMA_CHAVES_EVENTOS + 1));
+    uint64_t *chaves_pc = malloc(sizeof(uint64_t) * (NGRAMA_CHAVES_PECAS + 1));
+    uint64_t *lista_ev = malloc(sizeof(uint64_t) * (total_eventos + 1));
+    uint64_t *lista_pc = malloc(sizeof(uint64_t) * (total_pecas + 1));
+    int ok = eventos && pecas && blob && chaves_ev && chaves_pc && lista_ev && lista_pc;
+
+    for (int r = 0; ok && r < n; r++) {
+        memcpy(blob + tabela[r].pos_nome, nomes[r], strlen(nomes[r]) + 1);
+        Sessao s;
+        restaurarQuadro(replayQuadro(&replays[r], 0), &s);
+        uint8_t *ev = eventos + tabela[r].inicio_eventos;
+        for (uint64_t t = 0; t < replays[r].num_turnos; t++) {
+            int acao = replayAcao(&replays[r], t);
+            int legal = acao < NUM_ACOES && ((acoesLegais(&s.fila, &s.pilha) >> acao) & 1u);
+            ev[t] = eventoDoTurno(&s, acao < NUM_ACOES ? acao : ACAO_SAIR, legal);
+            aplicarAcaoSessao(&s, acao);
+        }
+        tiposNoIntervalo(s.gerador.semente, 0, pecas + tabela[r].inicio_pecas, tabela[r].num_pecas);
+    }
+
+    ok = ok && montarTrigramas(eventos, limites_ev, n, NGRAMA_EVENTOS, chaves_ev, NGRAMA_CHAVES_EVENTOS, lista_ev) == 0
+            && montarTrigramas(pecas, limites_pc, n, NUM_TIPOS, chaves_pc, NGRAMA_CHAVES_PECAS, lista_pc) == 0;
+    FILE *arq = ok ? fopen(caminho, "wb") : NULL;
+    ok = arq != NULL;
+    if (ok) {
+
+        CabecalhoIndiceNgrama cab;
+        memset(&cab, 0, sizeof(cab));
+        memcpy(cab.magica, NGRAMA_MAGICA, sizeof(cab.magica));
+        cab.versao = NGRAMA_VERSAO;
+        cab.num_replays = (uint32_t)n;
+        cab.num_eventos = total_eventos;
+        cab.num_pecas = total_pecas;
+        uint64_t pos = sizeof(cab);
+        cab.pos_replays = pos;
+        pos += sizeof(ReplayIndexado) * n;
+        cab.pos_nomes = pos;
+        pos += (total_nomes + 7) / 8 * 8;
+        cab.pos_eventos = pos;
+        pos += (total_eventos + 7) / 8 * 8;
+        cab.pos_pecas = pos;
+        pos += (total_pecas + 7) / 8 * 8;
+        cab.pos_chaves_eventos = pos;
+        pos += sizeof(uint64_t) * (NGRAMA_CHAVES_EVENTOS + 1);
+        cab.pos_lista_eventos = pos;
+        pos += sizeof(uint64_t) * chaves_ev[NGRAMA_CHAVES_EVENTOS];
+        cab.pos_chaves_pecas = pos;
+        pos += sizeof(uint64_t) * (NGRAMA_CHAVES_PECAS + 1);
+        cab.pos_lista_pecas = pos;
+
+        uint64_t escrito = 0;
+        ok = escreverAlinhado(arq, &cab, sizeof(cab), &escrito)
+          && escreverAlinhado(arq, tabela, sizeof(ReplayIndexado) * n, &escrito)
+          && escreverAlinhado(arq, blob, total_nomes, &escrito)
+          && escreverAlinhado(arq, eventos, total_eventos, &escrito)
+          && escreverAlinhado(arq, pecas, total_pecas, &escrito)
+          && escreverAlinhado(arq, chaves_ev, sizeof(uint64_t) * (NGRAMA_CHAVES_EVENTOS + 1), &escrito)
+          && escreverAlinhado(arq, lista_ev, sizeof(uint64_t) * chaves_ev[NGRAMA_CHAVES_EVENTOS], &escrito)
+          && escreverAlinhado(arq, chaves_pc, sizeof(uint64_t) * (NGRAMA_CHAVES_PECAS + 1), &escrito)
+          && escreverAlinhado(arq, lista_pc, sizeof(uint64_t) * chaves_pc[NGRAMA_CHAVES_PECAS], &escrito);
+        ok = fclose(arq) == 0 && ok;
+    }
+
+    free(limites_ev);
+    free(limites_pc);
+    free(tabela);
+    free(eventos);
+    free(pecas);
+    free(blob);
+    free(chaves_ev);
+    free(chaves_pc);
+    free(lista_ev);
+    free(lista_pc);
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Índice de n-gramas aberto com mmap.
+ */
+typedef struct {
+    void *mapa;
+    size_t tamanho;
+    const CabecalhoIndiceNgrama *cabecalho;
+    const ReplayIndexado *replays;
+    const char *nomes;
+    const uint8_t *eventos;
+    const uint8_t *pecas;
+    const uint64_t *chaves_eventos;
+    const uint64_t *lista_eventos;
+    const uint64_t *chaves_pecas;
+    const uint64_t *lista_pecas;
+} IndiceNgrama;
+
+void indiceNgramaFechar(IndiceNgrama *ix) {
+    if (ix->mapa) {
+        munmap(ix->mapa, ix->tamanho);
+    }
+    ix->mapa = NULL;
+}
+
+// [pos, pos + bytes) cabe inteiro em um arquivo de 'tamanho' bytes.
+static int secaoCabe(uint64_t pos, uint64_t bytes, uint64_t tamanho) {
+    return pos <= tamanho && bytes <= tamanho - pos;
+}
+
+// Deslocamentos de uma sequência: começam em 0, nunca diminuem e a lista
+// que indexam (num_chaves + 1 entradas antes dela) cabe no arquivo.
+static int chavesValidas(const IndiceNgrama *ix, const uint64_t *chaves, uint64_t num_chaves, uint64_t pos_lista) {
+    if (chaves[0] != 0 || chaves[num_chaves] > ix->tamanho / sizeof(uint64_t)
+        || !secaoCabe(pos_lista, chaves[num_chaves] * sizeof(uint64_t), ix->tamanho)) {
+        return 0;
+    }
+    for (uint64_t k = 0; k < num_chaves; k++) {
+        if (chaves[k] > chaves[k + 1]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Abre um índice de n-gramas e confere sua estrutura.
+ *
+ * Cada seção precisa caber no arquivo, as faixas dos replays precisam
+ * cobrir as sequências sem buracos e cada nome termina antes dos eventos.
+ * As posições das listas não são lidas aqui; as consultas descartam as
+ * que caem fora das sequências.
+ *
+ * @return 0 em caso de sucesso, -1 se o arquivo for inválido.
+ */
+int indiceNgramaAbrir(IndiceNgrama *ix, const char *caminho) {
+    memset(ix, 0, sizeof(*ix));
+    int fd = open(caminho, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CabecalhoIndiceNgrama)) {
+        close(fd);
+        return -1;
+    }
+    void *mapa = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapa == MAP_FAILED) {
+        return -1;
+    }
+    const char *base = mapa;
+    ix->mapa = mapa;
+    ix->tamanho = st.st_size;
+    ix->cabecalho = mapa;
+    const CabecalhoIndiceNgrama *c = ix->cabecalho;
+    uint64_t tamanho = ix->tamanho;
+    if (memcmp(c->magica, NGRAMA_MAGICA, 8) != 0 || c->versao != NGRAMA_VERSAO
+        || c->pos_replays % 8 || c->pos_chaves_eventos % 8 || c->pos_lista_eventos % 8
+        || c->pos_chaves_pecas % 8 || c->pos_lista_pecas % 8
+        || !secaoCabe(c->pos_replays, sizeof(ReplayIndexado) * (uint64_t)c->num_replays, tamanho)
+        || c->pos_nomes > c->pos_eventos || !secaoCabe(c->pos_nomes, c->pos_eventos - c->pos_nomes, tamanho)
+        || !secaoCabe(c->pos_eventos, c->num_eventos, tamanho)
+        || !secaoCabe(c->pos_pecas, c->num_pecas, tamanho)
+        || !secaoCabe(c->pos_chaves_eventos, sizeof(uint64_t) * (NGRAMA_CHAVES_EVENTOS + 1), tamanho)
+        || !secaoCabe(c->pos_chaves_pecas, sizeof(uint64_t) * (NGRAMA_CHAVES_PECAS + 1), tamanho)
+        || (c->num_replays > 0 && (c->pos_nomes == c->pos_eventos || base[c->pos_eventos - 1] != '\0'))) {
+        indiceNgramaFechar(ix);
+        return -1;
+    }
+    ix->replays = (const ReplayIndexado *)(base + c->pos_replays);
+    ix->nomes = base + c->pos_nomes;
+    ix->eventos = (const uint8_t *)(base + c->pos_eventos);
+    ix->pecas = (const uint8_t *)(base + c->pos_pecas);
+    ix->chaves_eventos = (const uint64_t *)(base + c->pos_chaves_eventos);
+    ix->lista_eventos = (const uint64_t *)(base + c->pos_lista_eventos);
+    ix->chaves_pecas = (const uint64_t *)(base + c->pos_chaves_pecas);
+    ix->lista_pecas = (const uint64_t *)(base + c->pos_lista_pecas);
+
+    uint64_t eventos = 0, pecas = 0;
+    for (uint32_t r = 0; r < c->num_replays; r++) {
+        const ReplayIndexado *ri = &ix->replays[r];
+        if (ri->inicio_eventos != eventos || ri->num_eventos > c->num_eventos - eventos
+            || ri->inicio_pecas != pecas || ri->num_pecas > c->num_pecas - pecas
+            || ri->pos_nome >= c->pos_eventos - c->pos_nomes) {
+            indiceNgramaFechar(ix);
+            return -1;
+        }
+        eventos += ri->num_eventos;
+        pecas += ri->num_pecas;
+    }
+    if (eventos != c->num_eventos || pecas != c->num_pecas
+        || !chavesValidas(ix, ix->chaves_eventos, NGRAMA_CHAVES_EVENTOS, c->pos_lista_eventos)
+        || !chavesValidas(ix, ix->chaves_pecas, NGRAMA_CHAVES_PECAS, c->pos_lista_pecas)) {
+        indiceNgramaFechar(ix);
+        return -1;
+    }
+    return 0;
+}
+
+// Um símbolo do padrão: conjunto de valores aceitos (bit v = aceita v).
+typedef uint64_t SimboloPadrao;
+
+/**
+ * @brief Resultado de uma consulta: posições (globais) onde o padrão começa.
+ */
+typedef struct {
+    uint64_t *posicoes;
+    uint64_t quantidade;
+    uint64_t capacidade;
+} ResultadoNgrama;
+
+static int compararU64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Replay que contém a posição global 'pos' da sequência escolhida.
+static int replayDaPosicao(const IndiceNgrama *ix, int pecas, uint64_t pos) {
+    int lo = 0, hi = (int)ix->cabecalho->num_replays - 1;
+    while (lo < hi) {
+        int meio = (lo + hi + 1) / 2;
+        uint64_t inicio = pecas ? ix->replays[meio].inicio_pecas : ix->replays[meio].inicio_eventos;
+        if (inicio <= pos) {
+            lo = meio;
+        } else {
+            hi = meio - 1;
+        }
+    }
+    return lo;
+}
+
+// Confere o padrão inteiro a partir de 'pos', sem sair do replay.
+static int padraoCasa(const IndiceNgrama *ix, int pecas, const SimboloPadrao *padrao, int n, uint64_t pos) {
+    const uint8_t *seq = pecas ? ix->pecas : ix->eventos;
+    int r = replayDaPosicao(ix, pecas, pos);
+    uint64_t fim = pecas ? ix->replays[r].inicio_pecas + ix->replays[r].num_pecas
+                         : ix->replays[r].inicio_eventos + ix->replays[r].num_eventos;
+    if (pos + (uint64_t)n > fim) {
+        return 0;
+    }
+    for (int i = 0; i < n; i++) {
+        // Símbolos válidos são menores que 64; um índice corrompido não casa.
+        if (seq[pos + i] >= 64 || !((padrao[i] >> seq[pos + i]) & 1u)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int adicionarResultado(ResultadoNgrama *res, uint64_t pos) {
+    if (res->quantidade == res->capacidade) {
+        uint64_t nova = res->capacidade ? res->capacidade * 2 : 256;
+        uint64_t *p = realloc(res->posicoes, sizeof(uint64_t) * nova);
+        if (!p) {
+            return -1;
+        }
+        res->posicoes = p;
+        res->capacidade = nova;
+    }
+    res->posicoes[res->quantidade++] = pos;
+    return 0;
+}
+
+/**
+ * @brief Padrões de 1 ou 2 símbolos, pelas listas dos trigramas.
+ *
+ * As listas estão ordenadas pela chave (a, b, c), então os trigramas que
+ * começam com 'a' (ou com 'a, b') ocupam uma faixa contígua: cada posição
+ * dela é uma ocorrência. Só as duas últimas posições de cada replay não
+ * começam trigrama nenhum e são conferidas uma a uma.
+ */
+static int consultarCurto(const IndiceNgrama *ix, int pecas, const SimboloPadrao *padrao, int n,
+                          ResultadoNgrama *res) {
+    const uint64_t *chaves = pecas ? ix->chaves_pecas : ix->chaves_eventos;
+    const uint64_t *lista = pecas ? ix->lista_pecas : ix->lista_eventos;
+    uint64_t base = pecas ? NUM_TIPOS : NGRAMA_EVENTOS;
+    uint64_t total = pecas ? ix->cabecalho->num_pecas : ix->cabecalho->num_eventos;
+    for (uint64_t a = 0; a < base; a++) {
+        if (!((padrao[0] >> a) & 1u)) continue;
+        for (uint64_t b = 0; b < base; b++) {
+            if (n == 2 && !((padrao[1] >> b) & 1u)) continue;
+            uint64_t k = n == 2 ? (a * base + b) * base : a * base * base;
+            uint64_t fim = n == 2 ? chaves[k + base] : chaves[k + base * base];
+            for (uint64_t j = chaves[k]; j < fim; j++) {
+                if (lista[j] < total && adicionarResultado(res, lista[j]) != 0) {
+                    return -1;
+                }
+            }
+            if (n == 1) {
+                break;
+            }
+        }
+    }
+    for (uint32_t r = 0; r < ix->cabecalho->num_replays; r++) {
+        const ReplayIndexado *ri = &ix->replays[r];
+        uint64_t inicio = pecas ? ri->inicio_pecas : ri->inicio_eventos;
+        uint64_t fim = inicio + (pecas ? ri->num_pecas : ri->num_eventos);
+        for (uint64_t pos = fim - inicio > 2 ? fim - 2 : inicio; pos < fim; pos++) {
+            if (padraoCasa(ix, pecas, padrao, n, pos) && adicionarResultado(res, pos) != 0) {
+                return -1;
+            }
+        }
+    }
+    if (res->quantidade > 0) {
+        qsort(res->posicoes, res->quantidade, sizeof(uint64_t), compararU64);
+    }
+    return 0;
+}
+
+/**
+ * @brief Busca um padrão de símbolos (com curingas) em eventos ou peças.
+ *
+ * Escolhe a janela de 3 símbolos cujas listas somam menos posições,
+ * percorre só essas listas e confere cada candidato. Padrões com menos
+ * de 3 símbolos saem das faixas de trigramas com o mesmo prefixo (ver
+ * consultarCurto).
+ *
+ * @return 0 em caso de sucesso, -1 se faltar memória.
+ */
+int consultarNgrama(const IndiceNgrama *ix, int pecas, const SimboloPadrao *padrao, int n, ResultadoNgrama *res) {
+    const uint64_t *chaves = pecas ? ix->chaves_pecas : ix->chaves_eventos;
+    const uint64_t *lista = pecas ? ix->lista_pecas : ix->lista_eventos;
+    int base = pecas ? NUM_TIPOS : NGRAMA_EVENTOS;
+    memset(res, 0, sizeof(*res));
+
+    if (n < 3) {
+        return consultarCurto(ix, pecas, padrao, n, res);
+    }
+
+    // Janela mais seletiva
+    int melhor = 0;
+    uint64_t menor = UINT64_MAX;
+    for (int w = 0; w + 3 <= n; w++) {
+        uint64_t soma = 0;
+        for (int a = 0; a < base; a++) {
+            if (!((padrao[w] >> a) & 1u)) continue;
+            for (int b = 0; b < base; b++) {
+                if (!((padrao[w + 1] >> b) & 1u)) continue;
+                uint64_t k = ((uint64_t)a * base + b) * base;
+                for (int c = 0; c < base; c++) {
+                    if ((padrao[w + 2] >> c) & 1u) {
+                        soma += chaves[k + c + 1] - chaves[k + c];
+                    }
+                }
+            }
+        }
+        if (soma < menor) {
+            menor = soma;
+            melhor = w;
+        }
+    }
+
+    for (int a = 0; a < base; a++) {
+        if (!((padrao[melhor] >> a) & 1u)) continue;
+        for (int b = 0; b < base; b++) {
+            if (!((padrao[melhor + 1] >> b) & 1u)) continue;
+            uint64_t k = ((uint64_t)a * base + b) * base;
+            for (int c = 0; c < base; c++) {
+                if (!((padrao[melhor + 2] >> c) & 1u)) continue;
+                for (uint64_t j = chaves[k + c]; j < chaves[k + c + 1]; j++) {
+                    uint64_t pos = lista[j];
+                    if (pos >= (uint64_t)melhor && padraoCasa(ix, pecas, padrao, n, pos - melhor)
+                        && adicionarResultado(res, pos - melhor) != 0) {
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+    if (res->quantidade > 0) {
+        qsort(res->posicoes, res->quantidade, sizeof(uint64_t), compararU64);
+    }
+    return 0;
+}
+
+
+// --- ANÁLISE PARALELA DE REPLAYS ---
+
+/**
+ * @brief Estatísticas de um ou mais replays, obtidas reexecutando as ações.
+ *
+ * Os campos são todos uint64_t e formam as colunas do arquivo de saída,
+ * na ordem de COLUNAS_ANALISE.
+ */
+typedef struct {
+    uint64_t valido;              // 1 se o replay abriu e foi processado
+    uint64_t turnos;
+    uint64_t acoes[NUM_ACOES];    // ações aplicadas, por tipo
+    uint64_t ilegais;
+    uint64_t soma_ocupacao;       // soma das peças na reserva após cada turno
+    uint64_t ocupacao_maxima;
+} EstatisticasReplay;
+
+#define NUM_COLUNAS_ANALISE (sizeof(EstatisticasReplay) / sizeof(uint64_t))
+
+static const char *const COLUNAS_ANALISE[] = {
+    "valido", "turnos", "sair", "jogar", "reservar", "usar_reserva", "trocar",
+    "troca_multipla", "ilegais", "soma_ocupacao", "ocupacao_maxima",
+};
+_Static_assert(sizeof(COLUNAS_ANALISE) / sizeof(COLUNAS_ANALISE[0]) == NUM_COLUNAS_ANALISE,
+               "uma coluna por campo de EstatisticasReplay");
+
+#define ANALISE_MAGICA "TSANALIS"
+#define ANALISE_VERSAO 1
+
+typedef struct {
+    char magica[8];
+    uint32_t versao;
+    uint32_t num_colunas;
+    uint64_t num_linhas;
+    char colunas[NUM_COLUNAS_ANALISE][16];
+    // seguem num_colunas colunas de num_linhas uint64_t e os nomes dos
+    // arquivos, terminados em '\0', na ordem das linhas
+} CabecalhoAnalise;
+
+/**
+ * @brief Lista de arquivos dividida entre as threads por um contador atômico.
+ *
+ * Cada thread mapeia, reexecuta e desmapeia os próprios arquivos, de modo
+ * que leitura e processamento se sobrepõem entre as threads. A linha de
+ * cada arquivo só é escrita pela thread que o pegou; os totais ficam em
+ * acumuladores por thread, somados no final.
+ */
+typedef struct {
+    const char *const *caminhos;
+    uint64_t num_arquivos;
+    atomic_uint_fast64_t proximo;
+    EstatisticasReplay *linhas;
+} AnaliseReplays;
+
+typedef struct {
+    AnaliseReplays *analise;
+    EstatisticasReplay total;
+} ThreadAnalise;
+
+#define ANALISE_BLOCO 4
+
+// Reexecuta um replay inteiro sem exibir nada.
+static void analisarReplay(const Replay *r, EstatisticasReplay *e) {
+    memset(e, 0, sizeof(*e));
+    Sessao s;
+    restaurarQuadro(replayQuadro(r, 0), &s);
+    for (uint64_t t = 0; t < r->num_turnos; t++) {
+        int acao = replayAcao(r, t);
+        if (aplicarAcaoSessao(&s, acao)) {
+            e->acoes[acao]++;
+        } else {
+            e->ilegais++;
+        }
+        uint64_t ocupacao = (uint64_t)(s.pilha.topo + 1);
+        e->soma_ocupacao += ocupacao;
+        e->ocupacao_maxima = ocupacao > e->ocupacao_maxima ? ocupacao : e->ocupacao_maxima;
+    }
+    e->turnos = r->num_turnos;
+    e->valido = 1;
+}
+
+static void somarEstatisticas(EstatisticasReplay *total, const EstatisticasReplay *e) {
+    uint64_t maxima = e->ocupacao_maxima > total->ocupacao_maxima ? e->ocupacao_maxima : total->ocupacao_maxima;
+    const uint64_t *origem = (const uint64_t *)e;
+    uint64_t *destino = (uint64_t *)total;
+    for (size_t c = 0; c < NUM_COLUNAS_ANALISE; c++) {
+        destino[c] += origem[c];
+    }
+    total->ocupacao_maxima = maxima;
+}
+
+static void *threadAnalise(void *arg) {
+    ThreadAnalise *t = arg;
+    AnaliseReplays *a = t->analise;
+    for (;;) {
+        uint64_t inicio = atomic_fetch_add(&a->proximo, ANALISE_BLOCO);
+        if (inicio >= a->num_arquivos) {
+            break;
+        }
+        uint64_t fim = inicio + ANALISE_BLOCO < a->num_arquivos ? inicio + ANALISE_BLOCO : a->num_arquivos;
+        for (uint64_t i = inicio; i < fim; i++) {
+            Replay r;
+            if (replayAbrir(&r, a->caminhos[i]) != 0) {
+                memset(&a->linhas[i], 0, sizeof(EstatisticasReplay));
+                continue;
+            }
+            madvise(r.mapa, r.tamanho, MADV_SEQUENTIAL);
+            madvise(r.mapa, r.tamanho, MADV_WILLNEED);
+            analisarReplay(&r, &a->linhas[i]);
+            somarEstatisticas(&t->total, &a->linhas[i]);
+            replayFechar(&r);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Analisa os arquivos com 'num_threads' threads.
+ *
+ * @param linhas Saída: uma linha de estatísticas por arquivo.
+ * @param total  Saída: soma de todas as linhas.
+ * @return 0 em caso de sucesso, -1 se faltar memória.
+ */
+int analisarReplays(const char *const *caminhos, uint64_t n, int num_threads,
+                    EstatisticasReplay *linhas, EstatisticasReplay *total) {
+    AnaliseReplays a;
+    a.caminhos = caminhos;
+    a.num_arquivos = n;
+    a.linhas = linhas;
+    atomic_init(&a.proximo, 0);
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+    ThreadAnalise *contextos = calloc(num_threads, sizeof(ThreadAnalise));
+    if (!threads || !contextos) {
+        free(threads);
+        free(contextos);
+        return -1;
+    }
+    int criadas = 0;
+    for (; criadas < num_threads; criadas++) {
+        contextos[criadas].analise = &a;
+        if (pthread_create(&threads[criadas], NULL, threadAnalise, &contextos[criadas]) != 0) {
+            break;
+        }
+    }
+    if (criadas == 0) {
+        threadAnalise(&contextos[0]); // sem threads extras, analisa na thread atual
+    }
+    for (int i = 0; i < criadas; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    memset(total, 0, sizeof(*total));
+    for (int i = 0; i < (criadas ? criadas : 1); i++) {
+        somarEstatisticas(total, &contextos[i].total);
+    }
+    free(threads);
+    free(contextos);
+    return 0;
+}
+
+/**
+ * @brief Grava as linhas em formato colunar (uma coluna após a outra).
+ *
+ * @return 0 em caso de sucesso, -1 em erro.
+ */
+int salvarAnalise(const char *caminho, const char *const *nomes, const EstatisticasReplay *linhas, uint64_t n) {
+    FILE *arq = fopen(caminho, "wb");
+    if (!arq) {
+        return -1;
+    }
+    CabecalhoAnalise cab;
+    memset(&cab, 0, sizeof(cab));
+    memcpy(cab.magica, ANALISE_MAGICA, sizeof(cab.magica));
+    cab.versao = ANALISE_VERSAO;
+    cab.num_colunas = NUM_COLUNAS_ANALISE;
+    cab.num_linhas = n;
+    for (size_t c = 0; c < NUM_COLUNAS_ANALISE; c++) {
+        strncpy(cab.colunas[c], COLUNAS_ANALISE[c], sizeof(cab.colunas[c]) - 1);
+    }
+    int ok = fwrite(&cab, sizeof(cab), 1, arq) == 1;
+
+    uint64_t *coluna = malloc(sizeof(uint64_t) * (n ? n : 1));
+    ok = ok && coluna;
+    for (size_t c = 0; ok && c < NUM_COLUNAS_ANALISE; c++) {
+        for (uint64_t i = 0; i < n; i++) {
+            coluna[i] = ((const uint64_t *)&linhas[i])[c];
+        }
+        ok = fwrite(coluna, sizeof(uint64_t), n, arq) == n;
+    }
+    for (uint64_t i = 0; ok && i < n; i++) {
+        ok = fwrite(nomes[i], 1, strlen(nomes[i]) + 1, arq) == strlen(nomes[i]) + 1;
+    }
+    free(coluna);
+    ok = fclose(arq) == 0 && ok;
+    return ok ? 0 : -1;
+}
+
+
+// --- LOG DE AÇÕES (WAL) E POOL DE SESSÕES ---
+
+/**
+ * @brief Conjunto de sessões hospedadas.
+ *
+ * 'lsn[i]' conta os registros de log já aplicados à sessão i; o próximo
+ * registro da sessão recebe esse número. Assim a recuperação sabe quais
+ * registros um checkpoint já contém.
+ *
+ * Cada sessão tem um seqlock ('versoes', ímpar durante uma escrita), para
+ * que o checkpointer copie estados consistentes sem parar as threads de
+ * jogo, e cada grupo de SESSOES_POR_PAGINA sessões tem um byte "sujo",
+ * marcado a cada escrita e limpo pelo checkpointer.
+ */
+typedef struct {
+    int num_sessoes;
+    Sessao *sessoes;
+    uint64_t *lsn;
+    atomic_uint_fast32_t *versoes;
+    atomic_uchar *sujas;
+} PoolSessoes;
+
+// Sessão e lsn como gravados no checkpoint: 128 bytes, 32 por página.
+typedef struct {
+    Sessao sessao;
+    uint64_t lsn;
+    char reservado[128 - sizeof(Sessao) - sizeof(uint64_t)];
+} SessaoGravada;
+
+#define PAGINA_CHECKPOINT 4096
+#define SESSOES_POR_PAGINA (PAGINA_CHECKPOINT / (int)sizeof(SessaoGravada))
+
+static inline int paginasDoPool(int num_sessoes) {
+    return (num_sessoes + SESSOES_POR_PAGINA - 1) / SESSOES_POR_PAGINA;
+}
+
+void poolDestruir(PoolSessoes *pool) {
+    free(pool->sessoes);
+    free(pool->lsn);
+    free(pool->versoes);
+    free(pool->sujas);
+    pool->sessoes = NULL;
+    pool->lsn = NULL;
+    pool->versoes = NULL;
+    pool->sujas = NULL;
+}
+
+int poolCriar(PoolSessoes *pool, int n) {
+    pool->num_sessoes = n;
+    pool->sessoes = calloc(n, sizeof(Sessao));
+    pool->lsn = calloc(n, sizeof(uint64_t));
+    pool->versoes = calloc(n, sizeof(atomic_uint_fast32_t));
+    pool->sujas = calloc(paginasDoPool(n), sizeof(atomic_uchar));
+    if (!pool->sessoes || !pool->lsn || !pool->versoes || !pool->sujas) {
+        poolDestruir(pool);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void poolInicioEscrita(PoolSessoes *pool, int i) {
+    atomic_fetch_add_explicit(&pool->versoes[i], 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+// Fecha o seqlock e marca a página. A marca vem antes do registro entrar
+// no log: um checkpoint que cobre o registro sempre vê a página suja.
+static inline void poolFimEscrita(PoolSessoes *pool, int i) {
+    atomic_fetch_add_explicit(&pool->versoes[i], 1, memory_order_release);
+    atomic_uchar *suja = &pool->sujas[i / SESSOES_POR_PAGINA];
+    if (!atomic_load_explicit(suja, memory_order_relaxed)) {
+        atomic_store_explicit(suja, 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Copia a sessão i sem bloquear quem escreve nela.
+ */
+void poolLerSessao(const PoolSessoes *pool, int i, SessaoGravada *destino) {
+    for (;;) {
+        uint_fast32_t v = atomic_load_explicit(&pool->versoes[i], memory_order_acquire);
+        if (v & 1) {
+            continue;
+        }
+        memcpy(&destino->sessao, &pool->sessoes[i], sizeof(Sessao));
+        destino->lsn = pool->lsn[i];
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&pool->versoes[i], memory_order_relaxed) == v) {
+            return;
+        }
+    }
+}
+
+// Resumo do pool inteiro, para comparar execução e recuperação.
+uint64_t hashPool(const PoolSessoes *pool) {
+    uint64_t h = (uint64_t)pool->num_sessoes;
+    for (int i = 0; i < pool->num_sessoes; i++) {
+        h = misturar64(h ^ hashSessao(&pool->sessoes[i]) ^ pool->lsn[i]);
+    }
+    return h;
+}
+
+// Log: cabeçalho e registros de tamanho fixo, na ordem em que o flusher
+// os drenou. A ordem entre sessões não importa; dentro de uma sessão os
+// registros saem do seu anel na ordem do lsn.
+#define LOG_MAGICA "TSLOGWAL"
+#define LOG_VERSAO 1
+#define LOG_ANEL 16                    // registros por sessão (potência de 2)
+#define LOG_BUFFER (1 << 20)           // bytes acumulados antes de cada write
+#define LOG_INTERVALO_PADRAO_US 2000   // intervalo entre fsyncs em grupo
+
+enum { LOG_INICIAR = 1, LOG_ACAO = 2 };
+
+typedef struct {
+    char magica[8];
+    uint32_t versao;
+    uint32_t num_sessoes;
+} CabecalhoLog;
+
+typedef struct {
+    uint64_t lsn;
+    uint64_t semente;      // só em LOG_INICIAR
+    uint32_t sessao;
+    uint8_t tipo;
+    uint8_t acao;          // só em LOG_ACAO
+    uint16_t verificacao;  // detecta registros rasgados no fim do arquivo
+} RegistroLog;
+
+static inline uint16_t verificacaoRegistro(const RegistroLog *r) {
+    uint64_t z = misturar64(r->lsn ^ misturar64(r->semente)
+                            ^ ((uint64_t)r->sessao << 16 | (uint64_t)r->tipo << 8 | r->acao));
+    return (uint16_t)(z >> 48);
+}
+
+// Anel de um produtor (a thread dona da sessão) e um consumidor (o flusher).
+typedef struct {
+    atomic_uint_fast32_t escrita;
+    atomic_uint_fast32_t leitura;
+    RegistroLog itens[LOG_ANEL];
+} AnelLog;
+
+/**
+ * @brief Log de ações com fsync em grupo.
+ *
+ * As threads de jogo só copiam o registro para o anel da sessão. Uma
+ * thread de fundo acorda a cada 'intervalo_us', drena todos os anéis em
+ * um buffer grande, grava com poucos write e faz um único fdatasync pelo
+ * lote inteiro; só então publica 'duravel' de cada sessão do lote.
+ */
+typedef struct {
+    int fd;
+    int num_sessoes;
+    long intervalo_us;
+    AnelLog *aneis;
+    atomic_uint_fast64_t *duravel;   // por sessão: lsn + 1 do último registro em disco
+    unsigned char *buffer;
+    size_t usado;
+    uint32_t *tocadas;               // sessões do lote atual
+    uint64_t *lsn_tocadas;
+    pthread_t flusher;
+    pthread_mutex_t trava;
+    pthread_cond_t acordar;          // anel cheio: adianta o próximo lote
+    pthread_cond_t sincronizado;     // lote em disco
+    atomic_int parar;
+    atomic_int pressa;
+    atomic_int erro;
+    uint64_t posicao_inicial;
+    atomic_uint_fast64_t posicao;    // tamanho do arquivo já sincronizado
+    uint64_t registros;
+    uint64_t lotes;
+    uint64_t bytes_gravados;
+} LogAcoes;
+
+static int logDescarregar(LogAcoes *log) {
+    size_t feito = 0;
+    while (feito < log->usado) {
+        ssize_t n = write(log->fd, log->buffer + feito, log->usado - feito);
+        if (n <= 0) {
+            return -1;
+        }
+        feito += (size_t)n;
+    }
+    log->bytes_gravados += log->usado;
+    log->usado = 0;
+    return 0;
+}
+
+static void *threadFlusher(void *arg) {
+    LogAcoes *log = arg;
+    for (;;) {
+        int parar = atomic_load(&log->parar);
+        int tocadas = 0;
+        int falhou = 0;
+        for (int s = 0; s < log->num_sessoes && !falhou; s++) {
+            AnelLog *a = &log->aneis[s];
+            uint32_t l = (uint32_t)atomic_load_explicit(&a->leitura, memory_order_relaxed);
+            uint32_t e = (uint32_t)atomic_load_explicit(&a->escrita, memory_order_acquire);
+            if (l == e) {
+                continue;
+            }
+            uint64_t ultimo = 0;
+            uint32_t inicio = l;
+            for (; l != e; l++) {
+                if (log->usado + sizeof(RegistroLog) > LOG_BUFFER && logDescarregar(log) != 0) {
+                    // Buffer cheio e sem como esvaziá-lo: o anel fica como
+                    // está e o log para de aceitar registros.
+                    falhou = 1;
+                    break;
+                }
+                const RegistroLog *r = &a->itens[l % LOG_ANEL];
+                memcpy(log->buffer + log->usado, r, sizeof(RegistroLog));
+                log->usado += sizeof(RegistroLog);
+                ultimo = r->lsn;
+            }
+            if (falhou) {
+                break;
+            }
+            log->registros += l - inicio;
+            atomic_store_explicit(&a->leitura, l, memory_order_release);
+            log->tocadas[tocadas] = (uint32_t)s;
+            log->lsn_tocadas[tocadas++] = ultimo + 1;
+        }
+        if (!falhou && tocadas > 0) {
+            falhou = logDescarregar(log) != 0 || fdatasync(log->fd) != 0;
+        }
+        if (falhou) {
+            atomic_store(&log->erro, 1);
+        } else if (tocadas > 0) {
+            // Só o que foi gravado e sincronizado passa a contar como durável.
+            for (int i = 0; i < tocadas; i++) {
+                atomic_store_explicit(&log->duravel[log->tocadas[i]], log->lsn_tocadas[i], memory_order_release);
+            }
+            atomic_store_explicit(&log->posicao, log->posicao_inicial + log->bytes_gravados, memory_order_release);
+            log->lotes++;
+        }
+        pthread_mutex_lock(&log->trava);
+        if (tocadas > 0 || falhou) {
+            pthread_cond_broadcast(&log->sincronizado);
+        }
+        if (parar || falhou) {
+            pthread_mutex_unlock(&log->trava);
+            break;
+        }
+        if (!atomic_exchange(&log->pressa, 0)) {
+            struct timespec prazo;
+            clock_gettime(CLOCK_REALTIME, &prazo);
+            prazo.tv_nsec += (log->intervalo_us % 1000000) * 1000;
+            prazo.tv_sec += log->intervalo_us / 1000000 + prazo.tv_nsec / 1000000000;
+            prazo.tv_nsec %= 1000000000;
+            pthread_cond_timedwait(&log->acordar, &log->trava, &prazo);
+        }
+        pthread_mutex_unlock(&log->trava);
+    }
+    return NULL;
+}
+
+int logFechar(LogAcoes *log);
+
+/**
+ * @brief Abre (ou cria) o log e inicia o flusher.
+ *
+ * Um log existente deve ter passado antes por recuperarPool, que corta um
+ * eventual registro rasgado no fim.
+ *
+ * @return 0 em caso de sucesso, -1 em erro.
+ */
+int logAbrir(LogAcoes *log, const char *caminho, int num_sessoes, long intervalo_us) {
+    memset(log, 0, sizeof(*log));
+    log->fd = open(caminho, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log->fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(log->fd, &st) != 0) {
+        close(log->fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        CabecalhoLog cab;
+        memset(&cab, 0, sizeof(cab));
+        memcpy(cab.magica, LOG_MAGICA, sizeof(cab.magica));
+        cab.versao = LOG_VERSAO;
+        cab.num_sessoes = (uint32_t)num_sessoes;
+        if (write(log->fd, &cab, sizeof(cab)) != (ssize_t)sizeof(cab) || fdatasync(log->fd) != 0) {
+            close(log->fd);
+            return -1;
+        }
+        st.st_size = sizeof(cab);
+    }
+    log->posicao_inicial = (uint64_t)st.st_size;
+    atomic_init(&log->posicao, log->posicao_inicial);
+    log->num_sessoes = num_sessoes;
+    log->intervalo_us = intervalo_us > 0 ? intervalo_us : LOG_INTERVALO_PADRAO_US;
+    log->aneis = calloc(num_sessoes, sizeof(AnelLog));
+    log->duravel = calloc(num_sessoes, sizeof(atomic_uint_fast64_t));
+    log->buffer = malloc(LOG_BUFFER);
+    log->tocadas = malloc(sizeof(uint32_t) * num_sessoes);
+    log->lsn_tocadas = malloc(sizeof(uint64_t) * num_sessoes);
+    pthread_mutex_init(&log->trava, NULL);
+    pthread_cond_init(&log->acordar, NULL);
+    pthread_cond_init(&log->sincronizado, NULL);
+    if (!log->aneis || !log->duravel || !log->buffer || !log->tocadas || !log->lsn_tocadas
+        || pthread_create(&log->flusher, NULL, threadFlusher, log) != 0) {
+        atomic_store(&log->parar, 1);
+        log->flusher = 0;
+        logFechar(log);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Drena os anéis, faz o último fsync e libera o log.
+ *
+ * Nenhuma thread de jogo pode estar registrando durante o fechamento.
+ *
+ * @return 0 se tudo chegou ao disco, -1 em erro.
+ */
+int logFechar(LogAcoes *log) {
+    if (log->flusher) {
+        pthread_mutex_lock(&log->trava);
+        atomic_store(&log->parar, 1);
+        pthread_cond_signal(&log->acordar);
+        pthread_mutex_unlock(&log->trava);
+        pthread_join(log->flusher, NULL);
+    }
+    int erro = atomic_load(&log->erro);
+    if (log->fd >= 0) {
+        erro |= close(log->fd) != 0;
+    }
+    pthread_mutex_destroy(&log->trava);
+    pthread_cond_destroy(&log->acordar);
+    pthread_cond_destroy(&log->sincronizado);
+    free(log->aneis);
+    free(log->duravel);
+    free(log->buffer);
+    free(log->tocadas);
+    free(log->lsn_tocadas);
+    log->fd = -1;
+    log->aneis = NULL;
+    return erro ? -1 : 0;
+}
+
+// Copia o registro para o anel da sessão; com o anel cheio, adianta o
+// flusher e espera o lote seguinte. Depois de um erro de E/S o flusher
+// não drena mais os anéis: o registro é descartado e nunca fica durável.
+static void logAnexar(LogAcoes *log, RegistroLog *r) {
+    r->verificacao = verificacaoRegistro(r);
+    AnelLog *a = &log->aneis[r->sessao];
+    uint32_t e = (uint32_t)atomic_load_explicit(&a->escrita, memory_order_relaxed);
+    if (e - (uint32_t)atomic_load_explicit(&a->leitura, memory_order_acquire) >= LOG_ANEL) {
+        pthread_mutex_lock(&log->trava);
+        while (e - (uint32_t)atomic_load_explicit(&a->leitura, memory_order_acquire) >= LOG_ANEL
+               && !atomic_load(&log->erro)) {
+            atomic_store(&log->pressa, 1);
+            pthread_cond_signal(&log->acordar);
+            pthread_cond_wait(&log->sincronizado, &log->trava);
+        }
+        pthread_mutex_unlock(&log->trava);
+        if (atomic_load(&log->erro)) {
+            return;
+        }
+    }
+    a->itens[e % LOG_ANEL] = *r;
+    atomic_store_explicit(&a->escrita, e + 1, memory_order_release);
+}
+
+/**
+ * @brief Espera o registro 'lsn' da sessão chegar ao disco.
+ *
+ * @return 0 quando o registro é durável, -1 se o log falhou.
+ */
+int logAguardarDuravel(LogAcoes *log, uint32_t sessao, uint64_t lsn) {
+    if (atomic_load(&log->erro)) {
+        return -1;
+    }
+    if (atomic_load_explicit(&log->duravel[sessao], memory_order_acquire) > lsn) {
+        return 0;
+    }
+    pthread_mutex_lock(&log->trava);
+    while (atomic_load_explicit(&log->duravel[sessao], memory_order_acquire) <= lsn && !atomic_load(&log->erro)) {
+        pthread_cond_wait(&log->sincronizado, &log->trava);
+    }
+    pthread_mutex_unlock(&log->trava);
+    return atomic_load(&log->erro) ? -1 : 0;
+}
+
+/**
+ * @brief Começa uma nova partida na sessão i e registra a semente.
+ *
+ * @return O lsn do registro.
+ */
+uint64_t poolIniciarSessao(PoolSessoes *pool, LogAcoes *log, int i, uint64_t semente) {
+    poolInicioEscrita(pool, i);
+    iniciarSessao(&pool->sessoes[i], semente);
+    uint64_t lsn = pool->lsn[i]++;
+    poolFimEscrita(pool, i);
+    RegistroLog r = {lsn, semente, (uint32_t)i, LOG_INICIAR, 0, 0};
+    logAnexar(log, &r);
+    return lsn;
+}
+
+static uint64_t poolAnexarAcao(LogAcoes *log, int i, int acao, uint64_t lsn) {
+    RegistroLog r = {lsn, 0, (uint32_t)i, LOG_ACAO, (uint8_t)acao, 0};
+    logAnexar(log, &r);
+    return lsn;
+}
+
+/**
+ * @brief Registra uma ação que quem chama já aplicou a uma cópia da
+ * sessão, e guarda o estado resultante 'depois' no pool.
+ *
+ * @return O lsn do registro.
+ */
+uint64_t poolRegistrar(PoolSessoes *pool, LogAcoes *log, int i, int acao, const Sessao *depois) {
+    poolInicioEscrita(pool, i);
+    pool->sessoes[i] = *depois;
+    uint64_t lsn = pool->lsn[i]++;
+    poolFimEscrita(pool, i);
+    return poolAnexarAcao(log, i, acao, lsn);
+}
+
+/**
+ * @brief Aplica a ação à sessão i e a registra no log.
+ *
+ * Ações ilegais também são registradas: na recuperação elas não mudam o
+ * estado, como aqui.
+ *
+ * @return O lsn do registro.
+ */
+uint64_t poolAplicar(PoolSessoes *pool, LogAcoes *log, int i, int acao) {
+    poolInicioEscrita(pool, i);
+    aplicarAcaoSessao(&pool->sessoes[i], acao);
+    uint64_t lsn = pool->lsn[i]++;
+    poolFimEscrita(pool, i);
+    return poolAnexarAcao(log, i, acao, lsn);
+}
+
+
+// --- CHECKPOINTS INCREMENTAIS DO POOL ---
+
+// Arquivo: uma página de cabeçalho e as sessões em SessaoGravada, página
+// p do pool na página p + 1 do arquivo. 'posicao_log' é o tamanho do log
+// já refletido em todas as sessões gravadas; a recuperação começa dali.
+#define CHECKPOINT_MAGICA "TSCHKPT"
+#define CHECKPOINT_VERSAO 2
+#define CHECKPOINT_LOTE 256            // páginas copiadas antes de cada espera pelo log
+#define CHECKPOINT_INTERVALO_PADRAO_MS 1000
+
+typedef struct {
+    char magica[8];
+    uint32_t versao;
+    uint32_t num_sessoes;
+    uint64_t posicao_log;
+    uint64_t rodadas;
+} CabecalhoCheckpoint;
+
+/**
+ * @brief Checkpoints incrementais do pool em um arquivo mapeado.
+ *
+ * Cada rodada lê a posição sincronizada do log, limpa e copia só as
+ * páginas sujas (cada sessão pelo seu seqlock, sem parar as threads de
+ * jogo), espera o log cobrir os estados copiados e só então os escreve no
+ * mapa; depois de msync, grava a nova posição no cabeçalho. Assim o
+ * arquivo nunca contém um estado que o log em disco não contenha.
+ */
+typedef struct {
+    int fd;
+    void *mapa;
+    size_t tamanho;
+    CabecalhoCheckpoint *cabecalho;
+    SessaoGravada *sessoes;
+    PoolSessoes *pool;
+    LogAcoes *log;             // NULL: pool parado, usa 'posicao_parado'
+    uint64_t posicao_parado;
+    SessaoGravada *copia;      // CHECKPOINT_LOTE páginas
+    int *paginas_lote;
+    long intervalo_ms;
+    pthread_t thread;
+    int rodando;
+    pthread_mutex_t trava;
+    pthread_cond_t acordar;
+    atomic_int parar;
+    uint64_t rodadas;
+    uint64_t paginas_gravadas;
+} Checkpointer;
+
+void checkpointFechar(Checkpointer *ck) {
+    if (ck->mapa) {
+        munmap(ck->mapa, ck->tamanho);
+    }
+    if (ck->fd >= 0) {
+        close(ck->fd);
+    }
+    free(ck->copia);
+    free(ck->paginas_lote);
+    ck->mapa = NULL;
+    ck->fd = -1;
+    ck->copia = NULL;
+    ck->paginas_lote = NULL;
+}
+
+/**
+ * @brief Mapeia (criando ou redimensionando) o arquivo de checkpoint.
+ *
+ * Todas as páginas do pool são marcadas sujas, então a primeira rodada
+ * grava o pool inteiro. Um arquivo de outro pool tem o cabeçalho
+ * invalidado antes, para que uma queda no meio da primeira rodada não
+ * deixe páginas misturadas com um cabeçalho válido.
+ *
+ * @param log Log das sessões, ou NULL com o pool parado ('posicao_log').
+ * @return 0 em caso de sucesso, -1 em erro.
+ */
+int checkpointAbrir(Checkpointer *ck, const char *caminho, PoolSessoes *pool, LogAcoes *log, uint64_t posicao_log) {
+    memset(ck, 0, sizeof(*ck));
+    ck->fd = open(caminho, O_RDWR | O_CREAT, 0644);
+    if (ck->fd < 0) {
+        return -1;
+    }
+    int paginas = paginasDoPool(pool->num_sessoes);
+    ck->tamanho = (size_t)(paginas + 1) * PAGINA_CHECKPOINT;
+    ck->copia = malloc(sizeof(SessaoGravada) * SESSOES_POR_PAGINA * CHECKPOINT_LOTE);
+    ck->paginas_lote = malloc(sizeof(int) * CHECKPOINT_LOTE);
+    struct stat st;
+    if (!ck->copia || !ck->paginas_lote || fstat(ck->fd, &st) != 0
+        || ((size_t)st.st_size != ck->tamanho && ftruncate(ck->fd, (off_t)ck->tamanho) != 0)) {
+        checkpointFechar(ck);
+        return -1;
+    }
+    void *mapa = mmap(NULL, ck->tamanho, PROT_READ | PROT_WRITE, MAP_SHARED, ck->fd, 0);
+    if (mapa == MAP_FAILED) {
+        checkpointFechar(ck);
+        return -1;
+    }
+    ck->mapa = mapa;
+    ck->cabecalho = mapa;
+    ck->sessoes = (SessaoGravada *)((char *)mapa + PAGINA_CHECKPOINT);
+    if (ck->cabecalho->num_sessoes != (uint32_t)pool->num_sessoes) {
+        memset(ck->cabecalho, 0, sizeof(CabecalhoCheckpoint));
+        msync(ck->mapa, PAGINA_CHECKPOINT, MS_SYNC);
+    }
+    ck->pool = pool;
+    ck->log = log;
+    ck->posicao_parado = posicao_log;
+    ck->intervalo_ms = CHECKPOINT_INTERVALO_PADRAO_MS;
+    for (int p = 0; p < paginas; p++) {
+        atomic_store(&pool->sujas[p], 1);
+    }
+    return 0;
+}
+
+// Espera o log cobrir as cópias do lote e as escreve no mapa.
+static int gravarLoteCheckpoint(Checkpointer *ck, int no_lote) {
+    PoolSessoes *pool = ck->pool;
+    for (int j = 0; ck->log && j < no_lote; j++) {
+        int base = ck->paginas_lote[j] * SESSOES_POR_PAGINA;
+        for (int k = 0; k < SESSOES_POR_PAGINA && base + k < pool->num_sessoes; k++) {
+            uint64_t lsn = ck->copia[j * SESSOES_POR_PAGINA + k].lsn;
+            if (lsn > 0 && logAguardarDuravel(ck->log, (uint32_t)(base + k), lsn - 1) != 0) {
+                for (int q = 0; q < no_lote; q++) {
+                    atomic_store(&pool->sujas[ck->paginas_lote[q]], 1);
+                }
+                return -1;
+            }
+        }
+    }
+    for (int j = 0; j < no_lote; j++) {
+        int base = ck->paginas_lote[j] * SESSOES_POR_PAGINA;
+        int n = pool->num_sessoes - base < SESSOES_POR_PAGINA ? pool->num_sessoes - base : SESSOES_POR_PAGINA;
+        memcpy(&ck->sessoes[base], &ck->copia[j * SESSOES_POR_PAGINA], sizeof(SessaoGravada) * n);
+    }
+    ck->paginas_gravadas += (uint64_t)no_lote;
+    return 0;
+}
+
+/**
+ * @brief Grava as páginas sujas e avança o cabeçalho.
+ *
+ * @return Páginas gravadas, ou -1 em erro.
+ */
+int checkpointRodada(Checkpointer *ck) {
+    PoolSessoes *pool = ck->pool;
+    uint64_t posicao = ck->log ? atomic_load_explicit(&ck->log->posicao, memory_order_acquire) : ck->posicao_parado;
+    uint64_t antes = ck->paginas_gravadas;
+    int paginas = paginasDoPool(pool->num_sessoes);
+    int no_lote = 0;
+    for (int p = 0; p < paginas; p++) {
+        if (!atomic_exchange_explicit(&pool->sujas[p], 0, memory_order_acquire)) {
+            continue;
+        }
+        int base = p * SESSOES_POR_PAGINA;
+        SessaoGravada *destino = &ck->copia[no_lote * SESSOES_POR_PAGINA];
+        memset(destino, 0, sizeof(SessaoGravada) * SESSOES_POR_PAGINA);
+        for (int k = 0; k < SESSOES_POR_PAGINA && base + k < pool->num_sessoes; k++) {
+            poolLerSessao(pool, base + k, &destino[k]);
+        }
+        ck->paginas_lote[no_lote++] = p;
+        if (no_lote == CHECKPOINT_LOTE) {
+            if (gravarLoteCheckpoint(ck, no_lote) != 0) {
+                return -1;
+            }
+            no_lote = 0;
+        }
+    }
+    if ((no_lote > 0 && gravarLoteCheckpoint(ck, no_lote) != 0)
+        || msync(ck->sessoes, ck->tamanho - PAGINA_CHECKPOINT, MS_SYNC) != 0) {
+        return -1;
+    }
+    CabecalhoCheckpoint *cab = ck->cabecalho;
+    memcpy(cab->magica, CHECKPOINT_MAGICA, sizeof(CHECKPOINT_MAGICA));
+    cab->versao = CHECKPOINT_VERSAO;
+    cab->num_sessoes = (uint32_t)pool->num_sessoes;
+    cab->posicao_log = posicao;
+    cab->rodadas++;
+    ck->rodadas++;
+    if (msync(ck->mapa, PAGINA_CHECKPOINT, MS_SYNC) != 0) {
+        return -1;
+    }
+    return (int)(ck->paginas_gravadas - antes);
+}
+
+static void *threadCheckpoint(void *arg) {
+    Checkpointer *ck = arg;
+    pthread_mutex_lock(&ck->trava);
+    while (!atomic_load(&ck->parar)) {
+        struct timespec prazo;
+        clock_gettime(CLOCK_REALTIME, &prazo);
+        prazo.tv_nsec += (ck->intervalo_ms % 1000) * 1000000;
+        prazo.tv_sec += ck->intervalo_ms / 1000 + prazo.tv_nsec / 1000000000;
+        prazo.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&ck->acordar, &ck->trava, &prazo);
+        if (atomic_load(&ck->parar)) {
+            break;
+        }
+        pthread_mutex_unlock(&ck->trava);
+        checkpointRodada(ck);
+        pthread_mutex_lock(&ck->trava);
+    }
+    pthread_mutex_unlock(&ck->trava);
+    return NULL;
+}
+
+/**
+ * @brief Roda checkpointRodada a cada 'intervalo_ms' em uma thread de fundo.
+ *
+ * @return 0 em caso de sucesso, -1 se a thread não puder ser criada.
+ */
+int checkpointIniciar(Checkpointer *ck, long intervalo_ms) {
+    ck->intervalo_ms = intervalo_ms > 0 ? intervalo_ms : CHECKPOINT_INTERVALO_PADRAO_MS;
+    atomic_init(&ck->parar, 0);
+    pthread_mutex_init(&ck->trava, NULL);
+    pthread_cond_init(&ck->acordar, NULL);
+    ck->rodando = pthread_create(&ck->thread, NULL, threadCheckpoint, ck) == 0;
+    return ck->rodando ? 0 : -1;
+}
+
+/**
+ * @brief Para a thread de fundo e faz uma última rodada.
+ *
+ * Deve ser chamado com o log ainda aberto, depois das threads de jogo.
+ *
+ * @return 0 em caso de sucesso, -1 em erro.
+ */
+int checkpointParar(Checkpointer *ck) {
+    if (ck->rodando) {
+        pthread_mutex_lock(&ck->trava);
+        atomic_store(&ck->parar, 1);
+        pthread_cond_signal(&ck->acordar);
+        pthread_mutex_unlock(&ck->trava);
+        pthread_join(ck->thread, NULL);
+        pthread_mutex_destroy(&ck->trava);
+        pthread_cond_destroy(&ck->acordar);
+        ck->rodando = 0;
+    }
+    return checkpointRodada(ck) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Grava o checkpoint completo de um pool parado.
+ *
+ * @return 0 em caso de sucesso, -1 em erro.
+ */
+int salvarCheckpoint(PoolSessoes *pool, const char *caminho, uint64_t posicao_log) {
+    Checkpointer ck;
+    if (checkpointAbrir(&ck, caminho, pool, NULL, posicao_log) != 0) {
+        return -1;
+    }
+    int res = checkpointRodada(&ck);
+    checkpointFechar(&ck);
+    return res < 0 ? -1 : 0;
+}
+
+// Carrega um checkpoint em um pool novo. Retorna a posição do log ou -1.
+static int64_t carregarCheckpoint(PoolSessoes *pool, const char *caminho) {
+    int fd = open(caminho, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < PAGINA_CHECKPOINT) {
+        close(fd);
+        return -1;
+    }
+    void *mapa = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapa == MAP_FAILED) {
+        return -1;
+    }
+    const CabecalhoCheckpoint *cab = mapa;
+    if (memcmp(cab->magica, CHECKPOINT_MAGICA, sizeof(CHECKPOINT_MAGICA)) != 0 || cab->versao != CHECKPOINT_VERSAO
+        || (size_t)st.st_size != (size_t)(paginasDoPool((int)cab->num_sessoes) + 1) * PAGINA_CHECKPOINT
+        || poolCriar(pool, (int)cab->num_sessoes) != 0) {
+        munmap(mapa, st.st_size);
+        return -1;
+    }
+    madvise(mapa, st.st_size, MADV_SEQUENTIAL);
+    const SessaoGravada *gravadas = (const SessaoGravada *)((const char *)mapa + PAGINA_CHECKPOINT);
+    for (int i = 0; i < pool->num_sessoes; i++) {
+        pool->sessoes[i] = gravadas[i].sessao;
+        pool->sessoes[i].gerador.sequencia = NULL; // ponteiros não valem entre processos
+        pool->sessoes[i].gerador.pecas_sequencia = 0;
+        pool->lsn[i] = gravadas[i].lsn;
+    }
+    int64_t posicao = (int64_t)cab->posicao_log;
+    munmap(mapa, st.st_size);
+    return posicao;
+}
+
+/**
+ * @brief Resultado de uma recuperação.
+ */
+typedef struct {
+    uint64_t aplicados;     // registros aplicados às sessões
+    uint64_t ignorados;     // já contidos no checkpoint
+    uint64_t lacunas;       // lsn à frente do esperado (log inconsistente)
+    uint64_t bytes_cortados; // registro rasgado descartado no fim do log
+    uint64_t tamanho_log;   // tamanho válido do log após a recuperação
+} Recuperacao;
+
+/**
+ * @brief Reconstrói o pool a partir do último checkpoint (opcional) e do log.
+ *
+ * Sem checkpoint nem log, cria um pool vazio de 'num_sessoes'. Um registro
+ * incompleto ou com verificação errada no fim do log é cortado do arquivo,
+ * para que novos registros continuem a partir do último válido.
+ *
+ * @return 0 em caso de sucesso, -1 se os arquivos forem inválidos.
+ */
+int recuperarPool(PoolSessoes *pool, int num_sessoes, const char *caminho_log, const char *caminho_checkpoint,
+                  Recuperacao *rec) {
+    memset(rec, 0, sizeof(*rec));
+    int64_t inicio = -1;
+    if (caminho_checkpoint) {
+        inicio = carregarCheckpoint(pool, caminho_checkpoint);
+        if (inicio < 0) {
+            return -1;
+        }
+    }
+
+    int fd = open(caminho_log, O_RDWR);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (inicio < 0 && poolCriar(pool, num_sessoes) != 0) {
+            return -1;
+        }
+        return 0;
+    }
+    CabecalhoLog cab;
+    if (pread(fd, &cab, sizeof(cab), 0) != (ssize_t)sizeof(cab) || memcmp(cab.magica, LOG_MAGICA, 8) != 0
+        || cab.versao != LOG_VERSAO || (inicio >= 0 && cab.num_sessoes != (uint32_t)pool->num_sessoes)
+        || (inicio < 0 && poolCriar(pool, (int)cab.num_sessoes) != 0)) {
+        close(fd);
+        if (inicio >= 0) {
+            poolDestruir(pool);
+        }
+        return -1;
+    }
+    void *mapa = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapa == MAP_FAILED) {
+        close(fd);
+        poolDestruir(pool);
+        return -1;
+    }
+    madvise(mapa, st.st_size, MADV_SEQUENTIAL);
+
+    uint64_t pos = inicio > (int64_t)sizeof(cab) ? (uint64_t)inicio : sizeof(cab);
+    for (; pos + sizeof(RegistroLog) <= (uint64_t)st.st_size; pos += sizeof(RegistroLog)) {
+        const RegistroLog *r = (const RegistroLog *)((const char *)mapa + pos);
+        if (r->verificacao != verificacaoRegistro(r) || r->sessao >= (uint32_t)pool->num_sessoes
+            || (r->tipo != LOG_INICIAR && r->tipo != LOG_ACAO)) {
+            break;
+        }
+        uint64_t esperado = pool->lsn[r->sessao];
+        if (r->lsn < esperado) {
+            rec->ignorados++;
+            continue;
+        }
+        if (r->lsn > esperado) {
+            rec->lacunas++;
+            continue;
+        }
+        if (r->tipo == LOG_INICIAR) {
+            iniciarSessao(&pool->sessoes[r->sessao], r->semente);
+        } else {
+            aplicarAcaoSessao(&pool->sessoes[r->sessao], r->acao);
+        }
+        pool->lsn[r->sessao]++;
+        rec->aplicados++;
+    }
+    munmap(mapa, st.st_size);
+    if (pos < (uint64_t)st.st_size) {
+        rec->bytes_cortados = (uint64_t)st.st_size - pos;
+        if (ftruncate(fd, (off_t)pos) != 0 || fsync(fd) != 0) {
+            close(fd);
+            poolDestruir(pool);
+            return -1;
+        }
+    }
+    rec->tamanho_log = pos;
+    close(fd);
+    return 0;
+}
+
+
+// --- TABULEIRO E FORMAS DAS PEÇAS ---
+
+// Cada linha do tabuleiro é um uint16_t: as colunas 0..9 ficam nos bits
+// TABULEIRO_PAREDE..TABULEIRO_PAREDE + 9 e os bits de fora são paredes
+// sempre ocupadas, então uma linha cheia vale LINHA_CHEIA e sair pelos
+// lados já é uma colisão. Abaixo da linha 0 há TABULEIRO_BORDA linhas
+// cheias (o chão) e acima do topo outras tantas só com as paredes, para
+// que uma peça em qualquer posição alcançável leia linhas válidas.
+#define TABULEIRO_LARGURA 10
+#define TABULEIRO_VISIVEL 20
+#define TABULEIRO_ALTURA 24                   // 20 visíveis + 4 de surgimento
+#define TABULEIRO_BORDA 4
+#define TABULEIRO_LINHAS (TABULEIRO_ALTURA + 2 * TABULEIRO_BORDA)
+#define TABULEIRO_PAREDE 3
+#define LINHA_CHEIA 0xFFFFu
+#define LINHA_VAZIA ((uint16_t)~(((1u << TABULEIRO_LARGURA) - 1) << TABULEIRO_PAREDE))
+#define MASCARA_COLUNAS (((1u << TABULEIRO_LARGURA) - 1) << TABULEIRO_PAREDE)
+
+#define NUM_ROTACOES 4
+#define SURGIMENTO_X 3
+#define SURGIMENTO_Y (TABULEIRO_VISIVEL - 1)
+
+/**
+ * @brief Tabuleiro em máscaras de linha (64 bytes, uma linha de cache).
+ *
+ * A linha y do jogo (0 = fundo) fica em linhas[TABULEIRO_BORDA + y].
+ */
+typedef struct {
+    uint16_t linhas[TABULEIRO_LINHAS];
+} Tabuleiro;
+
+/**
+ * @brief Forma de uma peça em uma rotação, dentro da sua caixa SRS.
+ *
+ * 'linhas[r]' é a linha r da caixa (0 = de baixo), com a coluna c da
+ * caixa no bit c. A caixa limitante das células vai de (x_min, y_min) a
+ * (x_max, y_max), em coordenadas da caixa.
+ */
+typedef struct {
+    uint8_t linhas[4];
+    int8_t x_min, x_max, y_min, y_max;
+} FormaPeca;
+
+// Formas SRS por tipo compactado (ordem de TIPOS_PECA) e rotação
+// (0 = surgimento, 1 = direita, 2 = invertida, 3 = esquerda).
+static const FormaPeca FORMAS[NUM_TIPOS][NUM_ROTACOES] = {
+    { // I
+        {{0x00, 0x00, 0x0F, 0x00}, 0, 3, 2, 2},
+        {{0x04, 0x04, 0x04, 0x04}, 2, 2, 0, 3},
+        {{0x00, 0x0F, 0x00, 0x00}, 0, 3, 1, 1},
+        {{0x02, 0x02, 0x02, 0x02}, 1, 1, 0, 3},
+    },
+    { // O
+        {{0x00, 0x06, 0x06, 0x00}, 1, 2, 1, 2},
+        {{0x00, 0x06, 0x06, 0x00}, 1, 2, 1, 2},
+        {{0x00, 0x06, 0x06, 0x00}, 1, 2, 1, 2},
+        {{0x00, 0x06, 0x06, 0x00}, 1, 2, 1, 2},
+    },
+    { // T
+        {{0x00, 0x07, 0x02, 0x00}, 0, 2, 1, 2},
+        {{0x02, 0x06, 0x02, 0x00}, 1, 2, 0, 2},
+        {{0x02, 0x07, 0x00, 0x00}, 0, 2, 0, 1},
+        {{0x02, 0x03, 0x02, 0x00}, 0, 1, 0, 2},
+    },
+    { // L
+        {{0x00, 0x07, 0x04, 0x00}, 0, 2, 1, 2},
+        {{0x06, 0x02, 0x02, 0x00}, 1, 2, 0, 2},
+        {{0x01, 0x07, 0x00, 0x00}, 0, 2, 0, 1},
+        {{0x02, 0x02, 0x03, 0x00}, 0, 1, 0, 2},
+    },
+    { // S
+        {{0x00, 0x03, 0x06, 0x00}, 0, 2, 1, 2},
+        {{0x04, 0x06, 0x02, 0x00}, 1, 2, 0, 2},
+        {{0x03, 0x06, 0x00, 0x00}, 0, 2, 0, 1},
+        {{0x02, 0x03, 0x01, 0x00}, 0, 1, 0, 2},
+    },
+    { // Z
+        {{0x00, 0x06, 0x03, 0x00}, 0, 2, 1, 2},
+        {{0x02, 0x06, 0x04, 0x00}, 1, 2, 0, 2},
+        {{0x06, 0x03, 0x00, 0x00}, 0, 2, 0, 1},
+        {{0x01, 0x03, 0x02, 0x00}, 0, 1, 0, 2},
+    },
+    { // J
+        {{0x00, 0x07, 0x01, 0x00}, 0, 2, 1, 2},
+        {{0x02, 0x02, 0x06, 0x00}, 1, 2, 0, 2},
+        {{0x04, 0x07, 0x00, 0x00}, 0, 2, 0, 1},
+        {{0x03, 0x02, 0x02, 0x00}, 0, 1, 0, 2},
+    },
+
+};
+
+// Testes de chute do SRS, (dx, dy) com y para cima, por classe de peça
+// (0 = J, L, S, T, Z; 1 = I; 2 = O), rotação de origem e sentido
+// (0 = horário, 1 = anti-horário).
+static const int8_t CHUTES_SRS[3][NUM_ROTACOES][2][5][2] = {
+    { // J, L, S, T, Z
+        {{{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}, {{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}},
+        {{{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}, {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}},
+        {{{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}, {{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}},
+        {{{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}, {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}},
+    },
+    { // I
+        {{{0, 0}, {-2, 0}, {1, 0}, {-2, -1}, {1, 2}}, {{0, 0}, {-1, 0}, {2, 0}, {-1, 2}, {2, -1}}},
+        {{{0, 0}, {-1, 0}, {2, 0}, {-1, 2}, {2, -1}}, {{0, 0}, {2, 0}, {-1, 0}, {2, 1}, {-1, -2}}},
+        {{{0, 0}, {2, 0}, {-1, 0}, {2, 1}, {-1, -2}}, {{0, 0}, {1, 0}, {-2, 0}, {1, -2}, {-2, 1}}},
+        {{{0, 0}, {1, 0}, {-2, 0}, {1, -2}, {-2, 1}}, {{0, 0}, {-2, 0}, {1, 0}, {-2, -1}, {1, 2}}},
+    },
+    { // O: não chuta
+        {{{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}, {{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}},
+        {{{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}, {{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}},
+        {{{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}, {{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}},
+        {{{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}, {{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}},
+    },
+};
+
+static const uint8_t CLASSE_CHUTE[NUM_TIPOS] = {1, 2, 0, 0, 0, 0, 0};
+
+void tabuleiroLimpar(Tabuleiro *t) {
+    for (int i = 0; i < TABULEIRO_LINHAS; i++) {
+        t->linhas[i] = i < TABULEIRO_BORDA ? LINHA_CHEIA : LINHA_VAZIA;
+    }
+}
+
+// Inverte a ordem das TABULEIRO_LARGURA colunas de 'colunas' (bit 0 = coluna 0).
+static inline uint32_t espelharColunas(uint32_t colunas) {
+    uint32_t v = colunas;
+    v = (v >> 1 & 0x5555u) | (v & 0x5555u) << 1;
+    v = (v >> 2 & 0x3333u) | (v & 0x3333u) << 2;
+    v = (v >> 4 & 0x0F0Fu) | (v & 0x0F0Fu) << 4;
+    v = (v >> 8 & 0x00FFu) | (v & 0x00FFu) << 8;
+    return v >> (16 - TABULEIRO_LARGURA);
+}
+
+/**
+ * @brief Espelha o tabuleiro (coluna c <-> coluna 9 - c); paredes e bordas
+ * não mudam. Com L <-> J e S <-> Z, é a simetria de espelho do jogo.
+ */
+void espelharTabuleiro(Tabuleiro *t) {
+    for (int i = 0; i < TABULEIRO_LINHAS; i++) {
+        uint32_t colunas = (t->linhas[i] & MASCARA_COLUNAS) >> TABULEIRO_PAREDE;
+        t->linhas[i] = (uint16_t)((t->linhas[i] & ~MASCARA_COLUNAS) | espelharColunas(colunas) << TABULEIRO_PAREDE);
+    }
+}
+
+/**
+ * @brief Testa se a peça, com a caixa em (x, y), sobrepõe algo ocupado.
+ *
+ * A linha é lida com os bits acima de 15 ligados, então células além da
+ * parede direita também colidem. Válido para x >= -x_min e
+ * y >= -TABULEIRO_BORDA, que cobre toda posição alcançável.
+ */
+static inline int colide(const Tabuleiro *t, int tipo, int rot, int x, int y) {
+    const FormaPeca *f = &FORMAS[tipo][rot];
+    const uint16_t *linhas = &t->linhas[TABULEIRO_BORDA + y];
+    int desloc = x + TABULEIRO_PAREDE;
+    uint32_t c = ((uint32_t)f->linhas[0] << desloc) & (linhas[0] | 0xFFFF0000u);
+    c |= ((uint32_t)f->linhas[1] << desloc) & (linhas[1] | 0xFFFF0000u);
+    c |= ((uint32_t)f->linhas[2] << desloc) & (linhas[2] | 0xFFFF0000u);
+    c |= ((uint32_t)f->linhas[3] << desloc) & (linhas[3] | 0xFFFF0000u);
+    return c != 0;
+}
+
+// Grava as células da peça no tabuleiro (a posição deve estar livre).
+static inline void fixarPeca(Tabuleiro *t, int tipo, int rot, int x, int y) {
+    const FormaPeca *f = &FORMAS[tipo][rot];
+    uint16_t *linhas = &t->linhas[TABULEIRO_BORDA + y];
+    int desloc = x + TABULEIRO_PAREDE;
+    for (int r = f->y_min; r <= f->y_max; r++) {
+        linhas[r] |= (uint16_t)(f->linhas[r] << desloc);
+    }
+}
+
+// Menor y alcançável descendo a peça a partir de (x, y).
+static inline int yDeQueda(const Tabuleiro *t, int tipo, int rot, int x, int y) {
+    while (!colide(t, tipo, rot, x, y - 1)) {
+        y--;
+    }
+    return y;
+}
+
+/**
+ * @brief Gira a peça com os chutes do SRS.
+ *
+ * @param sentido 0 = horário, 1 = anti-horário.
+ * @return Índice do chute usado (0 a 4), ou -1 se nenhum couber; só
+ *         altera rot, x e y em caso de sucesso.
+ */
+int rotacionarSRS(const Tabuleiro *t, int tipo, int *rot, int *x, int *y, int sentido) {
+    int nova = (*rot + (sentido ? NUM_ROTACOES - 1 : 1)) % NUM_ROTACOES;
+    const int8_t (*chutes)[2] = CHUTES_SRS[CLASSE_CHUTE[tipo]][*rot][sentido];
+    for (int k = 0; k < 5; k++) {
+        int nx = *x + chutes[k][0], ny = *y + chutes[k][1];
+        if (ny >= -TABULEIRO_BORDA && ny <= TABULEIRO_ALTURA && nx >= -FORMAS[tipo][nova].x_min
+            && !colide(t, tipo, nova, nx, ny)) {
+            *rot = nova;
+            *x = nx;
+            *y = ny;
+            return k;
+        }
+    }
+    return -1;
+}
+
+
+// --- LIMPEZA DE LINHAS ---
+
+#define MASCARA_ALTURA ((1u << TABULEIRO_ALTURA) - 1)
+
+// Máscara das linhas cheias (bit y = linha y do jogo), uma linha por vez.
+static inline uint32_t linhasCheiasEscalar(const Tabuleiro *t) {
+    uint32_t m = 0;
+    for (int y = 0; y < TABULEIRO_ALTURA; y++) {
+        m |= (uint32_t)(t->linhas[TABULEIRO_BORDA + y] == LINHA_CHEIA) << y;
+    }
+    return m;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// SSE2 (sempre presente em x86-64): 8 linhas por comparação, e o pack
+// junta os resultados em um byte por linha para um único movemask.
+static inline uint32_t linhasCheiasSse2(const Tabuleiro *t) {
+    const __m128i cheia = _mm_set1_epi16(-1);
+    const __m128i *l = (const __m128i *)t->linhas;
+    __m128i a = _mm_cmpeq_epi16(_mm_loadu_si128(l), cheia);
+    __m128i b = _mm_cmpeq_epi16(_mm_loadu_si128(l + 1), cheia);
+    __m128i c = _mm_cmpeq_epi16(_mm_loadu_si128(l + 2), cheia);
+    __m128i d = _mm_cmpeq_epi16(_mm_loadu_si128(l + 3), cheia);
+    uint32_t m = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(a, b))
+               | (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(c, d)) << 16;
+    return (m >> TABULEIRO_BORDA) & MASCARA_ALTURA;
+}
+
+// AVX2: o tabuleiro inteiro em dois registradores.
+__attribute__((target("avx2")))
+static inline uint32_t linhasCheiasAvx2(const Tabuleiro *t) {
+    const __m256i cheia = _mm256_set1_epi16(-1);
+    __m256i a = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)t->linhas), cheia);
+    __m256i b = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)t->linhas + 1), cheia);
+    // o pack intercala as metades de 128 bits; a permutação as desfaz
+    __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+    return ((uint32_t)_mm256_movemask_epi8(p) >> TABULEIRO_BORDA) & MASCARA_ALTURA;
+}
+
+__attribute__((target("avx2")))
+static void linhasCheiasLoteAvx2(const Tabuleiro *t, uint32_t *mascaras, int n) {
+    for (int i = 0; i < n; i++) {
+        mascaras[i] = linhasCheiasAvx2(&t[i]);
+    }
+}
+#endif
+
+/**
+ * @brief Máscara das linhas cheias do tabuleiro (bit y = linha y).
+ */
+static inline uint32_t linhasCheias(const Tabuleiro *t) {
+#if defined(__GNUC__) && defined(__x86_64__)
+    return linhasCheiasSse2(t);
+#else
+    return linhasCheiasEscalar(t);
+#endif
+}
+
+/**
+ * @brief Linhas cheias de vários tabuleiros (com AVX2 quando disponível).
+ */
+void linhasCheiasLote(const Tabuleiro *t, uint32_t *mascaras, int n) {
+#if defined(__GNUC__) && defined(__x86_64__)
+    static int avx2 = -1;
+    if (avx2 < 0) {
+        avx2 = __builtin_cpu_supports("avx2");
+    }
+    if (avx2) {
+        linhasCheiasLoteAvx2(t, mascaras, n);
+        return;
+    }
+#endif
+    for (int i = 0; i < n; i++) {
+        mascaras[i] = linhasCheias(&t[i]);
+    }
+}
+
+/**
+ * @brief Remove as linhas de 'cheias' e desce as de cima.
+ *
+ * As linhas abaixo da primeira cheia não se movem; das demais, cada uma
+ * é copiada para a posição de escrita, que só avança quando a linha
+ * sobrevive (sem desvio por linha).
+ */
+static inline void compactarLinhas(Tabuleiro *t, uint32_t cheias) {
+    uint16_t *l = t->linhas + TABULEIRO_BORDA;
+    int w = __builtin_ctz(cheias);
+    for (int y = w; y < TABULEIRO_ALTURA; y++) {
+        l[w] = l[y];
+        w += !((cheias >> y) & 1u);
+    }
+    for (; w < TABULEIRO_ALTURA; w++) {
+        l[w] = LINHA_VAZIA;
+    }
+}
+
+/**
+ * @brief Remove as linhas cheias.
+ *
+ * @return Número de linhas removidas.
+ */
+int limparLinhas(Tabuleiro *t) {
+    uint32_t cheias = linhasCheias(t);
+    if (!cheias) {
+        return 0;
+    }
+    compactarLinhas(t, cheias);
+    return __builtin_popcount(cheias);
+}
+
+/**
+ * @brief Fixa a peça e remove as linhas que ela completar.
+ *
+ * @return Número de linhas removidas.
+ */
+int colocarPeca(Tabuleiro *t, int tipo, int rot, int x, int y) {
+    fixarPeca(t, tipo, rot, x, y);
+    return limparLinhas(t);
+}
+
+
+// --- CARACTERÍSTICAS DA SUPERFÍCIE ---
+
+// Colunas das formas: COLUNAS_FORMA[tipo][rot][c] tem o bit r ligado se
+// a célula (c, r) da caixa pertence à peça (transposta de FORMAS).
+static const uint8_t COLUNAS_FORMA[NUM_TIPOS][NUM_ROTACOES][4] = {
+    { // I
+        {0x04, 0x04, 0x04, 0x04},
+        {0x00, 0x00, 0x0F, 0x00},
+        {0x02, 0x02, 0x02, 0x02},
+        {0x00, 0x0F, 0x00, 0x00},
+    },
+    { // O
+        {0x00, 0x06, 0x06, 0x00},
+        {0x00, 0x06, 0x06, 0x00},
+        {0x00, 0x06, 0x06, 0x00},
+        {0x00, 0x06, 0x06, 0x00},
+    },
+    { // T
+        {0x02, 0x06, 0x02, 0x00},
+        {0x00, 0x07, 0x02, 0x00},
+        {0x02, 0x03, 0x02, 0x00},
+        {0x02, 0x07, 0x00, 0x00},
+    },
+    { // L
+        {0x02, 0x02, 0x06, 0x00},
+        {0x00, 0x07, 0x01, 0x00},
+        {0x03, 0x02, 0x02, 0x00},
+        {0x04, 0x07, 0x00, 0x00},
+    },
+    { // S
+        {0x02, 0x06, 0x04, 0x00},
+        {0x00, 0x06, 0x03, 0x00},
+        {0x01, 0x03, 0x02, 0x00},
+        {0x06, 0x03, 0x00, 0x00},
+    },
+    { // Z
+        {0x04, 0x06, 0x02, 0x00},
+        {0x00, 0x03, 0x06, 0x00},
+        {0x02, 0x03, 0x01, 0x00},
+        {0x03, 0x06, 0x00, 0x00},
+    },
+    { // J
+        {0x06, 0x02, 0x02, 0x00},
+        {0x00, 0x07, 0x04, 0x00},
+        {0x02, 0x02, 0x03, 0x00},
+        {0x01, 0x07, 0x00, 0x00},
+    },
+};
+
+// Topo de cada coluna das formas: o byte c é topoDaColuna(COLUNAS_FORMA
+// [tipo][rot][c]), ou 0 se a coluna c da caixa é vazia.
+static const uint32_t TOPOS_FORMA[NUM_TIPOS][NUM_ROTACOES] = {
+    {0x03030303, 0x00040000, 0x02020202, 0x00000400}, // I
+    {0x00030300, 0x00030300, 0x00030300, 0x00030300}, // O
+    {0x00020302, 0x00020300, 0x00020202, 0x00000302}, // T
+    {0x00030202, 0x00010300, 0x00020202, 0x00000303}, // L
+    {0x00030302, 0x00020300, 0x00020201, 0x00000203}, // S
+    {0x00020303, 0x00030200, 0x00010202, 0x00000302}, // Z
+    {0x00020203, 0x00030300, 0x00020202, 0x00000301}, // J
+};
+
+/**
+ * @brief Características do tabuleiro mantidas junto com ele.
+ *
+ * 'colunas[c]' é a coluna c em bits (bit y = linha y do jogo); a altura
+ * de uma coluna é 32 - clz e os buracos, a altura menos o popcount.
+ * Os totais são atualizados só nas colunas que a peça toca, então
+ * colocar uma peça custa O(células da peça); remover linhas refaz os
+ * totais a partir das colunas, em O(largura).
+ */
+typedef struct {
+    uint32_t colunas[TABULEIRO_LARGURA];
+    uint8_t alturas[TABULEIRO_LARGURA];
+    uint8_t altura_max;
+    int16_t soma_alturas;
+    int16_t buracos;
+    int16_t irregularidade;  // soma de |h[c] - h[c + 1]|
+    int16_t pocos;           // soma das profundidades dos poços
+} Superficie;
+
+/**
+ * @brief Características de uma jogada candidata.
+ */
+typedef struct {
+    int linhas;
+    int soma_alturas;
+    int altura_max;
+    int buracos;
+    int irregularidade;
+    int pocos;
+} Caracteristicas;
+
+// Células em uma coluna de forma (4 bits), sem depender de popcnt.
+static inline int celulasNaColuna(unsigned forma) {
+    return (int)((0x4332322132212110ULL >> (forma * 4)) & 0xF);
+}
+
+// Altura da célula mais alta de uma coluna de forma (4 bits, não vazia).
+static inline int topoDaColuna(unsigned forma) {
+    return (int)((0x4444444433332210ULL >> (forma * 4)) & 0xF);
+}
+
+static inline int alturaColuna(uint32_t coluna) {
+    return coluna ? 32 - __builtin_clz(coluna) : 0;
+}
+
+// Profundidade do poço na coluna c: quanto os vizinhos (o único vizinho,
+// nas bordas) passam da sua altura.
+static inline int pocoColuna(const uint8_t *h, int c) {
+    int esq = c > 0 ? h[c - 1] : 255;
+    int dir = c < TABULEIRO_LARGURA - 1 ? h[c + 1] : 255;
+    int viz = esq < dir ? esq : dir;
+    return viz > h[c] ? viz - h[c] : 0;
+}
+
+// Soma da irregularidade dos pares (c, c + 1) com a <= c < z e dos
+// poços das colunas a..z, em '*irregularidade' e '*pocos'.
+static inline void termosFaixa(const uint8_t *h, int a, int z, int *irregularidade, int *pocos) {
+    int irr = 0, poc = 0;
+    for (int c = a; c <= z; c++) {
+        poc += pocoColuna(h, c);
+        irr += c < z ? abs(h[c] - h[c + 1]) : 0;
+    }
+    *irregularidade = irr;
+    *pocos = poc;
+}
+
+// Refaz alturas e totais a partir das colunas.
+static void superficieRecalcular(Superficie *s) {
+    int soma = 0, max = 0, buracos = 0;
+    for (int c = 0; c < TABULEIRO_LARGURA; c++) {
+        int h = alturaColuna(s->colunas[c]);
+        s->alturas[c] = (uint8_t)h;
+        soma += h;
+        max = h > max ? h : max;
+        buracos += h - __builtin_popcount(s->colunas[c]);
+    }
+    s->soma_alturas = (int16_t)soma;
+    s->altura_max = (uint8_t)max;
+    s->buracos = (int16_t)buracos;
+    int irregularidade, pocos;
+    termosFaixa(s->alturas, 0, TABULEIRO_LARGURA - 1, &irregularidade, &pocos);
+    s->irregularidade = (int16_t)irregularidade;
+    s->pocos = (int16_t)pocos;
+}
+
+/**
+ * @brief Calcula a superfície do zero, transpondo as linhas do tabuleiro.
+ */
+void superficieCalcular(Superficie *s, const Tabuleiro *t) {
+    for (int c = 0; c < TABULEIRO_LARGURA; c++) {
+        uint32_t coluna = 0;
+        for (int y = 0; y < TABULEIRO_ALTURA; y++) {
+            coluna |= (uint32_t)((t->linhas[TABULEIRO_BORDA + y] >> (TABULEIRO_PAREDE + c)) & 1) << y;
+        }
+        s->colunas[c] = coluna;
+    }
+    superficieRecalcular(s);
+}
+
+/**
+ * @brief Acrescenta as células da peça à superfície (sem remover linhas).
+ *
+ * Só as colunas da peça e as vizinhas entram na conta.
+ */
+static inline void superficieFixar(Superficie *s, int tipo, int rot, int x, int y) {
+    const FormaPeca *f = &FORMAS[tipo][rot];
+    const uint8_t *forma = COLUNAS_FORMA[tipo][rot];
+    int c0 = x + f->x_min, c1 = x + f->x_max;
+    // termos que mudam: pares e poços de c0 - 1 .. c1 + 1
+    int a = c0 > 0 ? c0 - 1 : 0;
+    int z = c1 < TABULEIRO_LARGURA - 1 ? c1 + 1 : c1;
+    int irr_antes, pocos_antes, irr_depois, pocos_depois;
+    termosFaixa(s->alturas, a, z, &irr_antes, &pocos_antes);
+    // a caixa pode começar abaixo do fundo quando a linha 0 dela é vazia
+    int sobe = y > 0 ? y : 0, desce = y < 0 ? -y : 0;
+    int buracos = s->buracos, soma = s->soma_alturas, max = s->altura_max;
+    for (int c = c0; c <= c1; c++) {
+        unsigned celulas = forma[c - x];
+        s->colunas[c] |= (celulas >> desce) << sobe;
+        int topo = y + topoDaColuna(celulas);
+        int h = topo > s->alturas[c] ? topo : s->alturas[c];
+        int dh = h - s->alturas[c];
+        buracos += dh - celulasNaColuna(celulas);
+        soma += dh;
+        max = h > max ? h : max;
+        s->alturas[c] = (uint8_t)h;
+    }
+    s->buracos = (int16_t)buracos;
+    s->soma_alturas = (int16_t)soma;
+    s->altura_max = (uint8_t)max;
+    termosFaixa(s->alturas, a, z, &irr_depois, &pocos_depois);
+    s->irregularidade = (int16_t)(s->irregularidade + irr_depois - irr_antes);
+    s->pocos = (int16_t)(s->pocos + pocos_depois - pocos_antes);
+}
+
+/**
+ * @brief Remove das colunas as linhas de 'cheias' e refaz os totais.
+ */
+static void superficieRemoverLinhas(Superficie *s, uint32_t cheias) {
+    for (int c = 0; c < TABULEIRO_LARGURA; c++) {
+        uint32_t coluna = s->colunas[c];
+        // de cima para baixo, para que os índices de baixo não mudem
+        for (uint32_t m = cheias; m; m &= ~(1u << (31 - __builtin_clz(m)))) {
+            int y = 31 - __builtin_clz(m);
+            uint32_t abaixo = (1u << y) - 1;
+            coluna = (coluna & abaixo) | ((coluna >> 1) & ~abaixo);
+        }
+        s->colunas[c] = coluna;
+    }
+    superficieRecalcular(s);
+}
+
+/**
+ * @brief Coloca a peça, remove as linhas completas e mantém a superfície.
+ *
+ * @return Número de linhas removidas.
+ */
+int colocarPecaSuperficie(Tabuleiro *t, Superficie *s, int tipo, int rot, int x, int y) {
+    fixarPeca(t, tipo, rot, x, y);
+    superficieFixar(s, tipo, rot, x, y);
+    uint32_t cheias = linhasCheias(t);
+    if (!cheias) {
+        return 0;
+    }
+    compactarLinhas(t, cheias);
+    superficieRemoverLinhas(s, cheias);
+    return __builtin_popcount(cheias);
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// Alturas da superfície num registrador, com a coluna c no byte c + 2 e
+// zero nos demais bytes (ver avaliarSemLinhas).
+static inline __m128i alturasSse(const Superficie *s) {
+    const __m128i colunas = _mm_setr_epi8(0, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0);
+    return _mm_and_si128(_mm_slli_si128(_mm_loadu_si128((const __m128i *)s->alturas), 2), colunas);
+}
+
+// Topos da peça (TOPOS_FORMA) com a coluna c da caixa no byte x + c + 2,
+// alinhados com alturasSse.
+static inline __m128i toposSse(int tipo, int rot, int x) {
+    unsigned __int128 posicionados = (unsigned __int128)TOPOS_FORMA[tipo][rot] << (8 * (x + 2));
+    return _mm_set_epi64x((long long)(uint64_t)(posicionados >> 64), (long long)(uint64_t)posicionados);
+}
+
+/**
+ * @brief superficieAvaliar sem cópia da superfície, com SSE2.
+ *
+ * Confere as 4 linhas da caixa de uma vez; se a jogada completa alguma,
+ * devolve 0 e fica para o caminho geral. Senão as colunas da peça sobem
+ * até o topo dela e os totais saem de somas sobre as alturas (de
+ * alturasSse) e dos topos da peça (de toposSse), com 255 além das bordas
+ * nos poços. Cada coluna ganha
+ * altura menos células em buracos e toda peça tem 4 células, então os
+ * buracos são 'buracos_base' (buracos - soma das alturas - 4) mais a
+ * soma nova.
+ *
+ * @return 1 se preencheu 'car', 0 se a jogada completa linhas.
+ */
+static inline int avaliarSemLinhas(const Tabuleiro *t, __m128i alturas, __m128i topos, int buracos_base, int tipo,
+                                   int rot, int x, int y, Caracteristicas *car) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i uns = _mm_set1_epi8(-1);
+    uint32_t forma;
+    memcpy(&forma, FORMAS[tipo][rot].linhas, sizeof(forma));
+    __m128i peca = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)forma), zero);
+    peca = _mm_sll_epi16(peca, _mm_cvtsi32_si128(x + TABULEIRO_PAREDE));
+    __m128i linhas = _mm_loadl_epi64((const __m128i *)&t->linhas[TABULEIRO_BORDA + y]);
+    __m128i cheias = _mm_andnot_si128(_mm_cmpeq_epi16(peca, zero), _mm_cmpeq_epi16(_mm_or_si128(linhas, peca), uns));
+    if (_mm_movemask_epi8(cheias)) {
+        return 0;
+    }
+
+    const __m128i colunas = _mm_setr_epi8(0, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0);
+    const __m128i pares = _mm_and_si128(colunas, _mm_srli_si128(colunas, 1));
+    __m128i novas = _mm_andnot_si128(_mm_cmpeq_epi8(topos, zero), _mm_add_epi8(topos, _mm_set1_epi8((char)y)));
+    __m128i h = _mm_and_si128(_mm_max_epu8(alturas, novas), colunas);
+
+    __m128i soma = _mm_sad_epu8(h, zero);
+    __m128i irr = _mm_sad_epu8(_mm_and_si128(h, pares), _mm_and_si128(_mm_srli_si128(h, 1), pares));
+    __m128i borda = _mm_or_si128(h, _mm_andnot_si128(colunas, uns));
+    __m128i viz = _mm_min_epu8(_mm_slli_si128(borda, 1), _mm_srli_si128(borda, 1));
+    __m128i pocos = _mm_sad_epu8(_mm_and_si128(_mm_subs_epu8(viz, h), colunas), zero);
+    __m128i max = _mm_max_epu8(h, _mm_srli_si128(h, 8));
+    max = _mm_max_epu8(max, _mm_srli_si128(max, 4));
+    max = _mm_max_epu8(max, _mm_srli_si128(max, 2));
+    max = _mm_max_epu8(max, _mm_srli_si128(max, 1));
+
+    // As três somas (< 2^16) vão para faixas de 16 bits de um só inteiro.
+    __m128i totais = _mm_or_si128(soma, _mm_or_si128(_mm_slli_epi64(irr, 16), _mm_slli_epi64(pocos, 32)));
+    uint64_t t64 = (uint64_t)_mm_cvtsi128_si64(_mm_add_epi64(totais, _mm_unpackhi_epi64(totais, totais)));
+    int nova_soma = (int)(t64 & 0xFFFF);
+    car->linhas = 0;
+    car->soma_alturas = nova_soma;
+    car->altura_max = _mm_cvtsi128_si32(max) & 0xFF;
+    car->buracos = buracos_base + nova_soma;
+    car->irregularidade = (int)(t64 >> 16 & 0xFFFF);
+    car->pocos = (int)(t64 >> 32 & 0xFFFF);
+    return 1;
+}
+#endif
+
+// Caminho geral de superficieAvaliar: numa cópia da superfície, com a
+// remoção das linhas completas.
+static __attribute__((noinline)) int avaliarCopiando(const Tabuleiro *t, const Superficie *s, int tipo, int rot,
+                                                     int x, int y, Caracteristicas *car) {
+    const FormaPeca *f = &FORMAS[tipo][rot];
+    const uint16_t *linhas = &t->linhas[TABULEIRO_BORDA + y];
+    int desloc = x + TABULEIRO_PAREDE;
+    uint32_t cheias = 0;
+    for (int r = f->y_min; r <= f->y_max; r++) {
+        uint16_t l = (uint16_t)(linhas[r] | f->linhas[r] << desloc);
+        cheias |= (uint32_t)(l == LINHA_CHEIA) << (y + r);
+    }
+    Superficie depois = *s;
+    superficieFixar(&depois, tipo, rot, x, y);
+    if (cheias) {
+        superficieRemoverLinhas(&depois, cheias);
+    }
+    car->linhas = __builtin_popcount(cheias);
+    car->soma_alturas = depois.soma_alturas;
+    car->altura_max = depois.altura_max;
+    car->buracos = depois.buracos;
+    car->irregularidade = depois.irregularidade;
+    car->pocos = depois.pocos;
+    return car->linhas;
+}
+
+/**
+ * @brief Características do tabuleiro depois de colocar a peça em (x, y).
+ *
+ * Não altera nada: testa só as linhas que a peça ocupa e trabalha numa
+ * cópia da superfície, então o custo é O(células da peça) quando a
+ * jogada não completa linhas. Em x86-64 esse caso comum sai só das
+ * alturas (avaliarSemLinhas) e é expandido no laço de quem chama.
+ *
+ * @return Número de linhas que a jogada completaria.
+ */
+static inline int superficieAvaliar(const Tabuleiro *t, const Superficie *s, int tipo, int rot, int x, int y,
+                                    Caracteristicas *car) {
+#if defined(__GNUC__) && defined(__x86_64__)
+    if (avaliarSemLinhas(t, alturasSse(s), toposSse(tipo, rot, x), s->buracos - s->soma_alturas - 4, tipo, rot, x,
+                         y, car)) {
+        return 0;
+    }
+#endif
+    return avaliarCopiando(t, s, tipo, rot, x, y, car);
+}
+
+// --- COLOCAÇÕES E AVALIAÇÃO EM LOTE ---
+
+#define MAX_COLOCACOES 48
+
+// Rotações que geram colocações diferentes: O tem uma só, e em I, S e Z
+// as rotações 2 e 3 repetem as células de 0 e 1 deslocadas.
+static const uint8_t ROTACOES_DISTINTAS[NUM_TIPOS] = {2, 1, 4, 4, 2, 2, 4};
+
+/**
+ * @brief Posição final de uma peça (caixa SRS em (x, y)).
+ */
+typedef struct {
+    int8_t rot, x, y;
+} Colocacao;
+
+/**
+ * @brief yDeQueda pelas alturas das colunas, em O(colunas da peça).
+ *
+ * A peça para onde a célula mais baixa de alguma coluna encosta no topo
+ * dela. Só vale se nada ocupado estiver acima da peça em (x, y); quando
+ * o resultado passa de y a peça está sob uma saliência, e a queda é
+ * feita linha a linha.
+ */
+static inline int yDeQuedaSuperficie(const Tabuleiro *t, const Superficie *s, int tipo, int rot, int x, int y) {
+    const FormaPeca *f = &FORMAS[tipo][rot];
+    const uint8_t *forma = COLUNAS_FORMA[tipo][rot];
+    int queda = -TABULEIRO_BORDA;
+    for (int c = f->x_min; c <= f->x_max; c++) {
+        int apoio = s->alturas[x + c] - __builtin_ctz(forma[c]);
+        queda = apoio > queda ? apoio : queda;
+    }
+    return queda <= y ? queda : yDeQueda(t, tipo, rot, x, y);
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// yDeQuedaSuperficie para todos os x de uma rotação: o byte x + 2 de
+// 'quedas' recebe o máximo, nas colunas c da peça, de altura[x + c] menos
+// a célula mais baixa da coluna c. Com as alturas de alturasSse (coluna
+// no byte c + 2), a coluna c da peça é a deslocada de c bytes; o
+// TABULEIRO_BORDA somado mantém as diferenças positivas.
+static inline void quedasSse(__m128i alturas, int tipo, int rot, int8_t *quedas) {
+    const uint8_t *forma = COLUNAS_FORMA[tipo][rot];
+    __m128i a = _mm_add_epi8(alturas, _mm_set1_epi8(TABULEIRO_BORDA));
+    __m128i q = _mm_setzero_si128();
+    if (forma[0]) {
+        q = _mm_max_epu8(q, _mm_sub_epi8(a, _mm_set1_epi8((char)__builtin_ctz(forma[0]))));
+    }
+    if (forma[1]) {
+        q = _mm_max_epu8(q, _mm_sub_epi8(_mm_srli_si128(a, 1), _mm_set1_epi8((char)__builtin_ctz(forma[1]))));
+    }
+    if (forma[2]) {
+        q = _mm_max_epu8(q, _mm_sub_epi8(_mm_srli_si128(a, 2), _mm_set1_epi8((char)__builtin_ctz(forma[2]))));
+    }
+    if (forma[3]) {
+        q = _mm_max_epu8(q, _mm_sub_epi8(_mm_srli_si128(a, 3), _mm_set1_epi8((char)__builtin_ctz(forma[3]))));
+    }
+    _mm_storeu_si128((__m128i *)quedas, _mm_sub_epi8(q, _mm_set1_epi8(TABULEIRO_BORDA)));
+}
+#endif
+
+/**
+ * @brief Enumera as colocações alcançáveis por queda livre.
+ *
+ * A peça surge em (SURGIMENTO_X, SURGIMENTO_Y), gira com SRS até cada
+ * rotação distinta, desliza para os dois lados enquanto couber e cai
+ * em cada coluna. Não inclui encaixes que exigem descer e deslizar.
+ * Com a superfície 's' (pode ser NULL) a queda usa as alturas.
+ *
+ * @return Número de colocações (0 se a peça nem surge).
+ */
+int enumerarColocacoes(const Tabuleiro *t, const Superficie *s, int tipo, Colocacao *saida) {
+    int n = 0;
+    if (colide(t, tipo, 0, SURGIMENTO_X, SURGIMENTO_Y)) {
+        return 0;
+    }
+    // Com tudo abaixo da linha SURGIMENTO_Y - 2 (o chute mais baixo), giros
+    // e deslizes só esbarram nas paredes, e nenhuma peça para acima de
+    // altura_max: a queda pelas alturas já é a final.
+    if (s && s->altura_max <= SURGIMENTO_Y - 2) {
+#if defined(__GNUC__) && defined(__x86_64__)
+        __m128i alturas = alturasSse(s);
+        int8_t quedas[16];
+#endif
+        for (int rot = 0; rot < ROTACOES_DISTINTAS[tipo]; rot++) {
+            const FormaPeca *f = &FORMAS[tipo][rot];
+#if defined(__GNUC__) && defined(__x86_64__)
+            quedasSse(alturas, tipo, rot, quedas);
+#endif
+            for (int px = -f->x_min; px + f->x_max < TABULEIRO_LARGURA; px++) {
+                saida[n].rot = (int8_t)rot;
+                saida[n].x = (int8_t)px;
+#if defined(__GNUC__) && defined(__x86_64__)
+                saida[n].y = quedas[px + 2];
+#else
+                saida[n].y = (int8_t)yDeQuedaSuperficie(t, s, tipo, rot, px, SURGIMENTO_Y);
+#endif
+                n++;
+            }
+        }
+        return n;
+    }
+    for (int alvo = 0; alvo < ROTACOES_DISTINTAS[tipo]; alvo++) {
+        int rot = 0, x = SURGIMENTO_X, y = SURGIMENTO_Y;
+        // 3 é um giro anti-horário; 1 e 2, um ou dois horários
+        int ok = 1;
+        if (alvo == 3) {
+            ok = rotacionarSRS(t, tipo, &rot, &x, &y, 1) >= 0;
+        } else {
+            for (int g = 0; g < alvo && ok; g++) {
+                ok = rotacionarSRS(t, tipo, &rot, &x, &y, 0) >= 0;
+            }
+        }
+        if (!ok) {
+            continue;
+        }
+        int esq = x, dir = x;
+        while (esq - 1 >= -FORMAS[tipo][rot].x_min && !colide(t, tipo, rot, esq - 1, y)) {
+            esq--;
+        }
+        while (!colide(t, tipo, rot, dir + 1, y)) {
+            dir++;
+        }
+        for (int px = esq; px <= dir; px++) {
+            saida[n].rot = (int8_t)rot;
+            saida[n].x = (int8_t)px;
+            saida[n].y = (int8_t)(s ? yDeQuedaSuperficie(t, s, tipo, rot, px, y) : yDeQueda(t, tipo, rot, px, y));
+            n++;
+        }
+    }
+    return n;
+}
+
+enum {
+    CAR_LINHAS,
+    CAR_SOMA_ALTURAS,
+    CAR_ALTURA_MAX,
+    CAR_BURACOS,
+    CAR_IRREGULARIDADE,
+    CAR_POCOS,
+    NUM_CARACTERISTICAS
+};
+
+// Pesos lineares por característica (ordem do enum acima).
+static const float PESOS_PADRAO[NUM_CARACTERISTICAS] = {0.76f, -0.51f, -0.05f, -0.36f, -0.18f, -0.10f};
+
+/**
+ * @brief Nota linear de um candidato, avaliado sozinho.
+ */
+static inline float avaliarLinear(const Caracteristicas *c, const float *pesos) {
+    float nota = (float)c->linhas * pesos[CAR_LINHAS];
+    nota += (float)c->soma_alturas * pesos[CAR_SOMA_ALTURAS];
+    nota += (float)c->altura_max * pesos[CAR_ALTURA_MAX];
+    nota += (float)c->buracos * pesos[CAR_BURACOS];
+    nota += (float)c->irregularidade * pesos[CAR_IRREGULARIDADE];
+    nota += (float)c->pocos * pesos[CAR_POCOS];
+    return nota;
+}
+
+/**
+ * @brief Lote de candidatos em colunas (uma por característica).
+ *
+ * As colunas ficam num só bloco alinhado a 32 bytes, com a capacidade
+ * arredondada para múltiplo de 8, para serem lidas 8 candidatos por vez.
+ */
+typedef struct {
+    int n;
+    int capacidade;
+    int32_t *car[NUM_CARACTERISTICAS];
+} LoteCandidatos;
+
+int loteCriar(LoteCandidatos *l, int capacidade) {
+    capacidade = (capacidade + 7) & ~7;
+    int32_t *bloco = aligned_alloc(32, sizeof(int32_t) * NUM_CARACTERISTICAS * (size_t)capacidade);
+    if (!bloco) {
+        return -1;
+    }
+    // zerado para que o bloco final incompleto seja lido sem lixo
+    memset(bloco, 0, sizeof(int32_t) * NUM_CARACTERISTICAS * (size_t)capacidade);
+    for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+        l->car[k] = bloco + (size_t)k * capacidade;
+    }
+    l->n = 0;
+    l->capacidade = capacidade;
+    return 0;
+}
+
+void loteLiberar(LoteCandidatos *l) {
+    free(l->car[0]);
+    l->car[0] = NULL;
+}
+
+static inline void loteAnexar(LoteCandidatos *l, const Caracteristicas *c) {
+    int i = l->n++;
+    l->car[CAR_LINHAS][i] = c->linhas;
+    l->car[CAR_SOMA_ALTURAS][i] = c->soma_alturas;
+    l->car[CAR_ALTURA_MAX][i] = c->altura_max;
+    l->car[CAR_BURACOS][i] = c->buracos;
+    l->car[CAR_IRREGULARIDADE][i] = c->irregularidade;
+    l->car[CAR_POCOS][i] = c->pocos;
+}
+
+// Mesma conta de avaliarLinear, na mesma ordem, sobre uma linha do lote.
+static inline float notaLote(const LoteCandidatos *l, const float *pesos, int i) {
+    float nota = (float)l->car[0][i] * pesos[0];
+    for (int k = 1; k < NUM_CARACTERISTICAS; k++) {
+        nota += (float)l->car[k][i] * pesos[k];
+    }
+    return nota;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+__attribute__((target("avx2")))
+static inline __m256 notaLoteAvx2(const LoteCandidatos *l, const __m256 *w, int i) {
+    __m256 nota = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_load_si256((const __m256i *)(l->car[0] + i))), w[0]);
+    for (int k = 1; k < NUM_CARACTERISTICAS; k++) {
+        __m256 f = _mm256_cvtepi32_ps(_mm256_load_si256((const __m256i *)(l->car[k] + i)));
+        nota = _mm256_add_ps(nota, _mm256_mul_ps(f, w[k]));
+    }
+    return nota;
+}
+
+__attribute__((target("avx2")))
+static int loteNotasAvx2(const LoteCandidatos *l, const float *pesos, float *notas) {
+    __m256 w[NUM_CARACTERISTICAS];
+    for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+        w[k] = _mm256_set1_ps(pesos[k]);
+    }
+    int i = 0;
+    for (; i + 8 <= l->n; i += 8) {
+        _mm256_storeu_ps(notas + i, notaLoteAvx2(l, w, i));
+    }
+    return i;
+}
+
+// Máximo por faixa com o índice de quem o atingiu primeiro; a redução
+// final desempata pelo menor índice, como a versão escalar. O último
+// bloco incompleto também é lido inteiro (a capacidade é múltipla de 8)
+// e as faixas além de n são descartadas pela máscara.
+__attribute__((target("avx2")))
+static int loteMelhorAvx2(const LoteCandidatos *l, const float *pesos, float *melhor) {
+    __m256 w[NUM_CARACTERISTICAS];
+    for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+        w[k] = _mm256_set1_ps(pesos[k]);
+    }
+    const __m256 piso = _mm256_set1_ps(-FLT_MAX);
+    const __m256i oito = _mm256_set1_epi32(8);
+    const __m256i n = _mm256_set1_epi32(l->n);
+    __m256 vmax = piso;
+    __m256i vidx = _mm256_set1_epi32(-1);
+    __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (int i = 0; i < l->n; i += 8) {
+        __m256 valido = _mm256_castsi256_ps(_mm256_cmpgt_epi32(n, idx));
+        __m256 nota = _mm256_blendv_ps(piso, notaLoteAvx2(l, w, i), valido);
+        __m256 maior = _mm256_and_ps(_mm256_cmp_ps(nota, vmax, _CMP_GT_OQ), valido);
+        vmax = _mm256_blendv_ps(vmax, nota, maior);
+        vidx = _mm256_blendv_epi8(vidx, idx, _mm256_castps_si256(maior));
+        idx = _mm256_add_epi32(idx, oito);
+    }
+    float m[8];
+    int32_t id[8];
+    _mm256_storeu_ps(m, vmax);
+    _mm256_storeu_si256((__m256i *)id, vidx);
+    int melhor_i = -1;
+    for (int j = 0; j < 8; j++) {
+        if (id[j] >= 0 && (melhor_i < 0 || m[j] > *melhor || (m[j] == *melhor && id[j] < melhor_i))) {
+            *melhor = m[j];
+            melhor_i = id[j];
+        }
+    }
+    return melhor_i;
+}
+#endif
+
+/**
+ * @brief Notas lineares de todos os candidatos do lote.
+ */
+void loteNotas(const LoteCandidatos *l, const float *pesos, float *notas) {
+    int i = 0;
+#if defined(__GNUC__) && defined(__x86_64__)
+    static int avx2 = -1;
+    if (avx2 < 0) {
+        avx2 = __builtin_cpu_supports("avx2");
+    }
+    if (avx2) {
+        i = loteNotasAvx2(l, pesos, notas);
+    }
+#endif
+    for (; i < l->n; i++) {
+        notas[i] = notaLote(l, pesos, i);
+    }
+}
+
+/**
+ * @brief Melhor candidato do lote pela nota linear.
+ *
+ * Empates ficam com o menor índice.
+ *
+ * @return Índice do melhor candidato, ou -1 se o lote estiver vazio.
+ */
+int loteMelhor(const LoteCandidatos *l, const float *pesos, float *nota) {
+    float melhor = -FLT_MAX;
+    int melhor_i = -1;
+#if defined(__GNUC__) && defined(__x86_64__)
+    static int avx2 = -1;
+    if (avx2 < 0) {
+        avx2 = __builtin_cpu_supports("avx2");
+    }
+    if (avx2) {
+        melhor_i = loteMelhorAvx2(l, pesos, &melhor);
+        if (nota) {
+            *nota = melhor;
+        }
+        return melhor_i;
+    }
+#endif
+    for (int i = 0; i < l->n; i++) {
+        float v = notaLote(l, pesos, i);
+        if (melhor_i < 0 || v > melhor) {
+            melhor = v;
+            melhor_i = i;
+        }
+    }
+    if (nota) {
+        *nota = melhor;
+    }
+    return melhor_i;
+}
+
+/**
+ * @brief Anexa ao lote as características de cada colocação da peça.
+ *
+ * As alturas da superfície entram no registrador uma vez para todas as
+ * colocações, e os topos de cada rotação vão para uma janela de bytes
+ * zerados em volta: o load na posição 14 - x já os traz deslocados.
+ */
+void loteColocacoes(LoteCandidatos *l, const Tabuleiro *t, const Superficie *s, int tipo,
+                    const Colocacao *colocacoes, int n) {
+#if defined(__GNUC__) && defined(__x86_64__)
+    __m128i alturas = alturasSse(s);
+    int buracos_base = s->buracos - s->soma_alturas - 4;
+    uint8_t janelas[NUM_ROTACOES][32] = {{0}};
+    for (int rot = 0; rot < NUM_ROTACOES; rot++) {
+        memcpy(&janelas[rot][16], &TOPOS_FORMA[tipo][rot], sizeof(uint32_t));
+    }
+#endif
+    for (int i = 0; i < n && l->n < l->capacidade; i++) {
+        const Colocacao *c = &colocacoes[i];
+        Caracteristicas car;
+#if defined(__GNUC__) && defined(__x86_64__)
+        __m128i topos = _mm_loadu_si128((const __m128i *)&janelas[c->rot][14 - c->x]);
+        if (!avaliarSemLinhas(t, alturas, topos, buracos_base, tipo, c->rot, c->x, c->y, &car))
+#endif
+        {
+            avaliarCopiando(t, s, tipo, c->rot, c->x, c->y, &car);
+        }
+        loteAnexar(l, &car);
+    }
+}
+
+
+// --- AVALIAÇÃO POR REDE NEURAL ---
+
+// MLP pequena que troca a avaliação linear: as NUM_CARACTERISTICAS
+// características do lote, divididas por ESCALA_ENTRADA e limitadas a
+// [0, 1], passam por duas camadas ocultas com ReLU limitada a [0, 1] e
+// uma saída linear. São 2689 parâmetros, gravados em float no arquivo.
+//
+// A versão quantizada usa as mesmas contas em inteiros: entradas e
+// ativações em [0, 127] (127 = 1,0), pesos das camadas ocultas em int8
+// com escala 2^desloc por camada e viés em int32 na escala do acumulador.
+// A saída volta a float com uma escala própria. Os kernels AVX2 avaliam
+// 8 candidatos por vez com os pesos em broadcast: em float, uma
+// multiplicação e uma soma por peso; em int8, vpmaddubsw + vpmaddwd somam
+// 4 entradas por faixa de uma vez.
+#define REDE_ENTRADAS 8 // NUM_CARACTERISTICAS completadas com zeros
+#define REDE_OCULTA1 64
+#define REDE_OCULTA2 32
+#define REDE_MAGICA "TSREDE"
+#define REDE_VERSAO 1
+
+enum {
+    REDE_FLOAT,
+    REDE_INT8
+};
+
+// Divisores das características (ordem do enum): o valor que vira 1,0.
+static const float ESCALA_ENTRADA[NUM_CARACTERISTICAS] = {4.0f, 160.0f, 20.0f, 40.0f, 64.0f, 40.0f};
+
+typedef struct {
+    char magica[8];
+    uint32_t versao;
+    uint32_t entradas;
+    uint32_t oculta1;
+    uint32_t oculta2;
+    char reservado[16];
+} CabecalhoRede;
+
+typedef struct {
+    // modelo em float, como no arquivo
+    float w1[REDE_OCULTA1][REDE_ENTRADAS];
+    float b1[REDE_OCULTA1];
+    float w2[REDE_OCULTA2][REDE_OCULTA1];
+    float b2[REDE_OCULTA2];
+    float w3[REDE_OCULTA2];
+    float b3;
+    // versão quantizada (redeQuantizar)
+    int8_t q1[REDE_OCULTA1][REDE_ENTRADAS];
+    int8_t q2[REDE_OCULTA2][REDE_OCULTA1];
+    int8_t q3[REDE_OCULTA2];
+    int32_t qb1[REDE_OCULTA1];
+    int32_t qb2[REDE_OCULTA2];
+    int desloc1, desloc2;
+    float escala3;                              // acumulador da saída -> float
+    int32_t mult_entrada[NUM_CARACTERISTICAS];  // entrada = (f * mult + 2^15) >> 16
+} RedeAvaliacao;
+
+// Sorteio uniforme em [0, 1) a partir do estado x.
+static inline float sortearUniforme(uint64_t *x) {
+    *x = misturar64(*x + PASSO_GERADOR);
+    return (float)(*x >> 40) * (1.0f / (float)(1 << 24));
+}
+
+static inline int32_t arredondar(float v) {
+    return (int32_t)(v + (v >= 0 ? 0.5f : -0.5f));
+}
+
+static inline int8_t quantizarPeso(float v) {
+    int32_t q = arredondar(v);
+    return (int8_t)(q > 127 ? 127 : q < -127 ? -127 : q);
+}
+
+// Maior s em [0, 14] com max|w| * 2^s <= 127.
+static int deslocamentoCamada(const float *w, int n) {
+    float maximo = 0;
+    for (int i = 0; i < n; i++) {
+        float a = w[i] < 0 ? -w[i] : w[i];
+        maximo = a > maximo ? a : maximo;
+    }
+    int s = 14;
+    while (s > 0 && maximo * (float)(1 << s) > 127.0f) {
+        s--;
+    }
+    return s;
+}
+
+/**
+ * @brief Gera a versão int8 a partir dos pesos em float.
+ *
+ * Pesos acima de 127 (impossíveis de representar com desloc 0) são
+ * saturados.
+ */
+void redeQuantizar(RedeAvaliacao *r) {
+    r->desloc1 = deslocamentoCamada(&r->w1[0][0], REDE_OCULTA1 * REDE_ENTRADAS);
+    r->desloc2 = deslocamentoCamada(&r->w2[0][0], REDE_OCULTA2 * REDE_OCULTA1);
+    float e1 = (float)(1 << r->desloc1), e2 = (float)(1 << r->desloc2);
+    for (int j = 0; j < REDE_OCULTA1; j++) {
+        for (int k = 0; k < REDE_ENTRADAS; k++) {
+            r->q1[j][k] = quantizarPeso(r->w1[j][k] * e1);
+        }
+        r->qb1[j] = arredondar(r->b1[j] * 127.0f * e1);
+    }
+    for (int m = 0; m < REDE_OCULTA2; m++) {
+        for (int j = 0; j < REDE_OCULTA1; j++) {
+            r->q2[m][j] = quantizarPeso(r->w2[m][j] * e2);
+        }
+        r->qb2[m] = arredondar(r->b2[m] * 127.0f * e2);
+    }
+    float maximo = 0;
+    for (int m = 0; m < REDE_OCULTA2; m++) {
+        float a = r->w3[m] < 0 ? -r->w3[m] : r->w3[m];
+        maximo = a > maximo ? a : maximo;
+    }
+    float e3 = maximo > 0 ? 127.0f / maximo : 1.0f;
+    for (int m = 0; m < REDE_OCULTA2; m++) {
+        r->q3[m] = quantizarPeso(r->w3[m] * e3);
+    }
+    r->escala3 = 1.0f / (127.0f * e3);
+    for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+        r->mult_entrada[k] = arredondar(127.0f * 65536.0f / ESCALA_ENTRADA[k]);
+    }
+}
+
+/**
+ * @brief Grava os pesos em float (cabeçalho + w1, b1, w2, b2, w3, b3).
+ *
+ * @return 0 em caso de sucesso, -1 em erro de escrita.
+ */
+int redeSalvar(const RedeAvaliacao *r, const char *caminho) {
+    FILE *arq = fopen(caminho, "wb");
+    if (!arq) {
+        return -1;
+    }
+    CabecalhoRede cab;
+    memset(&cab, 0, sizeof(cab));
+    memcpy(cab.magica, REDE_MAGICA, sizeof(REDE_MAGICA));
+    cab.versao = REDE_VERSAO;
+    cab.entradas = REDE_ENTRADAS;
+    cab.oculta1 = REDE_OCULTA1;
+    cab.oculta2 = REDE_OCULTA2;
+    int ok = fwrite(&cab, sizeof(cab), 1, arq) == 1
+          && fwrite(r->w1, sizeof(r->w1), 1, arq) == 1 && fwrite(r->b1, sizeof(r->b1), 1, arq) == 1
+          && fwrite(r->w2, sizeof(r->w2), 1, arq) == 1 && fwrite(r->b2, sizeof(r->b2), 1, arq) == 1
+          && fwrite(r->w3, sizeof(r->w3), 1, arq) == 1 && fwrite(&r->b3, sizeof(r->b3), 1, arq) == 1;
+    ok = fclose(arq) == 0 && ok;
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Lê os pesos de um arquivo e prepara a versão quantizada.
+ *
+ * @return 0 em caso de sucesso, -1 se o arquivo não existir ou for de
+ *         outra arquitetura.
+ */
+int redeCarregar(RedeAvaliacao *r, const char *caminho) {
+    FILE *arq = fopen(caminho, "rb");
+    if (!arq) {
+        return -1;
+    }
+    CabecalhoRede cab;
+    int ok = fread(&cab, sizeof(cab), 1, arq) == 1
+          && memcmp(cab.magica, REDE_MAGICA, sizeof(REDE_MAGICA)) == 0 && cab.versao == REDE_VERSAO
+          && cab.entradas == REDE_ENTRADAS && cab.oculta1 == REDE_OCULTA1 && cab.oculta2 == REDE_OCULTA2
+          && fread(r->w1, sizeof(r->w1), 1, arq) == 1 && fread(r->b1, sizeof(r->b1), 1, arq) == 1
+          && fread(r->w2, sizeof(r->w2), 1, arq) == 1 && fread(r->b2, sizeof(r->b2), 1, arq) == 1
+          && fread(r->w3, sizeof(r->w3), 1, arq) == 1 && fread(&r->b3, sizeof(r->b3), 1, arq) == 1
+          && fgetc(arq) == EOF;
+    fclose(arq);
+    if (!ok) {
+        return -1;
+    }
+    redeQuantizar(r);
+    return 0;
+}
+
+static inline float limitar01(float v) {
+    return v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
+}
+
+static inline int32_t limitar127(int32_t v) {
+    return v < 0 ? 0 : v > 127 ? 127 : v;
+}
+
+static inline int32_t descer(int32_t acc, int desloc) {
+    return desloc > 0 ? (acc + (1 << (desloc - 1))) >> desloc : acc;
+}
+
+// Referência escalar em float para o candidato i do lote.
+static float notaRedeFloat(const RedeAvaliacao *r, const LoteCandidatos *l, int i) {
+    float x[NUM_CARACTERISTICAS], h1[REDE_OCULTA1];
+    for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+        x[k] = limitar01((float)l->car[k][i] * (1.0f / ESCALA_ENTRADA[k]));
+    }
+    for (int j = 0; j < REDE_OCULTA1; j++) {
+        float acc = r->b1[j];
+        for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+            acc += r->w1[j][k] * x[k];
+        }
+        h1[j] = limitar01(acc);
+    }
+    float saida = r->b3;
+    for (int m = 0; m < REDE_OCULTA2; m++) {
+        float acc = r->b2[m];
+        for (int j = 0; j < REDE_OCULTA1; j++) {
+            acc += r->w2[m][j] * h1[j];
+        }
+        saida += r->w3[m] * limitar01(acc);
+    }
+    return saida;
+}
+
+// Referência escalar em inteiros; o kernel AVX2 dá exatamente o mesmo.
+static float notaRedeInt8(const RedeAvaliacao *r, const LoteCandidatos *l, int i) {
+    int32_t x[NUM_CARACTERISTICAS], h1[REDE_OCULTA1];
+    for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+        x[k] = limitar127((int32_t)(((int64_t)l->car[k][i] * r->mult_entrada[k] + 32768) >> 16));
+    }
+    for (int j = 0; j < REDE_OCULTA1; j++) {
+        int32_t acc = r->qb1[j];
+        for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+            acc += r->q1[j][k] * x[k];
+        }
+        h1[j] = limitar127(descer(acc, r->desloc1));
+    }
+    int32_t saida = 0;
+    for (int m = 0; m < REDE_OCULTA2; m++) {
+        int32_t acc = r->qb2[m];
+        for (int j = 0; j < REDE_OCULTA1; j++) {
+            acc += r->q2[m][j] * h1[j];
+        }
+        saida += r->q3[m] * limitar127(descer(acc, r->desloc2));
+    }
+    return (float)saida * r->escala3 + r->b3;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// Mesma ordem de operações de notaRedeFloat, 8 candidatos por vez. Sem
+// FMA (mul e add separados, só target("avx2")): o arredondamento de cada
+// produto é o mesmo do escalar e as notas saem iguais bit a bit.
+__attribute__((target("avx2")))
+static __m256 blocoRedeFloatAvx2(const RedeAvaliacao *r, const LoteCandidatos *l, int i) {
+    const __m256 zero = _mm256_setzero_ps(), um = _mm256_set1_ps(1.0f);
+    __m256 x[NUM_CARACTERISTICAS], h1[REDE_OCULTA1];
+    for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+        __m256 f = _mm256_cvtepi32_ps(_mm256_load_si256((const __m256i *)(l->car[k] + i)));
+        x[k] = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(f, _mm256_set1_ps(1.0f / ESCALA_ENTRADA[k])), zero), um);
+    }
+    for (int j = 0; j < REDE_OCULTA1; j++) {
+        __m256 acc = _mm256_set1_ps(r->b1[j]);
+        for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(r->w1[j][k]), x[k]));
+        }
+        h1[j] = _mm256_min_ps(_mm256_max_ps(acc, zero), um);
+    }
+    __m256 saida = _mm256_set1_ps(r->b3);
+    for (int m = 0; m < REDE_OCULTA2; m++) {
+        __m256 acc = _mm256_set1_ps(r->b2[m]);
+        for (int j = 0; j < REDE_OCULTA1; j++) {
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(r->w2[m][j]), h1[j]));
+        }
+        acc = _mm256_min_ps(_mm256_max_ps(acc, zero), um);
+        saida = _mm256_add_ps(saida, _mm256_mul_ps(_mm256_set1_ps(r->w3[m]), acc));
+    }
+    return saida;
+}
+
+// Quatro valores em [0, 127] por faixa viram os 4 bytes da faixa.
+__attribute__((target("avx2")))
+static inline __m256i intercalar4(__m256i a, __m256i b, __m256i c, __m256i d) {
+    return _mm256_or_si256(_mm256_or_si256(a, _mm256_slli_epi32(b, 8)),
+                           _mm256_or_si256(_mm256_slli_epi32(c, 16), _mm256_slli_epi32(d, 24)));
+}
+
+// Soma, em cada faixa, os 4 bytes de x vezes os 4 pesos int8 de w.
+__attribute__((target("avx2")))
+static inline __m256i produto4(__m256i x, const int8_t *w) {
+    int32_t p;
+    memcpy(&p, w, sizeof(p));
+    __m256i pares = _mm256_maddubs_epi16(x, _mm256_set1_epi32(p));
+    return _mm256_madd_epi16(pares, _mm256_set1_epi16(1));
+}
+
+// Acumulador -> ativação em [0, 127], como descer + limitar127.
+__attribute__((target("avx2")))
+static inline __m256i ativacaoInt8(__m256i acc, int desloc) {
+    if (desloc > 0) {
+        acc = _mm256_add_epi32(acc, _mm256_set1_epi32(1 << (desloc - 1)));
+        acc = _mm256_sra_epi32(acc, _mm_cvtsi32_si128(desloc));
+    }
+    return _mm256_min_epi32(_mm256_max_epi32(acc, _mm256_setzero_si256()), _mm256_set1_epi32(127));
+}
+
+__attribute__((target("avx2")))
+static __m256 blocoRedeInt8Avx2(const RedeAvaliacao *r, const LoteCandidatos *l, int i) {
+    __m256i x[REDE_ENTRADAS];
+    for (int k = 0; k < REDE_ENTRADAS; k++) {
+        if (k < NUM_CARACTERISTICAS) {
+            __m256i f = _mm256_load_si256((const __m256i *)(l->car[k] + i));
+            x[k] = ativacaoInt8(_mm256_mullo_epi32(f, _mm256_set1_epi32(r->mult_entrada[k])), 16);
+        } else {
+            x[k] = _mm256_setzero_si256();
+        }
+    }
+    __m256i g0 = intercalar4(x[0], x[1], x[2], x[3]);
+    __m256i g1 = intercalar4(x[4], x[5], x[6], x[7]);
+
+    __m256i h1[REDE_OCULTA1 / 4];
+    for (int j = 0; j < REDE_OCULTA1; j += 4) {
+        __m256i a[4];
+        for (int t = 0; t < 4; t++) {
+            __m256i acc = _mm256_set1_epi32(r->qb1[j + t]);
+            acc = _mm256_add_epi32(acc, produto4(g0, &r->q1[j + t][0]));
+            acc = _mm256_add_epi32(acc, produto4(g1, &r->q1[j + t][4]));
+            a[t] = ativacaoInt8(acc, r->desloc1);
+        }
+        h1[j / 4] = intercalar4(a[0], a[1], a[2], a[3]);
+    }
+    __m256i saida = _mm256_setzero_si256();
+    for (int m = 0; m < REDE_OCULTA2; m++) {
+        __m256i acc = _mm256_set1_epi32(r->qb2[m]);
+        for (int g = 0; g < REDE_OCULTA1 / 4; g++) {
+            acc = _mm256_add_epi32(acc, produto4(h1[g], &r->q2[m][4 * g]));
+        }
+        acc = ativacaoInt8(acc, r->desloc2);
+        saida = _mm256_add_epi32(saida, _mm256_mullo_epi32(acc, _mm256_set1_epi32(r->q3[m])));
+    }
+    return _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(saida), _mm256_set1_ps(r->escala3)),
+                         _mm256_set1_ps(r->b3));
+}
+
+// O último bloco incompleto é calculado inteiro (a capacidade do lote é
+// múltipla de 8) e só as faixas válidas são copiadas.
+__attribute__((target("avx2")))
+static void redeNotasAvx2(const RedeAvaliacao *r, const LoteCandidatos *l, int modo, float *notas) {
+    for (int i = 0; i < l->n; i += 8) {
+        __m256 v = modo == REDE_INT8 ? blocoRedeInt8Avx2(r, l, i) : blocoRedeFloatAvx2(r, l, i);
+        if (i + 8 <= l->n) {
+            _mm256_storeu_ps(notas + i, v);
+        } else {
+            float resto[8];
+            _mm256_storeu_ps(resto, v);
+            memcpy(notas + i, resto, sizeof(float) * (l->n - i));
+        }
+    }
+}
+#endif
+
+// Versão escalar de redeNotasLote, referência dos kernels.
+static void redeNotasEscalar(const RedeAvaliacao *r, const LoteCandidatos *l, int modo, float *notas) {
+    for (int i = 0; i < l->n; i++) {
+        notas[i] = modo == REDE_INT8 ? notaRedeInt8(r, l, i) : notaRedeFloat(r, l, i);
+    }
+}
+
+/**
+ * @brief Notas da rede para todos os candidatos do lote.
+ *
+ * @param modo REDE_FLOAT ou REDE_INT8.
+ */
+void redeNotasLote(const RedeAvaliacao *r, const LoteCandidatos *l, int modo, float *notas) {
+#if defined(__GNUC__) && defined(__x86_64__)
+    static int avx2 = -1;
+    if (avx2 < 0) {
+        avx2 = __builtin_cpu_supports("avx2");
+    }
+    if (avx2) {
+        redeNotasAvx2(r, l, modo, notas);
+        return;
+    }
+#endif
+    redeNotasEscalar(r, l, modo, notas);
+}
+
+/**
+ * @brief Monta uma rede que reproduz a avaliação linear.
+ *
+ * As 6 primeiras unidades de cada camada oculta copiam as entradas e a
+ * saída as pesa por pesos * ESCALA_ENTRADA, então, com 'ruido' 0, a nota
+ * é a linear enquanto as características ficam dentro das escalas. As
+ * demais unidades recebem pesos uniformes em [-ruido, ruido]: é um ponto
+ * de partida para treino externo e dá à inferência o custo da rede cheia.
+ */
+void redeDaAvaliacaoLinear(RedeAvaliacao *r, const float *pesos, uint64_t semente, float ruido) {
+    memset(r, 0, sizeof(*r));
+    uint64_t x = misturar64(semente ^ 0x2545F4914F6CDD1DULL);
+    for (int j = 0; j < REDE_OCULTA1; j++) {
+        for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+            r->w1[j][k] = j < NUM_CARACTERISTICAS ? (float)(j == k) : ruido * (2.0f * sortearUniforme(&x) - 1.0f);
+        }
+        r->b1[j] = j < NUM_CARACTERISTICAS ? 0.0f : ruido * (2.0f * sortearUniforme(&x) - 1.0f);
+    }
+    for (int m = 0; m < REDE_OCULTA2; m++) {
+        for (int j = 0; j < REDE_OCULTA1; j++) {
+            r->w2[m][j] = m < NUM_CARACTERISTICAS ? (float)(m == j) : ruido * (2.0f * sortearUniforme(&x) - 1.0f);
+        }
+        r->b2[m] = m < NUM_CARACTERISTICAS ? 0.0f : ruido * (2.0f * sortearUniforme(&x) - 1.0f);
+        r->w3[m] = m < NUM_CARACTERISTICAS ? pesos[m] * ESCALA_ENTRADA[m] : ruido * (2.0f * sortearUniforme(&x) - 1.0f);
+    }
+    redeQuantizar(r);
+}
+
+
+// --- BOT DE BUSCA EM FEIXE ---
+
+#define FEIXE_LARGURA_PADRAO 100
+#define NUM_MACROS 5
+#define MAX_FILHOS_POR_NO (NUM_MACROS * MAX_COLOCACOES)
+
+// Lances do bot: ações que só mexem em fila e pilha seguidas da ação que
+// põe uma peça no tabuleiro (1 = frente da fila, 3 = topo da pilha).
+// Reservar e usar a reserva na sequência equivale a jogar, então fica de fora.
+static const uint8_t MACROS_BOT[NUM_MACROS][2] = {
+    {ACAO_JOGAR, ACAO_SAIR},
+    {ACAO_USAR_RESERVA, ACAO_SAIR},
+    {ACAO_RESERVAR, ACAO_JOGAR},
+    {ACAO_TROCAR, ACAO_JOGAR},
+    {ACAO_TROCA_MULTIPLA, ACAO_JOGAR},
+};
+
+/**
+ * @brief Jogada escolhida pelo bot: as ações do menu e onde a peça cai.
+ */
+typedef struct {
+    uint8_t acoes[2];
+    uint8_t num_acoes;
+    uint8_t tipo;
+    Colocacao colocacao;
+} Lance;
+
+typedef struct {
+    Sessao sessao;
+    Tabuleiro tabuleiro;
+    Superficie superficie;
+    float acumulado; // peso das linhas feitas no caminho até aqui
+    float nota;
+    int raiz;        // lance da raiz de onde o nó descende
+    int duplicado;   // outro nó da camada tem o mesmo estado (busca paralela)
+} NoFeixe;
+
+typedef struct {
+    int pai;
+    uint32_t chave; // pai * MAX_FILHOS_POR_NO + posição entre os irmãos
+    uint8_t macro;
+    uint8_t tipo;
+    Colocacao colocacao;
+} FilhoFeixe;
+
+/**
+ * @brief Área de trabalho da busca, alocada uma vez e reusada por jogada.
+ */
+typedef struct {
+    int largura;
+    float pesos[NUM_CARACTERISTICAS];
+    NoFeixe *atual;
+    NoFeixe *proximo;
+    FilhoFeixe *filhos;
+    int *inicio_nos; // primeiro filho de cada nó no lote, mais o fim do último
+    LoteCandidatos lote;
+    float *notas;
+    int *ordem;
+    Lance *lances_raiz;
+    long avaliados; // filhos avaliados desde a criação
+    const RedeAvaliacao *rede; // se não for NULL, avalia com a rede no lugar dos pesos
+    int modo_rede;             // REDE_FLOAT ou REDE_INT8
+} BuscaFeixe;
+
+void buscaFeixeLiberar(BuscaFeixe *b) {
+    free(b->atual);
+    free(b->proximo);
+    free(b->filhos);
+    free(b->inicio_nos);
+    free(b->notas);
+    free(b->ordem);
+    free(b->lances_raiz);
+    loteLiberar(&b->lote);
+}
+
+int buscaFeixeCriar(BuscaFeixe *b, int largura, const float *pesos) {
+    memset(b, 0, sizeof(*b));
+    if (largura <= 0) {
+        return -1;
+    }
+    int capacidade = largura * MAX_FILHOS_POR_NO;
+    b->largura = largura;
+    memcpy(b->pesos, pesos ? pesos : PESOS_PADRAO, sizeof(b->pesos));
+    b->atual = malloc(sizeof(NoFeixe) * largura);
+    b->proximo = malloc(sizeof(NoFeixe) * largura);
+    b->filhos = malloc(sizeof(FilhoFeixe) * capacidade);
+    b->inicio_nos = malloc(sizeof(int) * (largura + 1));
+    b->notas = malloc(sizeof(float) * (capacidade + 8));
+    b->ordem = malloc(sizeof(int) * capacidade);
+    b->lances_raiz = malloc(sizeof(Lance) * largura);
+    if (loteCriar(&b->lote, capacidade) != 0 || !b->atual || !b->proximo || !b->filhos || !b->inicio_nos || !b->notas
+        || !b->ordem || !b->lances_raiz) {
+        buscaFeixeLiberar(b);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Aplica à sessão as ações de um lance.
+ *
+ * A busca só conhece as peças já vistas, com ID menor que 'limite': um
+ * lance que põe no tabuleiro ou leva para a pilha uma peça ainda não
+ * revelada é recusado.
+ *
+ * @return Tipo da peça posta no tabuleiro, ou -1 se o lance não vale.
+ */
+static int aplicarMacro(Sessao *s, int macro, int limite) {
+    const uint8_t *acoes = MACROS_BOT[macro];
+    int ultima = acoes[1] != ACAO_SAIR;
+    if (ultima && !aplicarAcaoSessao(s, acoes[0])) {
+        return -1;
+    }
+    int acao = acoes[ultima];
+    const Peca *peca;
+    if (acao == ACAO_JOGAR) {
+        if (filaVazia(&s->fila)) {
+            return -1;
+        }
+        peca = &s->fila.itens[s->fila.inicio];
+    } else {
+        if (pilhaVazia(&s->pilha)) {
+            return -1;
+        }
+        peca = &s->pilha.itens[s->pilha.topo];
+    }
+    int tipo = tipoDaLetra(peca->nome);
+    if (peca->id >= limite || !aplicarAcaoSessao(s, acao)) {
+        return -1;
+    }
+    for (int i = 0; i <= s->pilha.topo; i++) {
+        if (s->pilha.itens[i].id >= limite) {
+            return -1;
+        }
+    }
+    return tipo;
+}
+
+// Ordem total dos filhos: nota maior primeiro, empate pelo menor índice.
+// Sem desvios: nas partições o resultado é imprevisível.
+static inline int filhoMelhor(const float *notas, int a, int b) {
+    return (notas[a] > notas[b]) | ((notas[a] == notas[b]) & (a < b));
+}
+
+static inline void trocarIndices(int *v, int a, int b) {
+    int tmp = v[a];
+    v[a] = v[b];
+    v[b] = tmp;
+}
+
+// Deixa em ordem[0..k-1] os k melhores de ordem[0..m-1] (k < m), por
+// seleção rápida: cada partição põe antes do pivô (a mediana de três) os
+// que o vencem, sem desvios, e segue só pelo lado que contém a posição k.
+static void separarMelhores(const float *notas, int *ordem, int m, int k) {
+    int lo = 0, hi = m;
+    while (hi - lo > 1) {
+        int meio = lo + (hi - lo) / 2, ultimo = hi - 1;
+        if (filhoMelhor(notas, ordem[meio], ordem[lo])) {
+            trocarIndices(ordem, meio, lo);
+        }
+        if (filhoMelhor(notas, ordem[ultimo], ordem[meio])) {
+            trocarIndices(ordem, ultimo, meio);
+            if (filhoMelhor(notas, ordem[meio], ordem[lo])) {
+                trocarIndices(ordem, meio, lo);
+            }
+        }
+        trocarIndices(ordem, meio, ultimo);
+        int pivo = ordem[ultimo], pos = lo;
+        for (int i = lo; i < ultimo; i++) {
+            int e = ordem[i];
+            ordem[i] = ordem[pos];
+            ordem[pos] = e;
+            pos += filhoMelhor(notas, e, pivo);
+        }
+        trocarIndices(ordem, pos, ultimo);
+        if (pos == k || pos == k - 1) {
+            return;
+        }
+        if (pos < k) {
+            lo = pos + 1;
+        } else {
+            hi = pos;
+        }
+    }
+}
+
+#define SELECAO_PASSO 16 // um filho em cada 16 entra na amostra do limiar
+
+/**
+ * @brief Põe em ordem[0..k-1] os k melhores filhos (em ordem qualquer).
+ *
+ * Os escolhidos de uma amostra (um filho em SELECAO_PASSO, com folga)
+ * dão um limiar; uma passada sem desvios guarda só os filhos que o
+ * alcançam, e separarMelhores escolhe entre eles. Se a amostra enganar e
+ * sobrarem menos de k, a seleção percorre todos. Como a ordem é total, o
+ * conjunto escolhido não depende do caminho.
+ *
+ * @return Quantos foram escolhidos (min(n, k)).
+ */
+static int selecionarMelhores(const float *notas, int n, int k, int *ordem) {
+    if (n <= k) {
+        for (int i = 0; i < n; i++) {
+            ordem[i] = i;
+        }
+        return n;
+    }
+    int m = n / SELECAO_PASSO;
+    int r = 2 * k / SELECAO_PASSO + 4;
+    if (r < m) {
+        for (int j = 0; j < m; j++) {
+            ordem[j] = j * SELECAO_PASSO;
+        }
+        separarMelhores(notas, ordem, m, r);
+        // Os filhos com nota >= limiar formam um prefixo da ordem total:
+        // se forem pelo menos k, contêm os k melhores.
+        float limiar = notas[ordem[0]];
+        for (int j = 1; j < r; j++) {
+            limiar = notas[ordem[j]] < limiar ? notas[ordem[j]] : limiar;
+        }
+        int c = 0, i = 0;
+#if defined(__GNUC__) && defined(__x86_64__)
+        const __m128 l4 = _mm_set1_ps(limiar);
+        for (; i + 4 <= n; i += 4) {
+            for (int m = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(notas + i), l4)); m; m &= m - 1) {
+                ordem[c++] = i + __builtin_ctz((unsigned)m);
+            }
+        }
+#endif
+        for (; i < n; i++) {
+            ordem[c] = i;
+            c += notas[i] >= limiar;
+        }
+        if (c >= k) {
+            if (c > k) {
+                separarMelhores(notas, ordem, c, k);
+            }
+            return k;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        ordem[i] = i;
+    }
+    separarMelhores(notas, ordem, n, k);
+    return k;
+}
+
+// Soma à nota de cada filho o peso acumulado do pai. Os filhos de um nó
+// são contíguos no lote, de inicio_nos[i] a inicio_nos[i + 1].
+static void somarAcumulados(const NoFeixe *nos, const int *inicio_nos, int primeiro, int fim, float *notas) {
+    for (int i = primeiro; i < fim; i++) {
+        float acumulado = nos[i].acumulado;
+        for (int j = inicio_nos[i]; j < inicio_nos[i + 1]; j++) {
+            notas[j] += acumulado;
+        }
+    }
+}
+
+// Gera no lote os filhos de um nó. Lances que põem o mesmo tipo de peça
+// levam aos mesmos tabuleiros, então as colocações e características de
+// cada tipo são calculadas uma vez e copiadas para os demais lances.
+static void expandirNo(BuscaFeixe *b, const NoFeixe *no, int pai, int limite) {
+    int inicio[NUM_TIPOS], quantos[NUM_TIPOS];
+    for (int t = 0; t < NUM_TIPOS; t++) {
+        inicio[t] = -1;
+    }
+    LoteCandidatos *l = &b->lote;
+    int primeiro = l->n;
+    for (int m = 0; m < NUM_MACROS; m++) {
+        Sessao s = no->sessao;
+        int tipo = aplicarMacro(&s, m, limite);
+        if (tipo < 0) {
+            continue;
+        }
+        if (inicio[tipo] < 0) {
+            Colocacao col[MAX_COLOCACOES];
+            int n = enumerarColocacoes(&no->tabuleiro, &no->superficie, tipo, col);
+            inicio[tipo] = l->n;
+            quantos[tipo] = n;
+            for (int i = 0; i < n; i++) {
+                FilhoFeixe *f = &b->filhos[l->n + i];
+                f->pai = pai;
+                f->chave = (uint32_t)pai * MAX_FILHOS_POR_NO + (uint32_t)(l->n + i - primeiro);
+                f->macro = (uint8_t)m;
+                f->tipo = (uint8_t)tipo;
+                f->colocacao = col[i];
+            }
+            loteColocacoes(l, &no->tabuleiro, &no->superficie, tipo, col, n);
+            b->avaliados += n;
+            continue;
+        }
+        int origem = inicio[tipo], destino = l->n, n = quantos[tipo];
+        memcpy(&b->filhos[destino], &b->filhos[origem], sizeof(FilhoFeixe) * n);
+        for (int i = 0; i < n; i++) {
+            b->filhos[destino + i].chave = (uint32_t)pai * MAX_FILHOS_POR_NO + (uint32_t)(destino + i - primeiro);
+            b->filhos[destino + i].macro = (uint8_t)m;
+        }
+        for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+            memcpy(&l->car[k][destino], &l->car[k][origem], sizeof(l->car[k][0]) * n);
+        }
+        l->n += n;
+    }
+}
+
+// Monta o nó de um filho escolhido a partir do pai.
+static void materializarFilho(const NoFeixe *pai, const FilhoFeixe *f, float nota, float peso_linhas, int limite,
+                              NoFeixe *no) {
+    no->sessao = pai->sessao;
+    aplicarMacro(&no->sessao, f->macro, limite);
+    no->tabuleiro = pai->tabuleiro;
+    no->superficie = pai->superficie;
+    int linhas = colocarPecaSuperficie(&no->tabuleiro, &no->superficie, f->tipo, f->colocacao.rot,
+                                       f->colocacao.x, f->colocacao.y);
+    no->acumulado = pai->acumulado + (float)linhas * peso_linhas;
+    no->nota = nota;
+    no->raiz = pai->raiz;
+    no->duplicado = 0;
+}
+
+static void lanceDoFilho(const FilhoFeixe *f, Lance *lance) {
+    const uint8_t *acoes = MACROS_BOT[f->macro];
+    lance->num_acoes = acoes[1] != ACAO_SAIR ? 2 : 1;
+    lance->acoes[0] = acoes[0];
+    lance->acoes[1] = acoes[1];
+    lance->tipo = f->tipo;
+    lance->colocacao = f->colocacao;
+}
+
+/**
+ * @brief Escolhe a próxima jogada por busca em feixe.
+ *
+ * A raiz é uma fotografia da sessão (capturarQuadro/restaurarQuadro).
+ * Cada camada expande os nós do feixe por todos os lances e colocações,
+ * avalia os filhos em lote e guarda os 'largura' melhores; a busca
+ * segue enquanto houver peças já vistas para pôr (as FILA_MAX da fila e
+ * as da pilha). A nota de um nó é a avaliação do seu tabuleiro (linear
+ * ou, com 'rede', da rede neural) mais o peso das linhas feitas no
+ * caminho, e a jogada escolhida é o primeiro lance do melhor nó da
+ * camada mais funda.
+ *
+ * @return Profundidade alcançada, ou 0 se não há jogada possível.
+ */
+int buscarLance(BuscaFeixe *b, const Sessao *sessao, const Tabuleiro *t, const Superficie *s, Lance *lance) {
+    QuadroChave quadro;
+    capturarQuadro(sessao, 0, 0, &quadro);
+    NoFeixe *raiz = &b->atual[0];
+    restaurarQuadro(&quadro, &raiz->sessao);
+    raiz->tabuleiro = *t;
+    raiz->superficie = *s;
+    raiz->acumulado = 0;
+    raiz->nota = 0;
+    raiz->raiz = -1;
+    int limite = sessao->gerador.proximo_id;
+    int num_nos = 1, profundidade = 0;
+
+    for (;;) {
+        b->lote.n = 0;
+        for (int i = 0; i < num_nos; i++) {
+            b->inicio_nos[i] = b->lote.n;
+            expandirNo(b, &b->atual[i], i, limite);
+        }
+        b->inicio_nos[num_nos] = b->lote.n;
+        int n = b->lote.n;
+        if (n == 0) {
+            break;
+        }
+        if (b->rede) {
+            redeNotasLote(b->rede, &b->lote, b->modo_rede, b->notas);
+        } else {
+            loteNotas(&b->lote, b->pesos, b->notas);
+        }
+        somarAcumulados(b->atual, b->inicio_nos, 0, num_nos, b->notas);
+        int k = selecionarMelhores(b->notas, n, b->largura, b->ordem);
+        for (int j = 0; j < k; j++) {
+            int i = b->ordem[j];
+            const FilhoFeixe *f = &b->filhos[i];
+            materializarFilho(&b->atual[f->pai], f, b->notas[i], b->pesos[CAR_LINHAS], limite, &b->proximo[j]);
+            if (profundidade == 0) {
+                lanceDoFilho(f, &b->lances_raiz[j]);
+                b->proximo[j].raiz = j;
+            }
+        }
+        NoFeixe *tmp = b->atual;
+        b->atual = b->proximo;
+        b->proximo = tmp;
+        num_nos = k;
+        profundidade++;
+    }
+
+    if (profundidade == 0) {
+        return 0;
+    }
+    int melhor = 0;
+    for (int i = 1; i < num_nos; i++) {
+        if (b->atual[i].nota > b->atual[melhor].nota) {
+            melhor = i;
+        }
+    }
+    *lance = b->lances_raiz[b->atual[melhor].raiz];
+    return profundidade;
+}
+
+/**
+ * @brief Executa um lance na sessão e no tabuleiro.
+ *
+ * @return Linhas removidas, ou -1 se alguma ação foi recusada.
+ */
+int executarLance(Sessao *sessao, Tabuleiro *t, Superficie *s, const Lance *lance) {
+    for (int i = 0; i < lance->num_acoes; i++) {
+        if (!aplicarAcaoSessao(sessao, lance->acoes[i])) {
+            return -1;
+        }
+    }
+    const Colocacao *c = &lance->colocacao;
+    return colocarPecaSuperficie(t, s, lance->tipo, c->rot, c->x, c->y);
+}
+
+
+// --- BUSCA PARALELA COM TABELA DE TRANSPOSIÇÃO ---
+
+// Tabela de transposição sem travas, de tamanho fixo: cada entrada são
+// duas palavras, (chave ^ dados) e dados. Quem lê confere se a primeira
+// xor a segunda dá a chave; uma entrada rasgada por duas escritas
+// simultâneas não passa na conferência e conta como ausente.
+//
+// dados: nota ordenável (32 bits) | geração (8) | profundidade (8) |
+// posição do nó na camada (16).
+#define TT_BITS_PADRAO 16
+
+typedef struct {
+    _Atomic uint64_t *palavras;
+    uint64_t mascara;
+} TabelaTransposicao;
+
+int ttCriar(TabelaTransposicao *tt, int bits) {
+    tt->palavras = calloc((size_t)2 << bits, sizeof(uint64_t));
+    tt->mascara = ((uint64_t)1 << bits) - 1;
+    return tt->palavras ? 0 : -1;
+}
+
+void ttLiberar(TabelaTransposicao *tt) {
+    free(tt->palavras);
+    tt->palavras = NULL;
+}
+
+static inline int ttSondar(const TabelaTransposicao *tt, uint64_t chave, uint64_t *dados) {
+    _Atomic uint64_t *e = &tt->palavras[2 * (chave & tt->mascara)];
+    uint64_t x = atomic_load_explicit(&e[0], memory_order_relaxed);
+    uint64_t d = atomic_load_explicit(&e[1], memory_order_relaxed);
+    if ((x ^ d) != chave) {
+        return 0;
+    }
+    *dados = d;
+    return 1;
+}
+
+static inline void ttGravar(TabelaTransposicao *tt, uint64_t chave, uint64_t dados) {
+    _Atomic uint64_t *e = &tt->palavras[2 * (chave & tt->mascara)];
+    atomic_store_explicit(&e[0], chave ^ dados, memory_order_relaxed);
+    atomic_store_explicit(&e[1], dados, memory_order_relaxed);
+}
+
+// Float -> uint32_t que preserva a ordem (positivos acima dos negativos).
+static inline uint32_t notaOrdenavel(float nota) {
+    uint32_t u;
+    memcpy(&u, &nota, sizeof(u));
+    return (u & 0x80000000u) ? ~u : u | 0x80000000u;
+}
+
+static inline uint64_t dadosTransposicao(float nota, int geracao, int profundidade, int posicao) {
+    return (uint64_t)notaOrdenavel(nota) << 32 | (uint64_t)(geracao & 0xFF) << 24
+         | (uint64_t)(profundidade & 0xFF) << 16 | (uint64_t)(posicao & 0xFFFF);
+}
+
+// Mesma camada (geração e profundidade iguais) e nó melhor: nota maior
+// ou, empatada, posição menor.
+static inline int dadosMelhores(uint64_t a, uint64_t b) {
+    if ((a & 0xFFFF0000u) != (b & 0xFFFF0000u)) {
+        return 0;
+    }
+    return (a >> 32) > (b >> 32) || ((a >> 32) == (b >> 32) && (a & 0xFFFF) < (b & 0xFFFF));
+}
+
+// Tipos visíveis da fila (frente -> fim) e da pilha (base -> topo), 3 bits
+// cada; peças não reveladas valem NUM_TIPOS. Com 'espelhar', L <-> J e S <-> Z.
+static uint64_t tiposVisiveis(const Sessao *s, int limite, int espelhar) {
+    uint64_t tipos = 0;
+    int idx = s->fila.inicio;
+    for (int i = 0; i < s->fila.total; i++) {
+        const Peca *p = &s->fila.itens[idx];
+        int tipo = p->id < limite ? tipoDaLetra(p->nome) : NUM_TIPOS;
+        tipos = tipos << 3 | (uint64_t)(espelhar && tipo < NUM_TIPOS ? ESPELHO_TIPO[tipo] : tipo);
+        idx = (idx + 1) % FILA_MAX;
+    }
+    for (int i = 0; i <= s->pilha.topo; i++) {
+        int tipo = tipoDaLetra(s->pilha.itens[i].nome);
+        tipos = tipos << 3 | (uint64_t)(espelhar ? ESPELHO_TIPO[tipo] : tipo);
+    }
+    return tipos;
+}
+
+static uint64_t hashNoOrientado(const NoFeixe *no, const Tabuleiro *t, int limite, int espelhar) {
+    const Sessao *s = &no->sessao;
+    uint64_t h = misturar64((uint64_t)s->gerador.proximo_id << 16 | (uint64_t)s->fila.total << 8
+                            | (uint64_t)(s->pilha.topo + 1));
+    for (size_t i = 0; i < sizeof(Tabuleiro); i += sizeof(uint64_t)) {
+        uint64_t palavra;
+        memcpy(&palavra, (const char *)t + i, sizeof(palavra));
+        h = misturar64(h ^ palavra);
+    }
+    return misturar64(h ^ (tiposVisiveis(s, limite, espelhar) + PASSO_GERADOR));
+}
+
+/**
+ * @brief Hash do estado de um nó: tabuleiro, fila e pilha.
+ *
+ * Só entram os tipos das peças já vistas; as outras contam como "não
+ * revelada", então dois caminhos que chegam ao mesmo estado com as
+ * mesmas peças têm o mesmo hash. O hash é o menor entre o do estado e o
+ * do seu espelho (tabuleiro espelhado, L <-> J, S <-> Z): as
+ * características e as colocações por queda livre são simétricas, então
+ * um nó espelhado também conta como duplicado. Só os giros com chute
+ * perto do topo (o surgimento fica fora do centro) quebram a simetria.
+ */
+static uint64_t hashNoFeixe(const NoFeixe *no, int limite) {
+    Tabuleiro espelho = no->tabuleiro;
+    espelharTabuleiro(&espelho);
+    uint64_t h = hashNoOrientado(no, &no->tabuleiro, limite, 0);
+    uint64_t e = hashNoOrientado(no, &espelho, limite, 1);
+    return h < e ? h : e;
+}
+
+typedef struct {
+    float nota;
+    uint32_t chave;
+    int thread;
+    int indice;
+} EscolhidoFeixe;
+
+/**
+ * @brief Busca em feixe repartida entre threads.
+ *
+ * Todas as threads percorrem as camadas em passo: cada uma expande uma
+ * faixa contígua dos nós e escolhe os seus 'largura' melhores filhos; a
+ * thread 0 junta as listas e as ordena por (nota, chave), e cada thread
+ * monta uma faixa dos escolhidos e os grava na tabela de transposição.
+ * Depois de uma barreira, um nó cujo estado tem na tabela um dono melhor
+ * da mesma camada é um duplicado e não é expandido. A ordem por chave
+ * (posição do pai e do filho) não depende do número de threads; só as
+ * corridas na tabela, que no pior caso deixam passar um duplicado.
+ */
+typedef struct {
+    int num_threads;
+    int largura;
+    float pesos[NUM_CARACTERISTICAS];
+    BuscaFeixe *trabalho;   // lote, filhos, notas e ordem de cada thread
+    int num_trabalhos;
+    int *escolhidos_thread; // quantos filhos cada thread propôs
+    EscolhidoFeixe *candidatos;
+    EscolhidoFeixe *escolhidos;
+    NoFeixe *atual;
+    NoFeixe *proximo;
+    Lance *lances_raiz;
+    TabelaTransposicao tt;
+    pthread_t *threads;
+    struct ThreadBusca *contextos;
+    int criadas;
+    pthread_barrier_t barreira;
+    pthread_mutex_t trava;
+    pthread_cond_t liberada;
+    int pronta;
+    atomic_int sair;
+    // estado da busca em andamento (escrito pela thread 0 entre barreiras)
+    int limite;
+    int geracao;
+    int num_nos;
+    int num_escolhidos;
+    int profundidade;
+    long duplicados;
+} BuscaParalela;
+
+static int compararEscolhidos(const void *a, const void *b) {
+    const EscolhidoFeixe *x = a, *y = b;
+    if (x->nota != y->nota) {
+        return x->nota > y->nota ? -1 : 1;
+    }
+    return x->chave < y->chave ? -1 : x->chave > y->chave;
+}
+
+static inline void faixaDaThread(int n, int num_threads, int id, int *inicio, int *fim) {
+    int por = (n + num_threads - 1) / num_threads;
+    *inicio = id * por < n ? id * por : n;
+    *fim = *inicio + por < n ? *inicio + por : n;
+}
+
+// Camadas da busca, executadas por todas as threads em passo.
+static void camadasParalelas(BuscaParalela *b, int id) {
+    BuscaFeixe *w = &b->trabalho[id];
+    for (;;) {
+        int inicio, fim;
+        faixaDaThread(b->num_nos, b->num_threads, id, &inicio, &fim);
+        w->lote.n = 0;
+        for (int i = inicio; i < fim; i++) {
+            w->inicio_nos[i] = w->lote.n;
+            if (!b->atual[i].duplicado) {
+                expandirNo(w, &b->atual[i], i, b->limite);
+            }
+        }
+        w->inicio_nos[fim] = w->lote.n;
+        loteNotas(&w->lote, b->pesos, w->notas);
+        somarAcumulados(b->atual, w->inicio_nos, inicio, fim, w->notas);
+        b->escolhidos_thread[id] = selecionarMelhores(w->notas, w->lote.n, b->largura, w->ordem);
+        pthread_barrier_wait(&b->barreira);
+
+        if (id == 0) {
+            int n = 0;
+            for (int t = 0; t < b->num_threads; t++) {
+                for (int j = 0; j < b->escolhidos_thread[t]; j++) {
+                    int i = b->trabalho[t].ordem[j];
+                    EscolhidoFeixe *e = &b->candidatos[n++];
+                    e->nota = b->trabalho[t].notas[i];
+                    e->chave = b->trabalho[t].filhos[i].chave;
+                    e->thread = t;
+                    e->indice = i;
+                }
+            }
+            qsort(b->candidatos, n, sizeof(EscolhidoFeixe), compararEscolhidos);
+            b->num_escolhidos = n < b->largura ? n : b->largura;
+            memcpy(b->escolhidos, b->candidatos, sizeof(EscolhidoFeixe) * b->num_escolhidos);
+        }
+        pthread_barrier_wait(&b->barreira);
+        if (b->num_escolhidos == 0) {
+            return;
+        }
+
+        faixaDaThread(b->num_escolhidos, b->num_threads, id, &inicio, &fim);
+        for (int j = inicio; j < fim; j++) {
+            const EscolhidoFeixe *e = &b->escolhidos[j];
+            const FilhoFeixe *f = &b->trabalho[e->thread].filhos[e->indice];
+            NoFeixe *no = &b->proximo[j];
+            materializarFilho(&b->atual[f->pai], f, e->nota, b->pesos[CAR_LINHAS], b->limite, no);
+            if (b->profundidade == 0) {
+                lanceDoFilho(f, &b->lances_raiz[j]);
+                no->raiz = j;
+            }
+            // preferência por profundidade: só não substitui um dono
+            // melhor da mesma camada
+            uint64_t chave = hashNoFeixe(no, b->limite), antigo;
+            uint64_t dados = dadosTransposicao(no->nota, b->geracao, b->profundidade, j);
+            if (!ttSondar(&b->tt, chave, &antigo) || !dadosMelhores(antigo, dados)) {
+                ttGravar(&b->tt, chave, dados);
+            }
+        }
+        pthread_barrier_wait(&b->barreira);
+
+        long duplicados = 0;
+        for (int j = inicio; j < fim; j++) {
+            NoFeixe *no = &b->proximo[j];
+            uint64_t dados = dadosTransposicao(no->nota, b->geracao, b->profundidade, j), dono;
+            no->duplicado = ttSondar(&b->tt, hashNoFeixe(no, b->limite), &dono) && dadosMelhores(dono, dados);
+            duplicados += no->duplicado;
+        }
+        __atomic_fetch_add(&b->duplicados, duplicados, __ATOMIC_RELAXED);
+        pthread_barrier_wait(&b->barreira);
+
+        if (id == 0) {
+            NoFeixe *tmp = b->atual;
+            b->atual = b->proximo;
+            b->proximo = tmp;
+            b->num_nos = b->num_escolhidos;
+            b->profundidade++;
+        }
+        pthread_barrier_wait(&b->barreira);
+    }
+}
+
+typedef struct ThreadBusca {
+    BuscaParalela *busca;
+    int id;
+} ThreadBusca;
+
+static void *threadBuscaParalela(void *arg) {
+    ThreadBusca *c = arg;
+    BuscaParalela *b = c->busca;
+    // espera buscaParalelaCriar fixar quantas threads participam
+    pthread_mutex_lock(&b->trava);
+    while (!b->pronta) {
+        pthread_cond_wait(&b->liberada, &b->trava);
+    }
+    pthread_mutex_unlock(&b->trava);
+    for (;;) {
+        pthread_barrier_wait(&b->barreira); // início de uma busca
+        if (atomic_load(&b->sair)) {
+            return NULL;
+        }
+        camadasParalelas(b, c->id);
+    }
+}
+
+void buscaParalelaLiberar(BuscaParalela *b) {
+    if (b->criadas > 0) {
+        atomic_store(&b->sair, 1);
+        pthread_barrier_wait(&b->barreira);
+        for (int i = 0; i < b->criadas; i++) {
+            pthread_join(b->threads[i], NULL);
+        }
+    }
+    if (b->pronta) {
+        pthread_barrier_destroy(&b->barreira);
+    }
+    pthread_mutex_destroy(&b->trava);
+    pthread_cond_destroy(&b->liberada);
+    for (int t = 0; t < b->num_trabalhos; t++) {
+        buscaFeixeLiberar(&b->trabalho[t]);
+    }
+    free(b->trabalho);
+    free(b->escolhidos_thread);
+    free(b->candidatos);
+    free(b->escolhidos);
+    free(b->atual);
+    free(b->proximo);
+    free(b->lances_raiz);
+    free(b->threads);
+    free(b->contextos);
+    ttLiberar(&b->tt);
+}
+
+/**
+ * @brief Prepara a busca com 'num_threads' threads (contando a atual).
+ *
+ * Se nem todas as threads extras puderem ser criadas, segue com as que
+ * foram; b->num_threads diz quantas participam.
+ */
+int buscaParalelaCriar(BuscaParalela *b, int num_threads, int largura, const float *pesos, int bits_tt) {
+    memset(b, 0, sizeof(*b));
+    if (num_threads <= 0 || largura <= 0 || largura > 0xFFFF) {
+        return -1;
+    }
+    pthread_mutex_init(&b->trava, NULL);
+    pthread_cond_init(&b->liberada, NULL);
+    atomic_init(&b->sair, 0);
+    b->num_threads = num_threads;
+    b->largura = largura;
+    memcpy(b->pesos, pesos ? pesos : PESOS_PADRAO, sizeof(b->pesos));
+    b->trabalho = calloc(num_threads, sizeof(BuscaFeixe));
+    b->escolhidos_thread = calloc(num_threads, sizeof(int));
+    b->candidatos = malloc(sizeof(EscolhidoFeixe) * largura * (size_t)num_threads);
+    b->escolhidos = malloc(sizeof(EscolhidoFeixe) * largura);
+    b->atual = malloc(sizeof(NoFeixe) * largura);
+    b->proximo = malloc(sizeof(NoFeixe) * largura);
+    b->lances_raiz = malloc(sizeof(Lance) * largura);
+    b->threads = malloc(sizeof(pthread_t) * num_threads);
+    b->contextos = malloc(sizeof(ThreadBusca) * num_threads);
+    int ok = b->trabalho && b->escolhidos_thread && b->candidatos && b->escolhidos && b->atual && b->proximo
+          && b->lances_raiz && b->threads && b->contextos && ttCriar(&b->tt, bits_tt) == 0;
+    // capacidade para o feixe inteiro, caso faltem threads na criação
+    while (ok && b->num_trabalhos < num_threads) {
+        ok = buscaFeixeCriar(&b->trabalho[b->num_trabalhos], largura, b->pesos) == 0;
+        b->num_trabalhos += ok;
+    }
+    if (!ok) {
+        buscaParalelaLiberar(b);
+        return -1;
+    }
+    for (; b->criadas < num_threads - 1; b->criadas++) {
+        ThreadBusca *c = &b->contextos[b->criadas];
+        c->busca = b;
+        c->id = b->criadas + 1;
+        if (pthread_create(&b->threads[b->criadas], NULL, threadBuscaParalela, c) != 0) {
+            break;
+        }
+    }
+    b->num_threads = b->criadas + 1;
+    pthread_barrier_init(&b->barreira, NULL, (unsigned)b->num_threads);
+    pthread_mutex_lock(&b->trava);
+    b->pronta = 1;
+    pthread_cond_broadcast(&b->liberada);
+    pthread_mutex_unlock(&b->trava);
+    return 0;
+}
+
+/**
+ * @brief Versão paralela de buscarLance (mesma interface).
+ *
+ * @return Profundidade alcançada, ou 0 se não há jogada possível.
+ */
+int buscarLanceParalelo(BuscaParalela *b, const Sessao *sessao, const Tabuleiro *t, const Superficie *s,
+                        Lance *lance) {
+    QuadroChave quadro;
+    capturarQuadro(sessao, 0, 0, &quadro);
+    NoFeixe *raiz = &b->atual[0];
+    restaurarQuadro(&quadro, &raiz->sessao);
+    raiz->tabuleiro = *t;
+    raiz->superficie = *s;
+    raiz->acumulado = 0;
+    raiz->nota = 0;
+    raiz->raiz = -1;
+    raiz->duplicado = 0;
+    b->limite = sessao->gerador.proximo_id;
+    b->geracao = (b->geracao + 1) & 0xFF;
+    b->num_nos = 1;
+    b->profundidade = 0;
+
+    pthread_barrier_wait(&b->barreira);
+    camadasParalelas(b, 0);
+
+    if (b->profundidade == 0) {
+        return 0;
+    }
+    int melhor = -1;
+    for (int i = 0; i < b->num_nos; i++) {
+        if (!b->atual[i].duplicado && (melhor < 0 || b->atual[i].nota > b->atual[melhor].nota)) {
+            melhor = i;
+        }
+    }
+    *lance = b->lances_raiz[b->atual[melhor].raiz];
+    return b->profundidade;
+}
+
+/**
+ * @brief Filhos avaliados por todas as threads desde a criação.
+ */
+long buscaParalelaAvaliados(const BuscaParalela *b) {
+    long total = 0;
+    for (int t = 0; t < b->num_threads; t++) {
+        total += b->trabalho[t].avaliados;
+    }
+    return total;
+}
+
+
+// --- MCTS COM NÓS DE ACASO ---
+
+// A árvore alterna nós de decisão (filhos = lances) e nós de acaso
+// (filhos = tipos sorteados para as peças que o lance faz surgir). O
+// sorteio segue a política do gerador, uniforme nos 7 tipos, e não a
+// semente da sessão: a busca não conhece as peças ainda não geradas.
+//
+// Os nós ficam num arena contíguo alocado uma vez; os filhos de um nó
+// são consecutivos e alocados juntos por um fetch_add. Várias threads
+// descem na mesma árvore com perda virtual: cada nó do caminho recebe
+// PERDA_VIRTUAL visitas de valor 0 na descida, desfeitas na volta, para
+// que as outras threads se espalhem por outros ramos.
+#define MCTS_LANCES_POR_MACRO 3   // melhores colocações de cada lance
+#define MCTS_PROFUNDIDADE_PADRAO 8 // peças postas antes de avaliar a folha
+#define MCTS_PROFUNDIDADE_MAX 32
+#define MCTS_EXPLORACAO 0.35f
+#define PERDA_VIRTUAL 3
+#define VALOR_ESCALA 1000000.0   // soma dos valores em ponto fixo
+#define VALOR_SUAVIZACAO 20.0f
+
+enum {
+    MCTS_FOLHA,
+    MCTS_EXPANDINDO,
+    MCTS_EXPANDIDO,
+    MCTS_SEM_ESPACO // arena cheio: continua folha
+};
+
+typedef struct {
+    _Atomic int32_t visitas;
+    _Atomic int32_t estado;
+    _Atomic int64_t soma;
+    uint32_t filhos;     // índice do primeiro filho no arena
+    uint16_t num_filhos;
+    uint8_t acaso;       // 1 = nó de acaso
+    uint8_t novas;       // nó de acaso: peças sorteadas (0 a 2)
+    Lance lance;         // nó de acaso: lance que leva a ele
+} NoMcts;
+
+typedef struct {
+    NoMcts *nos;
+    uint32_t capacidade;
+    _Atomic uint32_t usados;
+    int profundidade;
+    float pesos[NUM_CARACTERISTICAS];
+    // raiz da busca em andamento
+    NoFeixe raiz;
+    atomic_long restantes;
+    uint64_t semente;
+} Mcts;
+
+int mctsCriar(Mcts *m, uint32_t capacidade, const float *pesos) {
+    memset(m, 0, sizeof(*m));
+    m->nos = malloc(sizeof(NoMcts) * (size_t)capacidade);
+    if (!m->nos || capacidade < 2) {
+        free(m->nos);
+        return -1;
+    }
+    m->capacidade = capacidade;
+    m->profundidade = MCTS_PROFUNDIDADE_PADRAO;
+    memcpy(m->pesos, pesos ? pesos : PESOS_PADRAO, sizeof(m->pesos));
+    return 0;
+}
+
+void mctsLiberar(Mcts *m) {
+    free(m->nos);
+    m->nos = NULL;
+}
+
+static void iniciarNoMcts(NoMcts *no) {
+    atomic_init(&no->visitas, 0);
+    atomic_init(&no->estado, MCTS_FOLHA);
+    atomic_init(&no->soma, 0);
+    no->filhos = 0;
+    no->num_filhos = 0;
+    no->acaso = 0;
+    no->novas = 0;
+}
+
+// Reserva n nós consecutivos; devolve o primeiro, ou 0 se não couberem
+// (o nó 0 é sempre a raiz, então nunca é um primeiro filho).
+static uint32_t arenaAlocar(Mcts *m, uint32_t n) {
+    uint32_t inicio = atomic_fetch_add_explicit(&m->usados, n, memory_order_relaxed);
+    if ((uint64_t)inicio + n > m->capacidade) {
+        return 0;
+    }
+    return inicio;
+}
+
+// Raiz quadrada sem libm (o projeto não liga com -lm).
+static inline float raizQuadrada(float x) {
+#if defined(__GNUC__) && defined(__x86_64__)
+    return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(x)));
+#else
+    float r = x > 1.0f ? x : 1.0f;
+    for (int i = 0; i < 20; i++) {
+        r = 0.5f * (r + x / r);
+    }
+    return r;
+#endif
+}
+
+// Valor de uma folha em [0, 1]: linhas do caminho mais a avaliação linear
+// do tabuleiro, comprimidas por x / (|x| + k).
+static float valorFolha(const Mcts *m, const NoFeixe *estado) {
+    const Superficie *s = &estado->superficie;
+    const float *w = m->pesos;
+    float x = estado->acumulado + w[CAR_SOMA_ALTURAS] * s->soma_alturas + w[CAR_ALTURA_MAX] * s->altura_max
+            + w[CAR_BURACOS] * s->buracos + w[CAR_IRREGULARIDADE] * s->irregularidade + w[CAR_POCOS] * s->pocos;
+    float ax = x < 0 ? -x : x;
+    return 0.5f + 0.5f * x / (ax + VALOR_SUAVIZACAO);
+}
+
+static inline int pecasGeradas(const Lance *lance) {
+    int n = 0;
+    for (int i = 0; i < lance->num_acoes; i++) {
+        n += lance->acoes[i] == ACAO_JOGAR || lance->acoes[i] == ACAO_RESERVAR;
+    }
+    return n;
+}
+
+/**
+ * @brief Cria os filhos de um nó de decisão: para cada lance, as
+ * MCTS_LANCES_POR_MACRO colocações com melhor nota linear.
+ *
+ * @return 1 se criou (talvez nenhum filho: fim de jogo), 0 sem espaço.
+ */
+static int expandirDecisao(Mcts *m, NoMcts *no, const NoFeixe *estado, BuscaFeixe *w) {
+    w->lote.n = 0;
+    expandirNo(w, estado, 0, INT32_MAX);
+    loteNotas(&w->lote, m->pesos, w->notas);
+    int escolhidos[NUM_MACROS * MCTS_LANCES_POR_MACRO], n = 0;
+    for (int macro = 0; macro < NUM_MACROS; macro++) {
+        int melhores[MCTS_LANCES_POR_MACRO], k = 0;
+        for (int i = 0; i < w->lote.n; i++) {
+            if (w->filhos[i].macro != macro) {
+                continue;
+            }
+            // inserção ordenada nos k melhores
+            int j = k < MCTS_LANCES_POR_MACRO ? k++ : k;
+            while (j > 0 && w->notas[i] > w->notas[melhores[j - 1]]) {
+                if (j < MCTS_LANCES_POR_MACRO) {
+                    melhores[j] = melhores[j - 1];
+                }
+                j--;
+            }
+            if (j < MCTS_LANCES_POR_MACRO) {
+                melhores[j] = i;
+            }
+        }
+        for (int j = 0; j < k; j++) {
+            escolhidos[n++] = melhores[j];
+        }
+    }
+    uint32_t primeiro = n ? arenaAlocar(m, (uint32_t)n) : 0;
+    if (n && !primeiro) {
+        return 0;
+    }
+    for (int j = 0; j < n; j++) {
+        NoMcts *f = &m->nos[primeiro + j];
+        iniciarNoMcts(f);
+        f->acaso = 1;
+        lanceDoFilho(&w->filhos[escolhidos[j]], &f->lance);
+        f->novas = (uint8_t)pecasGeradas(&f->lance);
+    }
+    no->filhos = primeiro;
+    no->num_filhos = (uint16_t)n;
+    return 1;
+}
+
+// Filhos de um nó de acaso: um nó de decisão por resultado (7^novas).
+static int expandirAcaso(Mcts *m, NoMcts *no) {
+    uint32_t n = no->novas == 0 ? 1 : no->novas == 1 ? NUM_TIPOS : NUM_TIPOS * NUM_TIPOS;
+    uint32_t primeiro = arenaAlocar(m, n);
+    if (!primeiro) {
+        return 0;
+    }
+    for (uint32_t j = 0; j < n; j++) {
+        iniciarNoMcts(&m->nos[primeiro + j]);
+    }
+    no->filhos = primeiro;
+    no->num_filhos = (uint16_t)n;
+    return 1;
+}
+
+// Tenta expandir; quem perde a corrida trata o nó como folha nesta descida.
+// Devolve 0 se o nó continua folha, 1 se já estava expandido e 2 se
+// foi expandido agora.
+static int garantirExpandido(Mcts *m, NoMcts *no, const NoFeixe *estado, BuscaFeixe *w) {
+    int32_t e = atomic_load_explicit(&no->estado, memory_order_acquire);
+    if (e == MCTS_EXPANDIDO) {
+        return 1;
+    }
+    int32_t folha = MCTS_FOLHA;
+    if (e != MCTS_FOLHA || !atomic_compare_exchange_strong(&no->estado, &folha, MCTS_EXPANDINDO)) {
+        return 0;
+    }
+    int ok = no->acaso ? expandirAcaso(m, no) : expandirDecisao(m, no, estado, w);
+    atomic_store_explicit(&no->estado, ok ? MCTS_EXPANDIDO : MCTS_SEM_ESPACO, memory_order_release);
+    return ok ? 2 : 0;
+}
+
+// Filho de decisão com o maior Q + c * sqrt(N) / (1 + n); não visitados
+// valem 1 (otimismo), o que faz cada lance ser tentado ao menos uma vez.
+static uint32_t escolherLanceMcts(const Mcts *m, const NoMcts *no) {
+    int32_t total = atomic_load_explicit(&no->visitas, memory_order_relaxed);
+    float exploracao = MCTS_EXPLORACAO * raizQuadrada((float)(total + 1));
+    uint32_t melhor = no->filhos;
+    float melhor_u = -FLT_MAX;
+    for (uint32_t i = no->filhos; i < no->filhos + no->num_filhos; i++) {
+        const NoMcts *f = &m->nos[i];
+        int32_t n = atomic_load_explicit(&f->visitas, memory_order_relaxed);
+        float q = n > 0 ? (float)(atomic_load_explicit(&f->soma, memory_order_relaxed) / VALOR_ESCALA / n) : 1.0f;
+        float u = q + exploracao / (float)(1 + n);
+        if (u > melhor_u) {
+            melhor_u = u;
+            melhor = i;
+        }
+    }
+    return melhor;
+}
+
+// Uma descida da raiz até uma folha, com avaliação e retropropagação.
+static void iteracaoMcts(Mcts *m, BuscaFeixe *w, uint64_t *aleatorio) {
+    uint32_t caminho[2 * MCTS_PROFUNDIDADE_MAX + 2]; // decisão e acaso por peça, mais a folha
+    int tamanho = 0;
+    NoFeixe estado = m->raiz;
+    uint32_t atual = 0;
+    int pecas = 0;
+    float valor;
+    for (;;) {
+        NoMcts *no = &m->nos[atual];
+        atomic_fetch_add_explicit(&no->visitas, PERDA_VIRTUAL, memory_order_relaxed);
+        caminho[tamanho++] = atual;
+        if (!no->acaso && pecas >= m->profundidade) {
+            valor = valorFolha(m, &estado);
+            break;
+        }
+        int expansao = garantirExpandido(m, no, &estado, w);
+        if (expansao == 0) {
+            valor = valorFolha(m, &estado);
+            break;
+        }
+        if (no->num_filhos == 0) {
+            valor = 0; // fim de jogo
+            break;
+        }
+        // uma decisão nova por iteração: avalia o estado em vez de descer
+        if (expansao == 2 && !no->acaso) {
+            valor = valorFolha(m, &estado);
+            break;
+        }
+        if (!no->acaso) {
+            atual = escolherLanceMcts(m, no);
+            const Lance *lance = &m->nos[atual].lance;
+            int linhas = executarLance(&estado.sessao, &estado.tabuleiro, &estado.superficie, lance);
+            estado.acumulado += (float)linhas * m->pesos[CAR_LINHAS];
+            pecas++;
+            continue;
+        }
+        // acaso: sorteia os tipos das peças que o lance fez surgir (as
+        // últimas da fila) e desce para o resultado correspondente
+        *aleatorio = misturar64(*aleatorio + PASSO_GERADOR);
+        uint32_t resultado = (uint32_t)(((*aleatorio >> 32) * no->num_filhos) >> 32);
+        Fila *f = &estado.sessao.fila;
+        uint32_t r = resultado;
+        for (int i = 1; i <= no->novas; i++) {
+            f->itens[(f->fim - i + FILA_MAX) % FILA_MAX].nome = TIPOS_PECA[r % NUM_TIPOS];
+            r /= NUM_TIPOS;
+        }
+        atual = no->filhos + resultado;
+    }
+    int64_t v = (int64_t)(valor * VALOR_ESCALA);
+    for (int i = 0; i < tamanho; i++) {
+        NoMcts *no = &m->nos[caminho[i]];
+        atomic_fetch_add_explicit(&no->visitas, 1 - PERDA_VIRTUAL, memory_order_relaxed);
+        atomic_fetch_add_explicit(&no->soma, v, memory_order_relaxed);
+    }
+}
+
+typedef struct {
+    Mcts *mcts;
+    int id;
+    long iteracoes;
+    int erro;
+} ThreadMcts;
+
+void mctsDefinirProfundidade(Mcts *m, int profundidade) {
+    m->profundidade = profundidade < 1 ? 1 : profundidade > MCTS_PROFUNDIDADE_MAX ? MCTS_PROFUNDIDADE_MAX : profundidade;
+}
+
+static void *threadMcts(void *arg) {
+    ThreadMcts *c = arg;
+    Mcts *m = c->mcts;
+    BuscaFeixe w;
+    if (buscaFeixeCriar(&w, 1, m->pesos) != 0) {
+        c->erro = 1;
+        return NULL;
+    }
+    uint64_t aleatorio = misturar64(m->semente + (uint64_t)c->id * PASSO_GERADOR);
+    while (atomic_fetch_sub_explicit(&m->restantes, 1, memory_order_relaxed) > 0) {
+        iteracaoMcts(m, &w, &aleatorio);
+        c->iteracoes++;
+    }
+    buscaFeixeLiberar(&w);
+    return NULL;
+}
+
+/**
+ * @brief Escolhe a próxima jogada com MCTS.
+ *
+ * A árvore é refeita a cada chamada (o arena é reiniciado). A jogada é o
+ * lance mais visitado da raiz.
+ *
+ * @return Número de iterações feitas, 0 se não há jogada ou -1 em erro.
+ */
+long mctsBuscar(Mcts *m, const Sessao *sessao, const Tabuleiro *t, const Superficie *s, long iteracoes,
+                int num_threads, Lance *lance) {
+    QuadroChave quadro;
+    capturarQuadro(sessao, 0, 0, &quadro);
+    restaurarQuadro(&quadro, &m->raiz.sessao);
+    m->raiz.tabuleiro = *t;
+    m->raiz.superficie = *s;
+    m->raiz.acumulado = 0;
+    m->semente = misturar64(hashSessao(sessao) + (uint64_t)sessao->gerador.proximo_id);
+    iniciarNoMcts(&m->nos[0]);
+    atomic_store(&m->usados, 1);
+    atomic_store(&m->restantes, iteracoes);
+
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+    ThreadMcts *contextos = calloc(num_threads, sizeof(ThreadMcts));
+    if (!threads || !contextos) {
+        free(threads);
+        free(contextos);
+        return -1;
+    }
+    int criadas = 0;
+    for (; criadas < num_threads - 1; criadas++) {
+        contextos[criadas + 1].mcts = m;
+        contextos[criadas + 1].id = criadas + 1;
+        if (pthread_create(&threads[criadas], NULL, threadMcts, &contextos[criadas + 1]) != 0) {
+            break;
+        }
+    }
+    contextos[0].mcts = m;
+    threadMcts(&contextos[0]);
+    long feitas = 0;
+    int erro = contextos[0].erro;
+    for (int i = 0; i < criadas; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i <= criadas; i++) {
+        feitas += contextos[i].iteracoes;
+        erro |= contextos[i].erro;
+    }
+    free(threads);
+    free(contextos);
+    if (erro) {
+        return -1;
+    }
+
+    const NoMcts *raiz = &m->nos[0];
+    if (atomic_load(&raiz->estado) != MCTS_EXPANDIDO || raiz->num_filhos == 0) {
+        return 0;
+    }
+    uint32_t melhor = raiz->filhos;
+    for (uint32_t i = raiz->filhos; i < raiz->filhos + raiz->num_filhos; i++) {
+        if (atomic_load(&m->nos[i].visitas) > atomic_load(&m->nos[melhor].visitas)) {
+            melhor = i;
+        }
+    }
+    *lance = m->nos[melhor].lance;
+    return feitas;
+}
+
+
+// --- LIMPEZA TOTAL (PERFECT CLEAR) ---
+
+// Busca exaustiva de lances (MACROS_BOT, só com peças já vistas da fila e
+// da pilha) que deixem o tabuleiro vazio. Para cada altura alvo h (até
+// PC_ALTURA_MAX), as peças só ocupam as linhas abaixo de h, que desce a
+// cada linha removida; a limpeza acontece quando h chega a 0. Um estado
+// é podado quando:
+//  - as vazias abaixo de h não são um múltiplo de 4 ou pedem mais peças
+//    do que as vistas;
+//  - a paridade de colunas não fecha: O, S, Z, I deitado e T deitado
+//    cobrem 2 colunas pares e 2 ímpares, T de pé 3 + 1, L e J sempre
+//    3 + 1 e I de pé 4 + 0; remover uma linha cheia não muda a diferença
+//    entre vazias pares e ímpares, então ela tem de ser coberta pelas
+//    peças vistas;
+//  - uma coluna cheia em todas as linhas abaixo de h (e que continua
+//    cheia depois de qualquer remoção) separa regiões cujo número de
+//    vazias não é múltiplo de 4.
+// Os estados sem solução vão para uma tabela de falhas sem travas,
+// chaveada pelo tabuleiro, por h e pelos tipos visíveis. O resultado não
+// depende da consulta, então a tabela continua valendo entre consultas.
+#define PC_ALTURA_MAX 4
+#define PC_MAX_PECAS (FILA_MAX + PILHA_MAX)
+#define PC_MEMO_BITS_PADRAO 18
+#define PC_LINHAS_PARES 0x5555555555ULL //  colunas 0, 2, ..., 8 das linhas 0..3 empacotadas
+
+// Maior mudança na diferença entre vazias pares e ímpares, por tipo.
+static const uint8_t PC_DESEQUILIBRIO[NUM_TIPOS] = {4, 0, 2, 2, 0, 0, 2};
+
+typedef struct {
+    _Atomic uint64_t *falhas; // chave | 1 dos estados sem solução
+    uint64_t mascara;
+    int num_threads;
+    long nos;                 // estados visitados na última consulta
+} SolucionadorPC;
+
+int solucionadorPCCriar(SolucionadorPC *sol, int bits, int num_threads) {
+    sol->falhas = calloc((size_t)1 << bits, sizeof(uint64_t));
+    sol->mascara = ((uint64_t)1 << bits) - 1;
+    sol->num_threads = num_threads < 1 ? 1 : num_threads;
+    sol->nos = 0;
+    return sol->falhas ? 0 : -1;
+}
+
+void solucionadorPCLiberar(SolucionadorPC *sol) {
+    free(sol->falhas);
+    sol->falhas = NULL;
+}
+
+typedef struct {
+    SolucionadorPC *sol;
+    const Sessao *sessao;
+    const Tabuleiro *tabuleiro;
+    int limite;
+    int altura;
+    FilhoFeixe filhos[MAX_FILHOS_POR_NO]; // lances da raiz
+    int num_filhos;
+    _Atomic int proximo;
+    _Atomic int encontrada;
+    Lance solucao[PC_MAX_PECAS];
+    int num_lances;
+} ConsultaPC;
+
+typedef struct {
+    ConsultaPC *consulta;
+    Lance caminho[PC_MAX_PECAS];
+    int num_lances;
+    long nos;
+} ThreadPC;
+
+// Linhas 0..3 do tabuleiro em 40 bits, 10 por linha (bit = ocupada).
+static inline uint64_t empacotarPC(const Tabuleiro *t) {
+    const uint16_t *l = &t->linhas[TABULEIRO_BORDA];
+    return (uint64_t)((l[0] & MASCARA_COLUNAS) >> TABULEIRO_PAREDE)
+         | (uint64_t)((l[1] & MASCARA_COLUNAS) >> TABULEIRO_PAREDE) << TABULEIRO_LARGURA
+         | (uint64_t)((l[2] & MASCARA_COLUNAS) >> TABULEIRO_PAREDE) << (2 * TABULEIRO_LARGURA)
+         | (uint64_t)((l[3] & MASCARA_COLUNAS) >> TABULEIRO_PAREDE) << (3 * TABULEIRO_LARGURA);
+}
+
+// Linhas empacotadas por empacotarPC com as colunas espelhadas.
+static inline uint64_t espelharLinhasPC(uint64_t linhas) {
+    const uint64_t colunas = (1u << TABULEIRO_LARGURA) - 1;
+    uint64_t espelho = 0;
+    for (int y = 0; y < PC_ALTURA_MAX; y++) {
+        uint32_t linha = (uint32_t)((linhas >> (y * TABULEIRO_LARGURA)) & colunas);
+        espelho |= (uint64_t)espelharColunas(linha) << (y * TABULEIRO_LARGURA);
+    }
+    return espelho;
+}
+
+// Hash do estado: linhas 0..3, altura alvo e tipos visíveis na ordem. As
+// podas e as colocações por queda são simétricas, então o estado e o seu
+// espelho têm a mesma resposta e usam a mesma chave (a menor das duas).
+static uint64_t hashPC(const Sessao *s, uint64_t linhas, int h, int limite) {
+    uint64_t altura = (uint64_t)h << (PC_ALTURA_MAX * TABULEIRO_LARGURA);
+    uint64_t contagem = (uint64_t)(s->pilha.topo + 1) << 3 | (uint64_t)s->fila.total;
+    int visiveis = s->fila.total + s->pilha.topo + 1;
+    uint64_t direto = misturar64(linhas | altura)
+                    ^ misturar64((contagem << (3 * visiveis) | tiposVisiveis(s, limite, 0)) + PASSO_GERADOR);
+    uint64_t espelho = misturar64(espelharLinhasPC(linhas) | altura)
+                     ^ misturar64((contagem << (3 * visiveis) | tiposVisiveis(s, limite, 1)) + PASSO_GERADOR);
+    return direto < espelho ? direto : espelho;
+}
+
+// Aplica as podas de contagem, paridade e regiões (ver o topo da seção).
+static int viavelPC(const Sessao *s, uint64_t linhas, int h, int limite) {
+    int contagem[NUM_TIPOS] = {0};
+    int idx = s->fila.inicio;
+    for (int i = 0; i < s->fila.total; i++) {
+        const Peca *p = &s->fila.itens[idx];
+        if (p->id < limite) {
+            contagem[tipoDaLetra(p->nome)]++;
+        }
+        idx = (idx + 1) % FILA_MAX;
+    }
+    for (int i = 0; i <= s->pilha.topo; i++) {
+        contagem[tipoDaLetra(s->pilha.itens[i].nome)]++;
+    }
+    int pecas = 0, folga = 0;
+    for (int k = 0; k < NUM_TIPOS; k++) {
+        pecas += contagem[k];
+        folga += contagem[k] * PC_DESEQUILIBRIO[k];
+    }
+
+    const uint64_t colunas = (1u << TABULEIRO_LARGURA) - 1;
+    uint64_t livres = ~linhas & (((uint64_t)1 << (h * TABULEIRO_LARGURA)) - 1);
+    int vazias = __builtin_popcountll(livres);
+    int diferenca = 2 * __builtin_popcountll(livres & PC_LINHAS_PARES) - vazias;
+    if (vazias % 4 != 0 || vazias > 4 * pecas || diferenca > folga || -diferenca > folga) {
+        return 0;
+    }
+    // Sem peça sobrando, todas entram: L e J mudam a diferença em 2, I em
+    // 0 ou 4, e sem T a metade da diferença tem a paridade de L + J.
+    int lj = contagem[tipoDaLetra('L')] + contagem[tipoDaLetra('J')];
+    if (vazias == 4 * pecas && contagem[tipoDaLetra('T')] == 0 && ((diferenca / 2 - lj) & 1)) {
+        return 0;
+    }
+    uint64_t paredes = colunas;
+    for (int y = 0; y < h; y++) {
+        paredes &= linhas >> (y * TABULEIRO_LARGURA);
+    }
+    if (paredes & colunas) {
+        int regiao = 0;
+        for (int c = 0; c < TABULEIRO_LARGURA; c++) {
+            if ((paredes >> c) & 1) {
+                if (regiao % 4 != 0) {
+                    return 0;
+                }
+                regiao = 0;
+                continue;
+            }
+            for (int y = 0; y < h; y++) {
+                regiao += (int)((livres >> (y * TABULEIRO_LARGURA + c)) & 1);
+            }
+        }
+    }
+    return 1;
+}
+
+// Altura de cada coluna nas linhas abaixo de h.
+static inline void alturasPC(uint64_t linhas, int h, uint8_t *alturas) {
+    memset(alturas, 0, TABULEIRO_LARGURA);
+    for (int y = 0; y < h; y++) {
+        for (int c = 0; c < TABULEIRO_LARGURA; c++) {
+            if ((linhas >> (y * TABULEIRO_LARGURA + c)) & 1) {
+                alturas[c] = (uint8_t)(y + 1);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Colocações por queda livre que ficam abaixo da altura alvo.
+ *
+ * Como nada passa da linha h, a peça vem de cima de tudo e para na
+ * primeira coluna em que encosta (como em yDeQuedaSuperficie); o
+ * resultado é o mesmo de enumerarColocacoes filtrado por h.
+ */
+static int colocacoesPC(const uint8_t *alturas, int tipo, int h, Colocacao *saida) {
+    int n = 0;
+    for (int rot = 0; rot < ROTACOES_DISTINTAS[tipo]; rot++) {
+        const FormaPeca *f = &FORMAS[tipo][rot];
+        const uint8_t *forma = COLUNAS_FORMA[tipo][rot];
+        if (f->y_max - f->y_min >= h) {
+            continue;
+        }
+        for (int px = -f->x_min; px + f->x_max < TABULEIRO_LARGURA; px++) {
+            int y = -TABULEIRO_BORDA;
+            for (int c = f->x_min; c <= f->x_max; c++) {
+                int apoio = alturas[px + c] - __builtin_ctz(forma[c]);
+                y = apoio > y ? apoio : y;
+            }
+            if (y + f->y_max < h) {
+                saida[n].rot = (int8_t)rot;
+                saida[n].x = (int8_t)px;
+                saida[n].y = (int8_t)y;
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+static int buscarPC(ThreadPC *th, const Sessao *s, const Tabuleiro *t, int h, int prof) {
+    if (h == 0) {
+        th->num_lances = prof;
+        return 1;
+    }
+    ConsultaPC *c = th->consulta;
+    if (atomic_load_explicit(&c->encontrada, memory_order_relaxed)) {
+        return 0;
+    }
+    th->nos++;
+    uint64_t linhas = empacotarPC(t);
+    if (!viavelPC(s, linhas, h, c->limite)) {
+        return 0;
+    }
+    SolucionadorPC *sol = c->sol;
+    uint64_t chave = hashPC(s, linhas, h, c->limite);
+    _Atomic uint64_t *falha = &sol->falhas[chave & sol->mascara];
+    if (atomic_load_explicit(falha, memory_order_relaxed) == (chave | 1)) {
+        return 0;
+    }
+
+    // as colocações de um tipo servem para todos os lances que o usam
+    uint8_t alturas[TABULEIRO_LARGURA];
+    alturasPC(linhas, h, alturas);
+    Colocacao colocacoes[NUM_TIPOS][MAX_COLOCACOES];
+    int num_colocacoes[NUM_TIPOS] = {-1, -1, -1, -1, -1, -1, -1};
+    for (int m = 0; m < NUM_MACROS; m++) {
+        Sessao filho = *s;
+        int tipo = aplicarMacro(&filho, m, c->limite);
+        if (tipo < 0) {
+            continue;
+        }
+        if (num_colocacoes[tipo] < 0) {
+            num_colocacoes[tipo] = colocacoesPC(alturas, tipo, h, colocacoes[tipo]);
+        }
+        for (int i = 0; i < num_colocacoes[tipo]; i++) {
+            const Colocacao *col = &colocacoes[tipo][i];
+            Tabuleiro nt = *t;
+            int feitas = colocarPeca(&nt, tipo, col->rot, col->x, col->y);
+            FilhoFeixe f = {.macro = (uint8_t)m, .tipo = (uint8_t)tipo, .colocacao = *col};
+            lanceDoFilho(&f, &th->caminho[prof]);
+            if (buscarPC(th, &filho, &nt, h - feitas, prof + 1)) {
+                return 1;
+            }
+        }
+    }
+    // uma busca interrompida por outra thread não prova nada
+    if (!atomic_load_explicit(&c->encontrada, memory_order_relaxed)) {
+        atomic_store_explicit(falha, chave | 1, memory_order_relaxed);
+    }
+    return 0;
+}
+
+// Distribui os lances da raiz entre as threads; a primeira solução vence.
+static void *threadPC(void *arg) {
+    ThreadPC *th = arg;
+    ConsultaPC *c = th->consulta;
+    for (;;) {
+        int i = atomic_fetch_add(&c->proximo, 1);
+        if (i >= c->num_filhos || atomic_load(&c->encontrada)) {
+            break;
+        }
+        const FilhoFeixe *f = &c->filhos[i];
+        Sessao s = *c->sessao;
+        Tabuleiro t = *c->tabuleiro;
+        aplicarMacro(&s, f->macro, c->limite);
+        int feitas = colocarPeca(&t, f->tipo, f->colocacao.rot, f->colocacao.x, f->colocacao.y);
+        lanceDoFilho(f, &th->caminho[0]);
+        if (buscarPC(th, &s, &t, c->altura - feitas, 1)) {
+            int esperado = 0;
+            if (atomic_compare_exchange_strong(&c->encontrada, &esperado, 1)) {
+                memcpy(c->solucao, th->caminho, sizeof(Lance) * th->num_lances);
+                c->num_lances = th->num_lances;
+            }
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Resolve uma altura alvo: lista os lances da raiz e os divide entre as threads.
+static int consultarPC(ConsultaPC *c) {
+    SolucionadorPC *sol = c->sol;
+    const Sessao *raiz = c->sessao;
+    int h = c->altura;
+    sol->nos++;
+    uint64_t linhas = empacotarPC(c->tabuleiro);
+    if (!viavelPC(raiz, linhas, h, c->limite)) {
+        return 0;
+    }
+    uint64_t chave = hashPC(raiz, linhas, h, c->limite);
+    if (atomic_load(&sol->falhas[chave & sol->mascara]) == (chave | 1)) {
+        return 0;
+    }
+    c->num_filhos = 0;
+    uint8_t alturas[TABULEIRO_LARGURA];
+    alturasPC(linhas, h, alturas);
+    for (int m = 0; m < NUM_MACROS; m++) {
+        Sessao filho = *raiz;
+        int tipo = aplicarMacro(&filho, m, c->limite);
+        if (tipo < 0) {
+            continue;
+        }
+        Colocacao colocacoes[MAX_COLOCACOES];
+        int n = colocacoesPC(alturas, tipo, h, colocacoes);
+        for (int i = 0; i < n; i++) {
+            FilhoFeixe *f = &c->filhos[c->num_filhos++];
+            f->macro = (uint8_t)m;
+            f->tipo = (uint8_t)tipo;
+            f->colocacao = colocacoes[i];
+        }
+    }
+    atomic_store(&c->proximo, 0);
+    atomic_store(&c->encontrada, 0);
+    c->num_lances = 0;
+
+    int num_threads = sol->num_threads < c->num_filhos ? sol->num_threads : c->num_filhos;
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+    ThreadPC *contextos = calloc(num_threads, sizeof(ThreadPC));
+    if (!threads || !contextos) {
+        free(threads);
+        free(contextos);
+        return -1;
+    }
+    int criadas = 0;
+    for (; criadas < num_threads - 1; criadas++) {
+        contextos[criadas + 1].consulta = c;
+        if (pthread_create(&threads[criadas], NULL, threadPC, &contextos[criadas + 1]) != 0) {
+            break;
+        }
+    }
+    contextos[0].consulta = c;
+    threadPC(&contextos[0]);
+    for (int i = 0; i < criadas; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i <= criadas; i++) {
+        sol->nos += contextos[i].nos;
+    }
+    free(threads);
+    free(contextos);
+    if (!atomic_load(&c->encontrada)) {
+        atomic_store(&sol->falhas[chave & sol->mascara], chave | 1);
+    }
+    return c->num_lances;
+}
+
+/**
+ * @brief Procura uma limpeza total com as peças vistas da fila e da pilha.
+ *
+ * Tenta as alturas alvo da menor à maior; as linhas a partir de
+ * PC_ALTURA_MAX precisam estar vazias. Só considera colocações por queda
+ * livre (enumerarColocacoes).
+ *
+ * @param solucao Recebe até PC_MAX_PECAS lances, na ordem.
+ * @return Número de lances da solução, 0 se não há limpeza total ou -1 em erro.
+ */
+int resolverPC(SolucionadorPC *sol, const Sessao *sessao, const Tabuleiro *t, Lance *solucao) {
+    sol->nos = 0;
+    int ocupadas = 0, altura = 0;
+    for (int y = 0; y < TABULEIRO_ALTURA; y++) {
+        int n = __builtin_popcount(t->linhas[TABULEIRO_BORDA + y] & MASCARA_COLUNAS);
+        if (n && y >= PC_ALTURA_MAX) {
+            return 0;
+        }
+        ocupadas += n;
+        altura = n ? y + 1 : altura;
+    }
+    if (ocupadas == 0) {
+        return 0;
+    }
+    ConsultaPC *c = malloc(sizeof(ConsultaPC));
+    if (!c) {
+        return -1;
+    }
+    QuadroChave quadro;
+    Sessao raiz;
+    capturarQuadro(sessao, 0, 0, &quadro);
+    restaurarQuadro(&quadro, &raiz);
+    c->sol = sol;
+    c->sessao = &raiz;
+    c->tabuleiro = t;
+    c->limite = sessao->gerador.proximo_id;
+
+    int resultado = 0;
+    for (int h = altura; h <= PC_ALTURA_MAX && resultado == 0; h++) {
+        if ((TABULEIRO_LARGURA * h - ocupadas) % 4 != 0) {
+            continue;
+        }
+        c->altura = h;
+        resultado = consultarPC(c);
+    }
+    if (resultado > 0) {
+        memcpy(solucao, c->solucao, sizeof(Lance) * resultado);
+    }
+    free(c);
+    return resultado;
+}
+
+
+// --- TREINO GENÉTICO DOS PESOS ---
+
+// Evolui vetores de pesos da avaliação linear. Cada indivíduo joga as
+// mesmas 'jogos' partidas da geração com o bot de busca em feixe, até
+// 'max_pecas' peças cada, e a aptidão é a média de linhas feitas. As
+// sementes das partidas e todos os sorteios (seleção, cruzamento e
+// mutação) saem de (semente, geração), e cada partida grava o seu
+// resultado na sua posição: o resultado não depende do número de threads
+// nem de a geração ter sido retomada de um checkpoint.
+//
+// A nota linear só compara colocações, então os pesos são mantidos com
+// norma 1. O filho é a média dos pais ponderada pela aptidão, com
+// mutação ocasional de um peso.
+#define GENETICO_MAGICA "TSGENET"
+#define GENETICO_VERSAO 1
+#define GENETICO_TORNEIO 3          // sorteados por torneio
+#define GENETICO_MUTACAO_PCT 10     // chance de mutação de um filho
+#define GENETICO_PASSO_MUTACAO 0.2f // a mutação soma até +-0,2 a um peso
+
+/**
+ * @brief Cabeçalho do checkpoint; a população (pesos de cada indivíduo,
+ * ainda não avaliada) vem logo depois.
+ */
+typedef struct {
+    char magica[8];
+    uint32_t versao;
+    uint32_t populacao;
+    uint32_t jogos;
+    uint32_t max_pecas;
+    uint32_t largura;
+    uint32_t geracao;                        // próxima geração a avaliar
+    uint64_t semente;
+    float melhor_aptidao;                    // melhor indivíduo já avaliado
+    float melhor_pesos[NUM_CARACTERISTICAS];
+    char reservado[32];
+} CabecalhoGenetico;
+
+typedef float PesosLinear[NUM_CARACTERISTICAS];
+
+typedef struct {
+    int populacao;
+    int jogos;
+    int max_pecas;
+    int largura;
+    int num_threads;
+    uint64_t semente;
+    int geracao;
+    PesosLinear *pesos;      // população a avaliar
+    PesosLinear *novos;
+    float *aptidao;          // da última geração avaliada
+    float *linhas;           // por (indivíduo, partida)
+    int *ordem;
+    float melhor_aptidao;
+    PesosLinear melhor_pesos;
+    BuscaFeixe *buscas;      // uma por thread
+    _Atomic int proxima;     // próxima partida a jogar
+    _Atomic long pecas;      // peças jogadas desde a criação
+} TreinoGenetico;
+
+static void normalizarPesos(float *pesos) {
+    float soma = 0;
+    for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+        soma += pesos[k] * pesos[k];
+    }
+    if (soma > 0) {
+        float inv = 1.0f / raizQuadrada(soma);
+        for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+            pesos[k] *= inv;
+        }
+    }
+}
+
+void treinoLiberar(TreinoGenetico *tr) {
+    if (tr->buscas) {
+        for (int i = 0; i < tr->num_threads; i++) {
+            buscaFeixeLiberar(&tr->buscas[i]);
+        }
+    }
+    free(tr->buscas);
+    free(tr->pesos);
+    free(tr->novos);
+    free(tr->aptidao);
+    free(tr->linhas);
+    free(tr->ordem);
+    tr->buscas = NULL;
+}
+
+/**
+ * @brief Prepara o treino e sorteia a população inicial.
+ *
+ * O indivíduo 0 é PESOS_PADRAO; os demais têm pesos uniformes em
+ * [-1, 1], normalizados.
+ */
+int treinoCriar(TreinoGenetico *tr, int populacao, int jogos, int max_pecas, int largura, int num_threads,
+                uint64_t semente) {
+    memset(tr, 0, sizeof(*tr));
+    if (populacao < 2 || jogos <= 0 || max_pecas <= 0 || largura <= 0 || num_threads <= 0) {
+        return -1;
+    }
+    tr->populacao = populacao;
+    tr->jogos = jogos;
+    tr->max_pecas = max_pecas;
+    tr->largura = largura;
+    tr->num_threads = num_threads;
+    tr->semente = semente;
+    tr->melhor_aptidao = -1;
+    memcpy(tr->melhor_pesos, PESOS_PADRAO, sizeof(tr->melhor_pesos));
+    tr->pesos = malloc(sizeof(PesosLinear) * populacao);
+    tr->novos = malloc(sizeof(PesosLinear) * populacao);
+    tr->aptidao = calloc(populacao, sizeof(float));
+    tr->linhas = malloc(sizeof(float) * populacao * jogos);
+    tr->ordem = malloc(sizeof(int) * populacao);
+    tr->buscas = calloc(num_threads, sizeof(BuscaFeixe));
+    if (!tr->pesos || !tr->novos || !tr->aptidao || !tr->linhas || !tr->ordem || !tr->buscas) {
+        treinoLiberar(tr);
+        return -1;
+    }
+    int criadas = 0;
+    while (criadas < num_threads && buscaFeixeCriar(&tr->buscas[criadas], largura, NULL) == 0) {
+        criadas++;
+    }
+    if (criadas < num_threads) {
+        tr->num_threads = criadas;
+        treinoLiberar(tr);
+        return -1;
+    }
+
+    uint64_t x = misturar64(semente ^ 0x5DEECE66DULL);
+    memcpy(tr->pesos[0], PESOS_PADRAO, sizeof(PesosLinear));
+    for (int i = 1; i < populacao; i++) {
+        for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+            tr->pesos[i][k] = 2.0f * sortearUniforme(&x) - 1.0f;
+        }
+    }
+    for (int i = 0; i < populacao; i++) {
+        normalizarPesos(tr->pesos[i]);
+    }
+    return 0;
+}
+
+/**
+ * @brief Grava o checkpoint (em um arquivo temporário renomeado no fim,
+ * para que uma queda no meio nunca deixe um checkpoint pela metade).
+ *
+ * @return 0 em caso de sucesso, -1 em erro de escrita.
+ */
+int treinoSalvar(const TreinoGenetico *tr, const char *caminho) {
+    char temporario[4096];
+    if (snprintf(temporario, sizeof(temporario), "%s.tmp", caminho) >= (int)sizeof(temporario)) {
+        return -1;
+    }
+    FILE *arq = fopen(temporario, "wb");
+    if (!arq) {
+        return -1;
+    }
+    CabecalhoGenetico cab;
+    memset(&cab, 0, sizeof(cab));
+    memcpy(cab.magica, GENETICO_MAGICA, sizeof(GENETICO_MAGICA));
+    cab.versao = GENETICO_VERSAO;
+    cab.populacao = (uint32_t)tr->populacao;
+    cab.jogos = (uint32_t)tr->jogos;
+    cab.max_pecas = (uint32_t)tr->max_pecas;
+    cab.largura = (uint32_t)tr->largura;
+    cab.geracao = (uint32_t)tr->geracao;
+    cab.semente = tr->semente;
+    cab.melhor_aptidao = tr->melhor_aptidao;
+    memcpy(cab.melhor_pesos, tr->melhor_pesos, sizeof(cab.melhor_pesos));
+    int ok = fwrite(&cab, sizeof(cab), 1, arq) == 1
+          && fwrite(tr->pesos, sizeof(PesosLinear), tr->populacao, arq) == (size_t)tr->populacao
+          && fflush(arq) == 0 && fsync(fileno(arq)) == 0;
+    ok = fclose(arq) == 0 && ok;
+    if (!ok || rename(temporario, caminho) != 0) {
+        remove(temporario);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Lê o cabeçalho de um checkpoint, sem a população.
+ *
+ * @return 1 se leu, 0 se o arquivo não existe ou -1 se é inválido.
+ */
+int treinoLerCabecalho(const char *caminho, CabecalhoGenetico *cab) {
+    FILE *arq = fopen(caminho, "rb");
+    if (!arq) {
+        return 0;
+    }
+    int ok = fread(cab, sizeof(*cab), 1, arq) == 1;
+    fclose(arq);
+    if (!ok || memcmp(cab->magica, GENETICO_MAGICA, sizeof(GENETICO_MAGICA)) != 0
+        || cab->versao != GENETICO_VERSAO) {
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Retoma a população de um checkpoint gravado com os mesmos
+ * parâmetros do treino.
+ *
+ * @return 0 em caso de sucesso, -1 se o arquivo é inválido ou não bate.
+ */
+int treinoCarregar(TreinoGenetico *tr, const char *caminho) {
+    CabecalhoGenetico cab;
+    if (treinoLerCabecalho(caminho, &cab) != 1 || cab.populacao != (uint32_t)tr->populacao
+        || cab.jogos != (uint32_t)tr->jogos || cab.max_pecas != (uint32_t)tr->max_pecas
+        || cab.largura != (uint32_t)tr->largura || cab.semente != tr->semente) {
+        return -1;
+    }
+    FILE *arq = fopen(caminho, "rb");
+    if (!arq) {
+        return -1;
+    }
+    int ok = fseek(arq, (long)sizeof(cab), SEEK_SET) == 0
+          && fread(tr->pesos, sizeof(PesosLinear), tr->populacao, arq) == (size_t)tr->populacao;
+    fclose(arq);
+    if (!ok) {
+        return -1;
+    }
+    tr->geracao = (int)cab.geracao;
+    tr->melhor_aptidao = cab.melhor_aptidao;
+    memcpy(tr->melhor_pesos, cab.melhor_pesos, sizeof(tr->melhor_pesos));
+    return 0;
+}
+
+// Semente da partida 'jogo' da geração: igual para todos os indivíduos.
+static inline uint64_t sementePartida(const TreinoGenetico *tr, int jogo) {
+    return misturar64(tr->semente + ((uint64_t)tr->geracao * (uint64_t)tr->jogos + (uint64_t)jogo + 1) * PASSO_GERADOR);
+}
+
+// Joga uma partida com os pesos da busca; devolve as linhas feitas.
+static long jogarPartida(BuscaFeixe *b, uint64_t semente, int max_pecas, long *pecas) {
+    Sessao sessao;
+    Tabuleiro t;
+    Superficie s;
+    iniciarSessao(&sessao, semente);
+    tabuleiroLimpar(&t);
+    superficieCalcular(&s, &t);
+    long linhas = 0;
+    int jogadas = 0;
+    while (jogadas < max_pecas) {
+        Lance lance;
+        if (buscarLance(b, &sessao, &t, &s, &lance) == 0) {
+            break;
+        }
+        int feitas = executarLance(&sessao, &t, &s, &lance);
+        if (feitas < 0) {
+            break;
+        }
+        linhas += feitas;
+        jogadas++;
+    }
+    *pecas += jogadas;
+    return linhas;
+}
+
+typedef struct {
+    TreinoGenetico *treino;
+    int id;
+} ThreadTreino;
+
+static void *threadTreino(void *arg) {
+    ThreadTreino *c = arg;
+    TreinoGenetico *tr = c->treino;
+    BuscaFeixe *b = &tr->buscas[c->id];
+    int total = tr->populacao * tr->jogos;
+    long pecas = 0;
+    for (;;) {
+        int w = atomic_fetch_add(&tr->proxima, 1);
+        if (w >= total) {
+            break;
+        }
+        int i = w / tr->jogos, jogo = w % tr->jogos;
+        memcpy(b->pesos, tr->pesos[i], sizeof(PesosLinear));
+        tr->linhas[w] = (float)jogarPartida(b, sementePartida(tr, jogo), tr->max_pecas, &pecas);
+    }
+    atomic_fetch_add(&tr->pecas, pecas);
+    return NULL;
+}
+
+// Vencedor de um torneio entre GENETICO_TORNEIO indivíduos sorteados.
+static int torneio(const TreinoGenetico *tr, uint64_t *x) {
+    int melhor = -1;
+    for (int k = 0; k < GENETICO_TORNEIO; k++) {
+        int i = (int)(sortearUniforme(x) * tr->populacao);
+        if (melhor < 0 || tr->aptidao[i] > tr->aptidao[melhor] || (tr->aptidao[i] == tr->aptidao[melhor] && i < melhor)) {
+            melhor = i;
+        }
+    }
+    return melhor;
+}
+
+/**
+ * @brief Avalia a população em paralelo e gera a próxima.
+ *
+ * Depois da chamada, aptidao[] e ordem[] (do melhor para o pior) valem
+ * para a população avaliada, e pesos[] já é a nova.
+ *
+ * @return 0 em caso de sucesso, -1 se faltar memória.
+ */
+int treinoGeracao(TreinoGenetico *tr) {
+    atomic_store(&tr->proxima, 0);
+    pthread_t *threads = malloc(sizeof(pthread_t) * tr->num_threads);
+    ThreadTreino *contextos = calloc(tr->num_threads, sizeof(ThreadTreino));
+    if (!threads || !contextos) {
+        free(threads);
+        free(contextos);
+        return -1;
+    }
+    int criadas = 0;
+    for (; criadas < tr->num_threads - 1; criadas++) {
+        contextos[criadas + 1].treino = tr;
+        contextos[criadas + 1].id = criadas + 1;
+        if (pthread_create(&threads[criadas], NULL, threadTreino, &contextos[criadas + 1]) != 0) {
+            break;
+        }
+    }
+    contextos[0].treino = tr;
+    threadTreino(&contextos[0]);
+    for (int i = 0; i < criadas; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    free(contextos);
+
+    // aptidão e ordem (estável: no empate vence o índice menor)
+    for (int i = 0; i < tr->populacao; i++) {
+        float soma = 0;
+        for (int jogo = 0; jogo < tr->jogos; jogo++) {
+            soma += tr->linhas[i * tr->jogos + jogo];
+        }
+        tr->aptidao[i] = soma / tr->jogos;
+        int j = i;
+        while (j > 0 && tr->aptidao[tr->ordem[j - 1]] < tr->aptidao[i]) {
+            tr->ordem[j] = tr->ordem[j - 1];
+            j--;
+        }
+        tr->ordem[j] = i;
+    }
+    if (tr->aptidao[tr->ordem[0]] > tr->melhor_aptidao) {
+        tr->melhor_aptidao = tr->aptidao[tr->ordem[0]];
+        memcpy(tr->melhor_pesos, tr->pesos[tr->ordem[0]], sizeof(PesosLinear));
+    }
+
+    // elite intacta, o resto por torneio, cruzamento e mutação
+    uint64_t x = misturar64(tr->semente ^ misturar64((uint64_t)tr->geracao + 1));
+    int elite = tr->populacao / 8 > 0 ? tr->populacao / 8 : 1;
+    for (int i = 0; i < elite; i++) {
+        memcpy(tr->novos[i], tr->pesos[tr->ordem[i]], sizeof(PesosLinear));
+    }
+    for (int i = elite; i < tr->populacao; i++) {
+        int a = torneio(tr, &x), b = torneio(tr, &x);
+        float fa = tr->aptidao[a], fb = tr->aptidao[b];
+        if (fa + fb <= 0) {
+            fa = fb = 1;
+        }
+        for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+            tr->novos[i][k] = fa * tr->pesos[a][k] + fb * tr->pesos[b][k];
+        }
+        if (sortearUniforme(&x) * 100 < GENETICO_MUTACAO_PCT) {
+            normalizarPesos(tr->novos[i]);
+            int k = (int)(sortearUniforme(&x) * NUM_CARACTERISTICAS);
+            tr->novos[i][k] += (2.0f * sortearUniforme(&x) - 1.0f) * GENETICO_PASSO_MUTACAO;
+        }
+        normalizarPesos(tr->novos[i]);
+    }
+    PesosLinear *tmp = tr->pesos;
+    tr->pesos = tr->novos;
+    tr->novos = tmp;
+    tr->geracao++;
+    return 0;
+}
+
+
+// --- COMANDOS DE LINHA DE COMANDO ---
+
+static double segundosAgora(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Mede passos por segundo do ambiente vetorizado com ações aleatórias.
+ *
+ * Uso: tetris bench-ambiente [num_ambientes] [num_passos]
+ */
+static int comandoBenchAmbiente(int argc, char *argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : 1024;
+    int passos = argc > 2 ? atoi(argv[2]) : 10000;
+    if (n <= 0 || passos <= 0) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+
+    AmbienteVetorizado amb;
+    if (ambienteCriar(&amb, n, 1000) != 0) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+    uint64_t *sementes = malloc(sizeof(uint64_t) * n);
+    unsigned char *obs = malloc((size_t)n * OBS_TAMANHO);
+    unsigned char *acoes = malloc(n);
+    float *recompensas = malloc(sizeof(float) * n);
+    unsigned char *terminou = malloc(n);
+    if (!sementes || !obs || !acoes || !recompensas || !terminou) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+    for (int i = 0; i < n; i++) {
+        sementes[i] = (uint64_t)i;
+    }
+    ambienteResetar(&amb, sementes, obs);
+
+    // Ações de 1 a 5 sorteadas por um xorshift barato, fora da medição.
+    uint32_t x = 2463534242u;
+    double soma = 0.0;
+    double tempo = 0.0;
+    for (int t = 0; t < passos; t++) {
+        for (int i = 0; i < n; i++) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            acoes[i] = (unsigned char)(1 + (x >> 8) % 5);
+        }
+        double inicio = segundosAgora();
+        ambientePassar(&amb, acoes, obs, recompensas, terminou);
+        tempo += segundosAgora() - inicio;
+        soma += recompensas[t % n];
+    }
+
+    double total = (double)n * passos;
+    printf("%d ambientes x %d passos: %.3f s, %.1f M passos/s (checksum %.0f)\n",
+           n, passos, tempo, total / tempo / 1e6, soma);
+
+    free(sementes);
+    free(obs);
+    free(acoes);
+    free(recompensas);
+    free(terminou);
+    ambienteDestruir(&amb);
+    return 0;
+}
+
+/**
+ * @brief Resolve o jogo e grava a tabela de política ótima.
+ *
+ * Uso: tetris resolver [arquivo] [objetivo: jogar-i | i-disponivel] [gama]
+ */
+static int comandoResolver(int argc, char *argv[]) {
+    const char *caminho = argc > 1 ? argv[1] : "tabela.bin";
+    int objetivo = OBJETIVO_JOGAR_I;
+    if (argc > 2 && strcmp(argv[2], "i-disponivel") == 0) {
+        objetivo = OBJETIVO_I_DISPONIVEL;
+    } else if (argc > 2 && strcmp(argv[2], "jogar-i") != 0) {
+        fprintf(stderr, "Objetivo desconhecido: %s\n", argv[2]);
+        return 1;
+    }
+    float gama = argc > 3 ? (float)atof(argv[3]) : 0.9f;
+    if (gama <= 0.0f || gama >= 1.0f) {
+        fprintf(stderr, "Gama deve estar entre 0 e 1.\n");
+        return 1;
+    }
+
+    unsigned char *politica = malloc(NUM_CLASSES);
+    if (!politica) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+    double inicio = segundosAgora();
+    int iteracoes = resolverTabela(objetivo, gama, 1e-5f, 1000, politica);
+    if (iteracoes < 0) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        free(politica);
+        return 1;
+    }
+    printf("%ld estados (%ld classes de espelho) resolvidos em %d varreduras (%.2f s).\n",
+           NUM_ESTADOS, NUM_CLASSES, iteracoes, segundosAgora() - inicio);
+
+    if (salvarTabela(caminho, objetivo, gama, iteracoes, politica) != 0) {
+        fprintf(stderr, "Erro ao gravar %s\n", caminho);
+        free(politica);
+        return 1;
+    }
+    printf("Tabela gravada em %s\n", caminho);
+    free(politica);
+    return 0;
+}
+
+/**
+ * @brief Confere a bijeção rank/unrank em todos os estados e mede a vazão.
+ *
+ * Uso: tetris bench-indice [repeticoes]
+ */
+static int comandoBenchIndice(int argc, char *argv[]) {
+    int repeticoes = argc > 1 ? atoi(argv[1]) : 20;
+    if (repeticoes <= 0) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+    enum { LOTE = 4096 };
+    static uint32_t indices[LOTE], volta[LOTE];
+    static EstadoCompacto estados[LOTE];
+
+    long erros = 0;
+    double tempo = 0.0;
+    for (int r = 0; r < repeticoes; r++) {
+        for (long base = 0; base < NUM_ESTADOS; base += LOTE) {
+            int n = NUM_ESTADOS - base < LOTE ? (int)(NUM_ESTADOS - base) : LOTE;
+            for (int i = 0; i < n; i++) {
+                indices[i] = (uint32_t)(base + i);
+            }
+            double inicio = segundosAgora();
+            unrankLote(indices, estados, n);
+            rankLote(estados, volta, n);
+            tempo += segundosAgora() - inicio;
+            for (int i = 0; i < n; i++) {
+                erros += volta[i] != indices[i];
+            }
+        }
+    }
+    double total = (double)NUM_ESTADOS * repeticoes;
+    printf("%.0f idas e voltas em %.3f s: %.1f M/s, %ld erros\n",
+           total, tempo, total / tempo / 1e6, erros);
+    return erros != 0;
+}
+
+/**
+ * @brief Confere o acesso direto contra a geração sequencial e mede ambos.
+ *
+ * Uso: tetris bench-gerador [semente] [num_pecas]
+ */
+static int comandoBenchGerador(int argc, char *argv[]) {
+    uint64_t semente = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+    int n = argc > 2 ? atoi(argv[2]) : 10000000;
+    if (n <= 0) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+    uint8_t *sequencial = malloc(n);
+    uint8_t *direto = malloc(n);
+    if (!sequencial || !direto) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+
+    GeradorPecas g;
+    semearGerador(&g, semente);
+    double inicio = segundosAgora();
+    for (int i = 0; i < n; i++) {
+        sequencial[i] = (uint8_t)tipoDaLetra(gerarPecaDe(&g).nome);
+    }
+    double tempo_seq = segundosAgora() - inicio;
+
+    // Acesso direto em blocos fora de ordem, como fariam vários trabalhadores.
+    enum { BLOCO = 4096 };
+    int blocos = (n + BLOCO - 1) / BLOCO;
+    inicio = segundosAgora();
+    for (int b = blocos - 1; b >= 0; b--) {
+        int k0 = b * BLOCO;
+        int tam = n - k0 < BLOCO ? n - k0 : BLOCO;
+        tiposNoIntervalo(semente, (uint64_t)k0, direto + k0, tam);
+    }
+    double tempo_dir = segundosAgora() - inicio;
+
+    long erros = 0;
+    for (int i = 0; i < n; i++) {
+        erros += sequencial[i] != direto[i];
+    }
+    printf("%d pecas: sequencial %.1f M/s, acesso direto %.1f M/s, %ld divergencias\n",
+           n, n / tempo_seq / 1e6, n / tempo_dir / 1e6, erros);
+    printf("Peca 1000000000 da semente %llu: %c\n", (unsigned long long)semente,
+           pecaNaPosicao(semente, 1000000000).nome);
+
+    free(sequencial);
+    free(direto);
+    return erros != 0;
+}
+
+/**
+ * @brief Grava um replay de uma partida com ações legais sorteadas.
+ *
+ * Uso: tetris gerar-replay <arquivo> [semente] [turnos] [intervalo]
+ */
+static int comandoGerarReplay(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: tetris gerar-replay <arquivo> [semente] [turnos] [intervalo]\n");
+        return 1;
+    }
+    uint64_t semente = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    long turnos = argc > 3 ? atol(argv[3]) : 100000;
+    uint32_t intervalo = argc > 4 ? (uint32_t)atoi(argv[4]) : REPLAY_INTERVALO_PADRAO;
+
+    Sessao s;
+    iniciarSessao(&s, semente);
+    GravadorReplay g;
+    if (gravadorAbrir(&g, argv[1], &s, intervalo) != 0) {
+        fprintf(stderr, "Erro ao criar %s\n", argv[1]);
+        return 1;
+    }
+    // Sorteio das ações independente do gerador de peças da partida.
+    uint64_t x = misturar64(semente ^ 0xA5A5A5A5A5A5A5A5ULL);
+    for (long t = 0; t < turnos; t++) {
+        unsigned legais = acoesLegais(&s.fila, &s.pilha) & ~(1u << ACAO_SAIR);
+        int acao;
+        do {
+            x = misturar64(x + PASSO_GERADOR);
+            acao = 1 + (int)(x % 5);
+        } while (!((legais >> acao) & 1u));
+        aplicarAcaoSessao(&s, acao);
+        if (gravadorRegistrar(&g, acao, &s) != 0) {
+            fprintf(stderr, "Erro de escrita em %s\n", argv[1]);
+            gravadorFechar(&g);
+            return 1;
+        }
+    }
+    if (gravadorFechar(&g) != 0) {
+        fprintf(stderr, "Erro de escrita em %s\n", argv[1]);
+        return 1;
+    }
+    printf("Replay com %ld turnos gravado em %s\n", turnos, argv[1]);
+    return 0;
+}
+
+/**
+ * @brief Mostra o estado de um replay no início de um turno.
+ *
+ * Uso: tetris buscar <arquivo> <turno>
+ */
+static int comandoBuscar(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Uso: tetris buscar <arquivo> <turno>\n");
+        return 1;
+    }
+    Replay r;
+    if (replayAbrir(&r, argv[1]) != 0) {
+        fprintf(stderr, "Replay invalido: %s\n", argv[1]);
+        return 1;
+    }
+    uint64_t turno = strtoull(argv[2], NULL, 10);
+    Sessao s;
+    double inicio = segundosAgora();
+    int res = replayBuscar(&r, turno, &s);
+    double tempo = segundosAgora() - inicio;
+    if (res != 0) {
+        fprintf(stderr, "Turno fora do replay (0 a %llu).\n", (unsigned long long)r.num_turnos);
+        replayFechar(&r);
+        return 1;
+    }
+    printf("Turno %llu de %llu (busca em %.1f us)\n", (unsigned long long)turno,
+           (unsigned long long)r.num_turnos, tempo * 1e6);
+    exibirEstado(&s.fila, &s.pilha);
+    replayFechar(&r);
+    return 0;
+}
+
+/**
+ * @brief Verifica replays em paralelo pelos quadros-chave.
+ *
+ * Uso: tetris verificar [-j threads] <arquivo>...
+ */
+static int comandoVerificar(int argc, char *argv[]) {
+    int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int primeiro = 1;
+    if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+        num_threads = atoi(argv[2]);
+        primeiro = 3;
+    }
+    if (num_threads <= 0) {
+        num_threads = 1;
+    }
+    int n = argc - primeiro;
+    if (n <= 0) {
+        fprintf(stderr, "Uso: tetris verificar [-j threads] <arquivo>...\n");
+        return 1;
+    }
+
+    Replay *replays = malloc(sizeof(Replay) * n);
+    const char **nomes = malloc(sizeof(char *) * n);
+    uint64_t *divergencias = malloc(sizeof(uint64_t) * n);
+    uint64_t *primeira_falha = malloc(sizeof(uint64_t) * n);
+    if (!replays || !nomes || !divergencias || !primeira_falha) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+    int abertos = 0, invalidos = 0;
+    uint64_t turnos = 0;
+    for (int i = primeiro; i < argc; i++) {
+        if (replayAbrir(&replays[abertos], argv[i]) != 0) {
+            printf("%s: replay invalido\n", argv[i]);
+            invalidos++;
+            continue;
+        }
+        turnos += replays[abertos].num_turnos;
+        nomes[abertos++] = argv[i];
+    }
+
+    double inicio = segundosAgora();
+    if (verificarReplays(replays, abertos, num_threads, divergencias, primeira_falha) != 0) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+    double tempo = segundosAgora() - inicio;
+
+    int falhas = invalidos;
+    for (int i = 0; i < abertos; i++) {
+        if (divergencias[i]) {
+            printf("%s: %llu segmento(s) divergente(s), o primeiro comeca no turno %llu\n", nomes[i],
+                   (unsigned long long)divergencias[i], (unsigned long long)primeira_falha[i]);
+            falhas++;
+        }
+        replayFechar(&replays[i]);
+    }
+    printf("%d replay(s), %llu turnos, %d thread(s): %.3f s (%.1f M turnos/s), %d com falha\n",
+           abertos + invalidos, (unsigned long long)turnos, num_threads, tempo,
+           turnos / (tempo > 0 ? tempo : 1e-9) / 1e6, falhas);
+
+    free(replays);
+    free(nomes);
+    free(divergencias);
+    free(primeira_falha);
+    return falhas != 0;
+}
+
+/**
+ * @brief Acha o primeiro turno divergente entre dois replays, ou entre um
+ * replay e a reexecução pelo motor atual.
+ *
+ * Uso: tetris diferenca <a> [b]
+ */
+static int comandoDiferenca(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: tetris diferenca <replay_a> [replay_b]\n");
+        return 1;
+    }
+    Replay a, b;
+    if (replayAbrir(&a, argv[1]) != 0) {
+        fprintf(stderr, "Replay invalido: %s\n", argv[1]);
+        return 1;
+    }
+    int divergiu;
+    if (argc < 3) {
+        uint64_t turno;
+        divergiu = divergenciaAoVivo(&a, &turno);
+        if (divergiu) {
+            printf("O motor atual diverge do replay no turno %llu.\n", (unsigned long long)turno);
+        } else {
+            printf("O motor atual reproduz o replay inteiro.\n");
+        }
+    } else {
+        if (replayAbrir(&b, argv[2]) != 0) {
+            fprintf(stderr, "Replay invalido: %s\n", argv[2]);
+            replayFechar(&a);
+            return 1;
+        }
+        int64_t turno = primeiroTurnoDivergente(&a, &b);
+        if (turno == -2) {
+            fprintf(stderr, "Os replays usam intervalos de quadros diferentes.\n");
+        } else if (turno == -1) {
+            printf("Os replays coincidem nos turnos em comum.\n");
+        } else {
+            printf("Primeiro estado divergente: turno %lld\n", (long long)turno);
+            Sessao sa, sb;
+            replayBuscar(&a, (uint64_t)turno, &sa);
+            replayBuscar(&b, (uint64_t)turno, &sb);
+            printf("\n%s:", argv[1]);
+            exibirEstado(&sa.fila, &sa.pilha);
+            printf("\n%s:", argv[2]);
+            exibirEstado(&sb.fila, &sb.pilha);
+        }
+        replayFechar(&b);
+        divergiu = turno != -1;
+    }
+    replayFechar(&a);
+    return divergiu;
+}
+
+// Contexto da conferência de um replay compactado contra o original.
+typedef struct {
+    const Replay *original;
+    uint64_t divergencias;
+} ConferenciaCompactado;
+
+static int conferirBloco(void *contexto, uint64_t t0, const uint8_t *acoes, uint32_t n) {
+    ConferenciaCompactado *c = contexto;
+    for (uint32_t i = 0; i < n; i++) {
+        c->divergencias += t0 + i >= c->original->num_turnos
+                        || acoes[i] != replayAcao(c->original, t0 + i);
+    }
+    return 0;
+}
+
+// Bloco de um só símbolo, como as longas sequências de "jogar": o fluxo
+// deve ficar só com os estados iniciais e voltar igual.
+static int conferirBlocoUnico(void) {
+    uint32_t capacidade = 2 * RANS_BLOCO + 64;
+    uint8_t *acoes = malloc(RANS_BLOCO);
+    uint8_t *volta = malloc(RANS_BLOCO);
+    uint8_t *saida = malloc(capacidade);
+    int ok = acoes && volta && saida;
+    if (ok) {
+        memset(acoes, ACAO_JOGAR, RANS_BLOCO);
+        CabecalhoBlocoRans bloco;
+        memset(&bloco, 0, sizeof(bloco));
+        uint32_t tamanho = ransCodificar(acoes, RANS_BLOCO, &bloco, saida, capacidade);
+        ok = tamanho == 4 * RANS_ESTADOS && ransDecodificar(&bloco, saida, volta) == tamanho
+          && memcmp(acoes, volta, RANS_BLOCO) == 0;
+    }
+    free(acoes);
+    free(volta);
+    free(saida);
+    return ok;
+}
+
+static int contarBloco(void *contexto, uint64_t t0, const uint8_t *acoes, uint32_t n) {
+    (void)t0;
+    uint64_t *soma = contexto;
+    *soma += acoes[n - 1];
+    return 0;
+}
+
+/**
+ * @brief Compacta um replay e confere o resultado contra o original.
+ *
+ * Uso: tetris compactar <replay> <saida>
+ */
+static int comandoCompactar(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Uso: tetris compactar <replay> <saida>\n");
+        return 1;
+    }
+    Replay r;
+    if (replayAbrir(&r, argv[1]) != 0) {
+        fprintf(stderr, "Replay invalido: %s\n", argv[1]);
+        return 1;
+    }
+    double inicio = segundosAgora();
+    if (compactarReplay(&r, argv[2]) != 0) {
+        fprintf(stderr, "Erro ao gravar %s\n", argv[2]);
+        replayFechar(&r);
+        return 1;
+    }
+    double tempo_cod = segundosAgora() - inicio;
+
+    ReplayCompactado c;
+    if (compactadoAbrir(&c, argv[2]) != 0) {
+        fprintf(stderr, "Erro ao reabrir %s\n", argv[2]);
+        replayFechar(&r);
+        return 1;
+    }
+    ConferenciaCompactado conf = {&r, 0};
+    int res = compactadoLerAcoes(&c, conferirBloco, &conf);
+    int ok = res == 0 && conf.divergencias == 0 && c.cabecalho->num_turnos == r.num_turnos
+          && memcmp(c.inicial, replayQuadro(&r, 0), sizeof(QuadroChave)) == 0
+          && conferirBlocoUnico();
+
+    // Vazão de decodificação pura (sem a conferência)
+    uint64_t soma = 0;
+    inicio = segundosAgora();
+    compactadoLerAcoes(&c, contarBloco, &soma);
+    double tempo_dec = segundosAgora() - inicio;
+
+    printf("%llu acoes: %zu -> %zu bytes (%.3f bits/acao)\n", (unsigned long long)r.num_turnos,
+           r.tamanho, c.tamanho, c.tamanho * 8.0 / (r.num_turnos ? r.num_turnos : 1));
+    printf("Codificacao %.0f MB/s, decodificacao %.0f MB/s de acoes\n",
+           r.num_turnos / tempo_cod / 1e6, r.num_turnos / tempo_dec / 1e6);
+    printf("Conferencia: %s\n", ok ? "OK" : "FALHOU");
+
+    compactadoFechar(&c);
+    replayFechar(&r);
+    return !ok;
+}
+
+// Contexto da descompactação: reexecuta as ações gravando o replay.
+typedef struct {
+    Sessao sessao;
+    GravadorReplay gravador;
+    int erro;
+} Descompactacao;
+
+static int reexecutarBloco(void *contexto, uint64_t t0, const uint8_t *acoes, uint32_t n) {
+    (void)t0;
+    Descompactacao *d = contexto;
+    for (uint32_t i = 0; i < n; i++) {
+        aplicarAcaoSessao(&d->sessao, acoes[i]);
+        if (gravadorRegistrar(&d->gravador, acoes[i], &d->sessao) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Reconstrói o replay original a partir do compactado.
+ *
+ * Uso: tetris descompactar <compactado> <saida>
+ */
+static int comandoDescompactar(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Uso: tetris descompactar <compactado> <saida>\n");
+        return 1;
+    }
+    ReplayCompactado c;
+    if (compactadoAbrir(&c, argv[1]) != 0) {
+        fprintf(stderr, "Arquivo compactado invalido: %s\n", argv[1]);
+        return 1;
+    }
+    Descompactacao d;
+    restaurarQuadro(c.inicial, &d.sessao);
+    if (gravadorAbrir(&d.gravador, argv[2], &d.sessao, c.cabecalho->intervalo) != 0) {
+        fprintf(stderr, "Erro ao criar %s\n", argv[2]);
+        compactadoFechar(&c);
+        return 1;
+    }
+    int res = compactadoLerAcoes(&c, reexecutarBloco, &d);
+    int ok = gravadorFechar(&d.gravador) == 0 && res == 0;
+    if (!ok) {
+        fprintf(stderr, "Erro ao descompactar %s\n", argv[1]);
+    }
+    compactadoFechar(&c);
+    return !ok;
+}
+
+/**
+ * @brief Indexa replays para consultas de padrões.
+ *
+ * Uso: tetris indexar <indice> <replay>...
+ */
+static int comandoIndexar(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Uso: tetris indexar <indice> <replay>...\n");
+        return 1;
+    }
+    int n = argc - 2;
+    Replay *replays = calloc(n, sizeof(Replay));
+    const char **nomes = malloc(sizeof(char *) * n);
+    if (!replays || !nomes) {
+        free(replays);
+        free(nomes);
+        return 1;
+    }
+    int abertos = 0;
+    uint64_t turnos = 0;
+    for (int i = 0; i < n; i++) {
+        if (replayAbrir(&replays[abertos], argv[i + 2]) != 0) {
+            fprintf(stderr, "Replay invalido, ignorado: %s\n", argv[i + 2]);
+            continue;
+        }
+        turnos += replays[abertos].num_turnos;
+        nomes[abertos++] = argv[i + 2];
+    }
+
+    double t0 = segundosAgora();
+    int res = indexarReplays(replays, nomes, abertos, argv[1]);
+    double tempo = segundosAgora() - t0;
+    if (res == 0) {
+        printf("%d replay(s), %llu turnos indexados em %.3f s\n", abertos, (unsigned long long)turnos, tempo);
+    } else {
+        fprintf(stderr, "Erro ao gravar o indice %s\n", argv[1]);
+    }
+    for (int i = 0; i < abertos; i++) {
+        replayFechar(&replays[i]);
+    }
+    free(replays);
+    free(nomes);
+    return res != 0;
+}
+
+// Letra (ou '*') -> conjunto de tipos; -1 se inválida. '-' é "sem peça".
+static int64_t conjuntoDoTipo(char c, int aceitaSemPeca) {
+    if (c == '*') {
+        return aceitaSemPeca ? 0xFF : (1 << NUM_TIPOS) - 1;
+    }
+    if (c == '-' && aceitaSemPeca) {
+        return 1 << NGRAMA_SEM_PECA;
+    }
+    const char *p = c ? strchr(TIPOS_PECA, c) : NULL;
+    return p ? (int64_t)1 << (p - TIPOS_PECA) : -1;
+}
+
+// Evento "<acao><tipo>", com '*' em qualquer posição ("2I", "3*", "*I", "*").
+static int lerSimboloEvento(const char *txt, SimboloPadrao *simbolo) {
+    if (strcmp(txt, "*") == 0) {
+        txt = "**";
+    }
+    if (strlen(txt) != 2) {
+        return -1;
+    }
+    int64_t tipos = conjuntoDoTipo(txt[1], 1);
+    if (tipos < 0 || !(txt[0] == '*' || (txt[0] >= '0' && txt[0] < '0' + NUM_ACOES))) {
+        return -1;
+    }
+    *simbolo = 0;
+    for (int a = 0; a < NUM_ACOES; a++) {
+        if (txt[0] == '*' || txt[0] == '0' + a) {
+            *simbolo |= (SimboloPadrao)tipos << (a * 8);
+        }
+    }
+    return 0;
+}
+
+#define NGRAMA_PADRAO_MAX 64
+
+typedef struct {
+    const IndiceNgrama *indice;
+    int pecas;
+    SimboloPadrao simbolos[NGRAMA_PADRAO_MAX]; // 0 marca uma lacuna
+    int lacunas[NGRAMA_PADRAO_MAX];           // tamanho máximo de cada lacuna
+    int num_simbolos;
+    ResultadoNgrama total;
+} ConsultaNgrama;
+
+// Expande as lacunas "~n" (0 a n símbolos quaisquer) e consulta cada padrão.
+static int consultarExpandindo(ConsultaNgrama *c, int i, SimboloPadrao *padrao, int n) {
+    for (; i < c->num_simbolos && c->simbolos[i] != 0; i++) {
+        if (n == NGRAMA_PADRAO_MAX) {
+            return -1;
+        }
+        padrao[n++] = c->simbolos[i];
+    }
+    if (i == c->num_simbolos) {
+        ResultadoNgrama res;
+        if (consultarNgrama(c->indice, c->pecas, padrao, n, &res) != 0) {
+            free(res.posicoes);
+            return -1;
+        }
+        for (uint64_t j = 0; j < res.quantidade; j++) {
+            if (adicionarResultado(&c->total, res.posicoes[j]) != 0) {
+                free(res.posicoes);
+                return -1;
+            }
+        }
+        free(res.posicoes);
+        return 0;
+    }
+    SimboloPadrao qualquer = c->pecas ? (1u << NUM_TIPOS) - 1 : ((SimboloPadrao)1 << NGRAMA_EVENTOS) - 1;
+    for (int k = 0; k <= c->lacunas[i]; k++) {
+        if (n + k > NGRAMA_PADRAO_MAX) {
+            return -1;
+        }
+        for (int j = 0; j < k; j++) {
+            padrao[n + j] = qualquer;
+        }
+        if (consultarExpandindo(c, i + 1, padrao, n + k) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Procura um padrão de eventos ou de peças no índice.
+ *
+ * Eventos são "<acao><peca>" ("2I" = reservou um I, "3I" = usou um I da
+ * reserva, "3-" = tentou usar a reserva vazia), com '*' como curinga.
+ * Peças são letras ou '*', separadas ou juntas ("S Z S" ou "SZS").
+ * "~n" aceita de 0 a n símbolos quaisquer naquele ponto.
+ *
+ * Uso: tetris consultar <indice> eventos|pecas <simbolo>...
+ */
+static int comandoConsultar(int argc, char *argv[]) {
+    if (argc < 4 || (strcmp(argv[2], "eventos") != 0 && strcmp(argv[2], "pecas") != 0)) {
+        fprintf(stderr, "Uso: tetris consultar <indice> eventos|pecas <simbolo>...\n");
+        fprintf(stderr, "Ex.: tetris consultar idx.ng eventos 2I ~2 3I\n");
+        fprintf(stderr, "     tetris consultar idx.ng pecas SZS\n");
+        return 1;
+    }
+    IndiceNgrama indice;
+    if (indiceNgramaAbrir(&indice, argv[1]) != 0) {
+        fprintf(stderr, "Indice invalido: %s\n", argv[1]);
+        return 1;
+    }
+    ConsultaNgrama c;
+    memset(&c, 0, sizeof(c));
+    c.indice = &indice;
+    c.pecas = strcmp(argv[2], "pecas") == 0;
+    int valido = 1;
+    for (int i = 3; i < argc && valido; i++) {
+        const char *txt = argv[i];
+        if (txt[0] == '~') {
+            valido = c.num_simbolos < NGRAMA_PADRAO_MAX && txt[1] != '\0';
+            if (valido) {
+                c.lacunas[c.num_simbolos++] = atoi(txt + 1);
+            }
+        } else if (c.pecas) {
+            for (; *txt && valido; txt++) {
+                int64_t tipos = conjuntoDoTipo(*txt, 0);
+                valido = tipos > 0 && c.num_simbolos < NGRAMA_PADRAO_MAX;
+                if (valido) {
+                    c.simbolos[c.num_simbolos++] = (SimboloPadrao)tipos;
+                }
+            }
+        } else {
+            valido = c.num_simbolos < NGRAMA_PADRAO_MAX && lerSimboloEvento(txt, &c.simbolos[c.num_simbolos]) == 0;
+            c.num_simbolos += valido;
+        }
+    }
+    if (!valido) {
+        fprintf(stderr, "Padrao invalido.\n");
+        indiceNgramaFechar(&indice);
+        return 1;
+    }
+
+    double t0 = segundosAgora();
+    SimboloPadrao padrao[NGRAMA_PADRAO_MAX];
+    int res = consultarExpandindo(&c, 0, padrao, 0);
+    // Com lacunas, o mesmo início pode casar com mais de uma expansão
+    uint64_t distintos = 0;
+    if (res == 0 && c.total.quantidade > 0) {
+        qsort(c.total.posicoes, c.total.quantidade, sizeof(uint64_t), compararU64);
+        distintos = 1;
+        for (uint64_t j = 1; j < c.total.quantidade; j++) {
+            if (c.total.posicoes[j] != c.total.posicoes[distintos - 1]) {
+                c.total.posicoes[distintos++] = c.total.posicoes[j];
+            }
+        }
+    }
+    double tempo = segundosAgora() - t0;
+    if (res != 0) {
+        fprintf(stderr, "Padrao longo demais ou memoria insuficiente.\n");
+    } else {
+        uint64_t anterior = UINT64_MAX;
+        uint64_t partidas = 0;
+        for (uint64_t j = 0; j < distintos; j++) {
+            uint64_t pos = c.total.posicoes[j];
+            int r = replayDaPosicao(&indice, c.pecas, pos);
+            uint64_t local = pos - (c.pecas ? indice.replays[r].inicio_pecas : indice.replays[r].inicio_eventos);
+            partidas += (uint64_t)r != anterior;
+            anterior = (uint64_t)r;
+            if (j < 20) {
+                printf("%s: %s %llu\n", indice.nomes + indice.replays[r].pos_nome,
+                       c.pecas ? "peca" : "turno", (unsigned long long)local);
+            }
+        }
+        if (distintos > 20) {
+            printf("... mais %llu\n", (unsigned long long)(distintos - 20));
+        }
+        printf("%llu ocorrencia(s) em %llu replay(s), %.3f ms\n", (unsigned long long)distintos,
+               (unsigned long long)partidas, tempo * 1e3);
+    }
+    free(c.total.posicoes);
+    indiceNgramaFechar(&indice);
+    return res != 0;
+}
+
+// Acrescenta os caminhos de um arquivo-lista (um por linha) a 'caminhos'.
+static int lerListaArquivos(const char *lista, char ***caminhos, uint64_t *n, uint64_t *capacidade) {
+    FILE *arq = fopen(lista, "r");
+    if (!arq) {
+        return -1;
+    }
+    char linha[4096];
+    while (fgets(linha, sizeof(linha), arq)) {
+        linha[strcspn(linha, "\r\n")] = '\0';
+        if (linha[0] == '\0') {
+            continue;
+        }
+        if (*n == *capacidade) {
+            *capacidade = *capacidade ? *capacidade * 2 : 1024;
+            char **novo = realloc(*caminhos, sizeof(char *) * *capacidade);
+            if (!novo) {
+                fclose(arq);
+                return -1;
+            }
+            *caminhos = novo;
+        }
+        (*caminhos)[(*n)++] = strdup(linha);
+    }
+    fclose(arq);
+    return 0;
+}
+
+/**
+ * @brief Estatísticas agregadas de muitos replays, em paralelo.
+ *
+ * "@lista" lê os caminhos de um arquivo, um por linha, para acervos
+ * grandes demais para a linha de comando.
+ *
+ * Uso: tetris analisar [-j threads] <saida> <replay|@lista>...
+ */
+static int comandoAnalisar(int argc, char *argv[]) {
+    int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int primeiro = 1;
+    if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+        num_threads = atoi(argv[2]);
+        primeiro = 3;
+    }
+    if (num_threads <= 0) {
+        num_threads = 1;
+    }
+    if (argc - primeiro < 2) {
+        fprintf(stderr, "Uso: tetris analisar [-j threads] <saida> <replay|@lista>...\n");
+        return 1;
+    }
+
+    char **caminhos = NULL;
+    uint64_t n = 0, capacidade = 0;
+    for (int i = primeiro + 1; i < argc; i++) {
+        if (argv[i][0] == '@') {
+            if (lerListaArquivos(argv[i] + 1, &caminhos, &n, &capacidade) != 0) {
+                fprintf(stderr, "Erro ao ler a lista %s\n", argv[i] + 1);
+                return 1;
+            }
+            continue;
+        }
+        if (n == capacidade) {
+            capacidade = capacidade ? capacidade * 2 : 1024;
+            char **novo = realloc(caminhos, sizeof(char *) * capacidade);
+            if (!novo) {
+                fprintf(stderr, "Memoria insuficiente.\n");
+                return 1;
+            }
+            caminhos = novo;
+        }
+        caminhos[n++] = strdup(argv[i]);
+    }
+
+    EstatisticasReplay *linhas = malloc(sizeof(EstatisticasReplay) * (n ? n : 1));
+    EstatisticasReplay total;
+    double inicio = segundosAgora();
+    if (!linhas || analisarReplays((const char *const *)caminhos, n, num_threads, linhas, &total) != 0) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+    double tempo = segundosAgora() - inicio;
+    int ok = salvarAnalise(argv[primeiro], (const char *const *)caminhos, linhas, n) == 0;
+    if (!ok) {
+        fprintf(stderr, "Erro ao gravar %s\n", argv[primeiro]);
+    }
+
+    double turnos = total.turnos ? (double)total.turnos : 1.0;
+    printf("%llu de %llu replay(s), %llu turnos, %d thread(s): %.3f s (%.1f M turnos/s)\n",
+           (unsigned long long)total.valido, (unsigned long long)n, (unsigned long long)total.turnos,
+           num_threads, tempo, total.turnos / (tempo > 0 ? tempo : 1e-9) / 1e6);
+    for (int a = 0; a < NUM_ACOES; a++) {
+        printf("  %-16s %6.2f%%\n", COLUNAS_ANALISE[2 + a], 100.0 * total.acoes[a] / turnos);
+    }
+    printf("  %-16s %6.2f%%\n", "ilegais", 100.0 * total.ilegais / turnos);
+    printf("Uso da reserva: %.4f por turno\n", total.acoes[ACAO_USAR_RESERVA] / turnos);
+    printf("Trocas triplas: %.4f por turno\n", total.acoes[ACAO_TROCA_MULTIPLA] / turnos);
+    printf("Ocupacao media da reserva: %.3f pecas (maxima %llu)\n", total.soma_ocupacao / turnos,
+           (unsigned long long)total.ocupacao_maxima);
+
+    for (uint64_t i = 0; i < n; i++) {
+        free(caminhos[i]);
+    }
+    free(caminhos);
+    free(linhas);
+    return !ok;
+}
+
+/**
+ * @brief Grava uma sequência de peças e confere a leitura pelo mmap.
+ *
+ * Uso: tetris materializar <arquivo> <semente> <pecas>
+ */
+static int comandoMaterializar(int argc, char *argv[]) {
+    if (argc < 4) {
+        fprintf(stderr, "Uso: tetris materializar <arquivo> <semente> <pecas>\n");
+        return 1;
+    }
+    uint64_t semente = strtoull(argv[2], NULL, 10);
+    long long pedidas = atoll(argv[3]);
+    if (pedidas <= 0 || pedidas > INT32_MAX) {
+        fprintf(stderr, "Quantidade de pecas invalida.\n");
+        return 1;
+    }
+    int n = (int)pedidas;
+    double inicio = segundosAgora();
+    if (materializarSequencia(argv[1], semente, (uint64_t)n) != 0) {
+        fprintf(stderr, "Erro ao gravar %s\n", argv[1]);
+        return 1;
+    }
+    double tempo_grav = segundosAgora() - inicio;
+
+    SequenciaPecas seq;
+    if (sequenciaAbrir(&seq, argv[1]) != 0) {
+        fprintf(stderr, "Erro ao mapear %s\n", argv[1]);
+        return 1;
+    }
+    GeradorPecas lido, calculado;
+    semearGerador(&lido, semente);
+    usarSequencia(&lido, &seq);
+    semearGerador(&calculado, semente);
+
+    long erros = 0;
+    uint64_t soma = 0;
+    inicio = segundosAgora();
+    for (int i = 0; i < n; i++) {
+        soma += (unsigned char)gerarPecaDe(&lido).nome;
+    }
+    double tempo_mmap = segundosAgora() - inicio;
+    inicio = segundosAgora();
+    for (int i = 0; i < n; i++) {
+        soma -= (unsigned char)gerarPecaDe(&calculado).nome;
+    }
+    double tempo_calc = segundosAgora() - inicio;
+    semearGerador(&calculado, semente);
+    for (int i = 0; i < n; i++) {
+        erros += tipoNaSequencia(seq.palavras, (uint64_t)i) != tipoDaLetra(gerarPecaDe(&calculado).nome);
+    }
+    printf("%d pecas da semente %llu em %s (%zu bytes), gravadas em %.3f s\n", n, (unsigned long long)semente,
+           argv[1], seq.tamanho, tempo_grav);
+    printf("Leitura pelo mmap %.1f M/s, calculo %.1f M/s, %ld divergencias\n",
+           n / tempo_mmap / 1e6, n / tempo_calc / 1e6, erros + (soma != 0));
+    sequenciaFechar(&seq);
+    return erros != 0 || soma != 0;
+}
+
+typedef struct {
+    PoolSessoes *pool;
+    LogAcoes *log;
+    int primeira;   // sessões primeira .. ultima - 1
+    int ultima;
+    long acoes;     // por sessão
+} TrabalhoLog;
+
+// Thread de jogo: dona de um intervalo de sessões, joga ações sorteadas.
+static void *threadJogoLog(void *arg) {
+    TrabalhoLog *t = arg;
+    uint64_t x = misturar64((uint64_t)t->primeira + 1);
+    for (long k = 0; k < t->acoes; k++) {
+        for (int i = t->primeira; i < t->ultima; i++) {
+            Sessao *s = &t->pool->sessoes[i];
+            unsigned legais = acoesLegais(&s->fila, &s->pilha) & ~(1u << ACAO_SAIR);
+            int acao;
+            do {
+                x = misturar64(x + PASSO_GERADOR);
+                acao = 1 + (int)(x % 5);
+            } while (!((legais >> acao) & 1u));
+            poolAplicar(t->pool, t->log, i, acao);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Simula sessões hospedadas registrando cada ação no log.
+ *
+ * Retoma o log (e o checkpoint) se já existirem, então rodadas seguidas
+ * acrescentam ações às mesmas sessões; o hash final deve bater com o de
+ * "tetris recuperar". Com um checkpoint, uma thread de fundo grava as
+ * páginas alteradas a cada 'intervalo_ms' enquanto as sessões jogam.
+ *
+ * Uso: tetris bench-log <log> [sessoes] [acoes] [threads] [intervalo_us]
+ *                      [checkpoint] [intervalo_ms]
+ */
+static int comandoBenchLog(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: tetris bench-log <log> [sessoes] [acoes] [threads] [intervalo_us] "
+                        "[checkpoint] [intervalo_ms]\n");
+        return 1;
+    }
+    int sessoes = argc > 2 ? atoi(argv[2]) : 4096;
+    long acoes = argc > 3 ? atol(argv[3]) : 256;
+    int num_threads = argc > 4 ? atoi(argv[4]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    long intervalo_us = argc > 5 ? atol(argv[5]) : LOG_INTERVALO_PADRAO_US;
+    const char *checkpoint = argc > 6 ? argv[6] : NULL;
+    long intervalo_ms = argc > 7 ? atol(argv[7]) : CHECKPOINT_INTERVALO_PADRAO_MS;
+    if (sessoes <= 0 || acoes < 0 || num_threads <= 0) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+
+    PoolSessoes pool;
+    Recuperacao rec;
+    double inicio = segundosAgora();
+    int temCheckpoint = checkpoint && access(checkpoint, F_OK) == 0;
+    if (recuperarPool(&pool, sessoes, argv[1], temCheckpoint ? checkpoint : NULL, &rec) != 0) {
+        fprintf(stderr, "Checkpoint ou log invalido.\n");
+        return 1;
+    }
+    if (rec.aplicados > 0 || rec.ignorados > 0) {
+        printf("Retomado em %.3f s: %llu registros do log aplicados, %d sessoes\n", segundosAgora() - inicio,
+               (unsigned long long)rec.aplicados, pool.num_sessoes);
+    }
+    LogAcoes log;
+    if (logAbrir(&log, argv[1], pool.num_sessoes, intervalo_us) != 0) {
+        fprintf(stderr, "Erro ao abrir o log %s\n", argv[1]);
+        poolDestruir(&pool);
+        return 1;
+    }
+    for (int i = 0; i < pool.num_sessoes; i++) {
+        if (pool.lsn[i] == 0) {
+            poolIniciarSessao(&pool, &log, i, misturar64((uint64_t)i));
+        }
+    }
+
+    if (num_threads > pool.num_sessoes) {
+        num_threads = pool.num_sessoes;
+    }
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+    TrabalhoLog *trabalhos = malloc(sizeof(TrabalhoLog) * num_threads);
+    if (!threads || !trabalhos) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+    Checkpointer ck;
+    if (checkpoint && (checkpointAbrir(&ck, checkpoint, &pool, &log, 0) != 0
+                       || checkpointIniciar(&ck, intervalo_ms) != 0)) {
+        fprintf(stderr, "Erro ao abrir o checkpoint %s\n", checkpoint);
+        return 1;
+    }
+    uint64_t registros_antes = log.registros;
+    inicio = segundosAgora();
+    int criadas = 0;
+    for (; criadas < num_threads; criadas++) {
+        int primeira = (int)((long long)pool.num_sessoes * criadas / num_threads);
+        int ultima = (int)((long long)pool.num_sessoes * (criadas + 1) / num_threads);
+        trabalhos[criadas] = (TrabalhoLog){&pool, &log, primeira, ultima, acoes};
+        if (pthread_create(&threads[criadas], NULL, threadJogoLog, &trabalhos[criadas]) != 0) {
+            break;
+        }
+    }
+    if (criadas == 0) {
+        trabalhos[0] = (TrabalhoLog){&pool, &log, 0, pool.num_sessoes, acoes};
+        threadJogoLog(&trabalhos[0]);
+    }
+    for (int i = 0; i < criadas; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double tempo = segundosAgora() - inicio;
+    int ok = 1;
+    if (checkpoint) {
+        double t0 = segundosAgora();
+        ok = checkpointParar(&ck) == 0;
+        printf("Checkpoint: %llu rodadas, %llu paginas gravadas, ultima rodada em %.3f s\n",
+               (unsigned long long)ck.rodadas, (unsigned long long)ck.paginas_gravadas, segundosAgora() - t0);
+        checkpointFechar(&ck);
+    }
+    ok = logFechar(&log) == 0 && ok;
+
+    uint64_t registros = log.registros - registros_antes;
+    printf("%d sessoes, %d thread(s), fsync a cada %ld us: %llu registros em %.3f s (%.2f M/s)\n",
+           pool.num_sessoes, criadas ? criadas : 1, intervalo_us, (unsigned long long)registros, tempo,
+           registros / (tempo > 0 ? tempo : 1e-9) / 1e6);
+    printf("%llu lotes com fsync, %.0f registros por lote, %.1f MB gravados\n", (unsigned long long)log.lotes,
+           log.lotes ? (double)log.registros / log.lotes : 0.0, log.bytes_gravados / 1e6);
+    printf("Hash do pool: %016llx\n", (unsigned long long)hashPool(&pool));
+    if (!ok) {
+        fprintf(stderr, "Erro de escrita no log ou no checkpoint.\n");
+    }
+    free(threads);
+    free(trabalhos);
+    poolDestruir(&pool);
+    return !ok;
+}
+
+/**
+ * @brief Reconstrói as sessões a partir do checkpoint e do log.
+ *
+ * Uso: tetris recuperar <log> [checkpoint|-] [novo_checkpoint]
+ */
+static int comandoRecuperar(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: tetris recuperar <log> [checkpoint|-] [novo_checkpoint]\n");
+        return 1;
+    }
+    const char *checkpoint = argc > 2 && strcmp(argv[2], "-") != 0 ? argv[2] : NULL;
+    PoolSessoes pool;
+    Recuperacao rec;
+    double inicio = segundosAgora();
+    if (recuperarPool(&pool, 0, argv[1], checkpoint, &rec) != 0) {
+        fprintf(stderr, "Checkpoint ou log invalido.\n");
+        return 1;
+    }
+    double tempo = segundosAgora() - inicio;
+    printf("%d sessoes recuperadas em %.3f s: %llu registros aplicados, %llu ja no checkpoint\n",
+           pool.num_sessoes, tempo, (unsigned long long)rec.aplicados, (unsigned long long)rec.ignorados);
+    if (rec.lacunas) {
+        printf("Aviso: %llu registro(s) fora de sequencia ignorados\n", (unsigned long long)rec.lacunas);
+    }
+    if (rec.bytes_cortados) {
+        printf("Registro incompleto no fim do log: %llu bytes cortados\n", (unsigned long long)rec.bytes_cortados);
+    }
+    printf("Hash do pool: %016llx\n", (unsigned long long)hashPool(&pool));
+    int ok = 1;
+    if (argc > 3) {
+        ok = salvarCheckpoint(&pool, argv[3], rec.tamanho_log) == 0;
+        if (!ok) {
+            fprintf(stderr, "Erro ao gravar o checkpoint %s\n", argv[3]);
+        }
+    }
+    poolDestruir(&pool);
+    return !ok;
+}
+
+/**
+ * @brief Confere e mede a detecção e a remoção de linhas cheias.
+ *
+ * Uso: tetris bench-linhas [tabuleiros] [repeticoes]
+ */
+static int comandoBenchLinhas(int argc, char *argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : 65536;
+    int repeticoes = argc > 2 ? atoi(argv[2]) : 50;
+    if (n <= 0 || repeticoes <= 0) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+    Tabuleiro *tabs = malloc(sizeof(Tabuleiro) * n);
+    Tabuleiro *copia = malloc(sizeof(Tabuleiro) * n);
+    uint32_t *lote = malloc(sizeof(uint32_t) * n);
+    if (!tabs || !copia || !lote) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+    // Tabuleiros sorteados até uma altura qualquer, com ~1/4 das linhas cheias.
+    uint64_t x = 12345;
+    for (int i = 0; i < n; i++) {
+        tabuleiroLimpar(&tabs[i]);
+        x = misturar64(x + PASSO_GERADOR);
+        int altura = (int)(x % (TABULEIRO_VISIVEL + 1));
+        for (int y = 0; y < altura; y++) {
+            x = misturar64(x + PASSO_GERADOR);
+            uint16_t buracos = (x & 3) == 0 ? 0 : (uint16_t)((1u << (x >> 8) % TABULEIRO_LARGURA) << TABULEIRO_PAREDE);
+            tabs[i].linhas[TABULEIRO_BORDA + y] = (uint16_t)(LINHA_CHEIA & ~buracos);
+        }
+    }
+
+    long erros = 0;
+    linhasCheiasLote(tabs, lote, n);
+    for (int i = 0; i < n; i++) {
+        erros += lote[i] != linhasCheiasEscalar(&tabs[i]) || linhasCheias(&tabs[i]) != lote[i];
+    }
+
+    volatile uint32_t soma = 0;
+    double inicio = segundosAgora();
+    for (int r = 0; r < repeticoes; r++) {
+        uint32_t s = 0;
+        for (int i = 0; i < n; i++) {
+            s += linhasCheiasEscalar(&tabs[i]);
+        }
+        soma += s;
+    }
+    double t_escalar = segundosAgora() - inicio;
+    inicio = segundosAgora();
+    for (int r = 0; r < repeticoes; r++) {
+        uint32_t s = 0;
+        for (int i = 0; i < n; i++) {
+            s += linhasCheias(&tabs[i]);
+        }
+        soma += s;
+    }
+    double t_sse2 = segundosAgora() - inicio;
+    inicio = segundosAgora();
+    for (int r = 0; r < repeticoes; r++) {
+        linhasCheiasLote(tabs, lote, n);
+        soma += lote[r % n];
+    }
+    double t_lote = segundosAgora() - inicio;
+
+    double t_limpar = 0;
+    long removidas = 0;
+    for (int r = 0; r < repeticoes; r++) {
+        memcpy(copia, tabs, sizeof(Tabuleiro) * n);
+        inicio = segundosAgora();
+        for (int i = 0; i < n; i++) {
+            removidas += limparLinhas(&copia[i]);
+        }
+        t_limpar += segundosAgora() - inicio;
+    }
+    // Confere a remoção contra a definição: as linhas restantes, em ordem.
+    for (int i = 0; i < n; i++) {
+        int w = 0;
+        for (int y = 0; y < TABULEIRO_ALTURA; y++) {
+            uint16_t l = tabs[i].linhas[TABULEIRO_BORDA + y];
+            if (l != LINHA_CHEIA) {
+                erros += copia[i].linhas[TABULEIRO_BORDA + w++] != l;
+            }
+        }
+        for (; w < TABULEIRO_ALTURA; w++) {
+            erros += copia[i].linhas[TABULEIRO_BORDA + w] != LINHA_VAZIA;
+        }
+    }
+
+    double total = (double)n * repeticoes;
+    double gb = total * sizeof(Tabuleiro) / 1e9;
+    printf("%d tabuleiros x %d: escalar %.1f M/s, SSE2 %.1f M/s, lote %.1f M/s (%.1f GB/s)\n", n, repeticoes,
+           total / t_escalar / 1e6, total / t_sse2 / 1e6, total / t_lote / 1e6, gb / t_lote);
+    printf("Limpeza: %.1f M tabuleiros/s, %.2f linhas por tabuleiro, %ld divergencias\n",
+           total / t_limpar / 1e6, (double)removidas / total, erros);
+    free(tabs);
+    free(copia);
+    free(lote);
+    return erros != 0;
+}
+
+/**
+ * @brief Confere e mede a avaliação em lote contra a avaliação por candidato.
+ *
+ * Uso: tetris bench-avaliacao [tabuleiros] [repeticoes]
+ */
+static int comandoBenchAvaliacao(int argc, char *argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : 1024;
+    int repeticoes = argc > 2 ? atoi(argv[2]) : 500;
+    if (n <= 0 || repeticoes <= 0) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+    const int por_tabuleiro = 2 * MAX_COLOCACOES;
+    LoteCandidatos *lotes = malloc(sizeof(LoteCandidatos) * n);
+    Caracteristicas *cars = malloc(sizeof(Caracteristicas) * por_tabuleiro * (size_t)n);
+    if (!lotes || !cars) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+
+    // Tabuleiros de meio de jogo: jogadas sorteadas a partir do vazio. Em
+    // cada um, os candidatos são as colocações da peça da frente e da reserva.
+    uint64_t x = 2024;
+    long candidatos = 0;
+    double t_enumerar = 0;
+    for (int b = 0; b < n; b++) {
+        Tabuleiro t;
+        Superficie s;
+        Colocacao col[MAX_COLOCACOES];
+        tabuleiroLimpar(&t);
+        superficieCalcular(&s, &t);
+        x = misturar64(x + PASSO_GERADOR);
+        int jogadas = (int)(x % 24);
+        for (int k = 0; k < jogadas; k++) {
+            x = misturar64(x + PASSO_GERADOR);
+            int tipo = (int)(x % NUM_TIPOS);
+            int m = enumerarColocacoes(&t, &s, tipo, col);
+            if (m == 0) {
+                break;
+            }
+            const Colocacao *c = &col[(x >> 32) % m];
+            colocarPecaSuperficie(&t, &s, tipo, c->rot, c->x, c->y);
+        }
+        Colocacao col2[MAX_COLOCACOES];
+        x = misturar64(x + PASSO_GERADOR);
+        int tipo = (int)(x % NUM_TIPOS), tipo2 = (int)((x >> 32) % NUM_TIPOS);
+        double inicio = segundosAgora();
+        int m = enumerarColocacoes(&t, &s, tipo, col);
+        int m2 = enumerarColocacoes(&t, &s, tipo2, col2);
+        t_enumerar += segundosAgora() - inicio;
+        if (loteCriar(&lotes[b], m + m2) != 0) {
+            fprintf(stderr, "Memoria insuficiente.\n");
+            return 1;
+        }
+        inicio = segundosAgora();
+        loteColocacoes(&lotes[b], &t, &s, tipo, col, m);
+        loteColocacoes(&lotes[b], &t, &s, tipo2, col2, m2);
+        t_enumerar += segundosAgora() - inicio;
+        for (int i = 0; i < lotes[b].n; i++) {
+            Caracteristicas *c = &cars[(size_t)b * por_tabuleiro + i];
+            c->linhas = lotes[b].car[CAR_LINHAS][i];
+            c->soma_alturas = lotes[b].car[CAR_SOMA_ALTURAS][i];
+            c->altura_max = lotes[b].car[CAR_ALTURA_MAX][i];
+            c->buracos = lotes[b].car[CAR_BURACOS][i];
+            c->irregularidade = lotes[b].car[CAR_IRREGULARIDADE][i];
+            c->pocos = lotes[b].car[CAR_POCOS][i];
+        }
+        candidatos += lotes[b].n;
+    }
+
+    long erros = 0;
+    volatile long soma = 0;
+    double inicio = segundosAgora();
+    for (int r = 0; r < repeticoes; r++) {
+        long s = 0;
+        for (int b = 0; b < n; b++) {
+            const Caracteristicas *c = &cars[(size_t)b * por_tabuleiro];
+            int melhor_i = -1;
+            float melhor = -FLT_MAX;
+            for (int i = 0; i < lotes[b].n; i++) {
+                float v = avaliarLinear(&c[i], PESOS_PADRAO);
+                if (melhor_i < 0 || v > melhor) {
+                    melhor = v;
+                    melhor_i = i;
+                }
+            }
+            s += melhor_i;
+        }
+        soma += s;
+    }
+    double t_escalar = segundosAgora() - inicio;
+    inicio = segundosAgora();
+    for (int r = 0; r < repeticoes; r++) {
+        long s = 0;
+        for (int b = 0; b < n; b++) {
+            s += loteMelhor(&lotes[b], PESOS_PADRAO, NULL);
+        }
+        soma += s;
+    }
+    double t_lote = segundosAgora() - inicio;
+
+    float notas[2 * MAX_COLOCACOES];
+    for (int b = 0; b < n; b++) {
+        const Caracteristicas *c = &cars[(size_t)b * por_tabuleiro];
+        int melhor_i = -1;
+        float melhor = -FLT_MAX, nota;
+        for (int i = 0; i < lotes[b].n; i++) {
+            float v = avaliarLinear(&c[i], PESOS_PADRAO);
+            if (melhor_i < 0 || v > melhor) {
+                melhor = v;
+                melhor_i = i;
+            }
+        }
+        erros += loteMelhor(&lotes[b], PESOS_PADRAO, &nota) != melhor_i || (melhor_i >= 0 && nota != melhor);
+        loteNotas(&lotes[b], PESOS_PADRAO, notas);
+        for (int i = 0; i < lotes[b].n; i++) {
+            erros += notas[i] != avaliarLinear(&c[i], PESOS_PADRAO);
+        }
+        loteLiberar(&lotes[b]);
+    }
+
+    double total = (double)candidatos * repeticoes;
+    printf("%d tabuleiros, %.1f candidatos cada; enumeracao + caracteristicas: %.2f M candidatos/s\n", n,
+           (double)candidatos / n, candidatos / t_enumerar / 1e6);
+    printf("Avaliacao: por candidato %.1f M/s, em lote %.1f M/s (%.2fx), %ld divergencias\n", total / t_escalar / 1e6,
+           total / t_lote / 1e6, t_escalar / t_lote, erros);
+    free(lotes);
+    free(cars);
+    return erros != 0;
+}
+
+/**
+ * @brief Joga uma partida inteira com o bot de busca em feixe.
+ *
+ * Uso: tetris bot [semente] [pecas] [largura]
+ */
+static int comandoBot(int argc, char *argv[]) {
+    uint64_t semente = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+    long max_pecas = argc > 2 ? atol(argv[2]) : 1000;
+    int largura = argc > 3 ? atoi(argv[3]) : FEIXE_LARGURA_PADRAO;
+    if (max_pecas <= 0 || largura <= 0) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+    BuscaFeixe busca;
+    if (buscaFeixeCriar(&busca, largura, NULL) != 0) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+    Sessao sessao;
+    Tabuleiro t;
+    Superficie s;
+    iniciarSessao(&sessao, semente);
+    tabuleiroLimpar(&t);
+    superficieCalcular(&s, &t);
+
+    long pecas = 0, linhas = 0, profundidades = 0, usos_reserva = 0;
+    double inicio = segundosAgora();
+    while (pecas < max_pecas) {
+        Lance lance;
+        int profundidade = buscarLance(&busca, &sessao, &t, &s, &lance);
+        if (profundidade == 0) {
+            break;
+        }
+        const Colocacao *c = &lance.colocacao;
+        if (colide(&t, lance.tipo, c->rot, c->x, c->y) || !colide(&t, lance.tipo, c->rot, c->x, c->y - 1)) {
+            fprintf(stderr, "Colocacao invalida na peca %ld.\n", pecas);
+            buscaFeixeLiberar(&busca);
+            return 1;
+        }
+        int feitas = executarLance(&sessao, &t, &s, &lance);
+        if (feitas < 0) {
+            fprintf(stderr, "Lance recusado na peca %ld.\n", pecas);
+            buscaFeixeLiberar(&busca);
+            return 1;
+        }
+        linhas += feitas;
+        profundidades += profundidade;
+        usos_reserva += lance.acoes[0] != ACAO_JOGAR;
+        pecas++;
+    }
+    double tempo = segundosAgora() - inicio;
+
+    printf("%ld pecas, %ld linhas (%s), altura final %d\n", pecas, linhas,
+           pecas < max_pecas ? "fim de jogo" : "limite de pecas", s.altura_max);
+    printf("Largura %d, profundidade media %.2f, %ld lances com a reserva\n", largura,
+           pecas ? (double)profundidades / pecas : 0.0, usos_reserva);
+    printf("%.0f pecas/s, %.2f M filhos avaliados/s\n", pecas / tempo, busca.avaliados / tempo / 1e6);
+    buscaFeixeLiberar(&busca);
+    return 0;
+}
+
+/**
+ * @brief Mede a busca paralela de 1 a N threads na mesma partida.
+ *
+ * Uso: tetris bench-busca [threads] [pecas] [largura] [semente]
+ */
+static int comandoBenchBusca(int argc, char *argv[]) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    long max_pecas = argc > 2 ? atol(argv[2]) : 300;
+    int largura = argc > 3 ? atoi(argv[3]) : FEIXE_LARGURA_PADRAO;
+    uint64_t semente = argc > 4 ? strtoull(argv[4], NULL, 10) : 1;
+    if (max_threads <= 0 || max_pecas <= 0 || largura <= 0) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+    printf("%d nucleos online, largura %d, %ld pecas por rodada\n", (int)sysconf(_SC_NPROCESSORS_ONLN), largura,
+           max_pecas);
+    printf("threads  pecas/s  M nos/s  aceleracao  linhas  duplicados\n");
+    double base = 0;
+    for (int n = 1; n <= max_threads; n++) {
+        BuscaParalela busca;
+        if (buscaParalelaCriar(&busca, n, largura, NULL, TT_BITS_PADRAO) != 0) {
+            fprintf(stderr, "Nao foi possivel preparar a busca.\n");
+            return 1;
+        }
+        Sessao sessao;
+        Tabuleiro t;
+        Superficie s;
+        iniciarSessao(&sessao, semente);
+        tabuleiroLimpar(&t);
+        superficieCalcular(&s, &t);
+        long pecas = 0, linhas = 0;
+        double inicio = segundosAgora();
+        while (pecas < max_pecas) {
+            Lance lance;
+            if (buscarLanceParalelo(&busca, &sessao, &t, &s, &lance) == 0) {
+                break;
+            }
+            int feitas = executarLance(&sessao, &t, &s, &lance);
+            if (feitas < 0) {
+                fprintf(stderr, "Lance recusado na peca %ld.\n", pecas);
+                buscaParalelaLiberar(&busca);
+                return 1;
+            }
+            linhas += feitas;
+            pecas++;
+        }
+        double tempo = segundosAgora() - inicio;
+        double nos = buscaParalelaAvaliados(&busca) / tempo;
+        if (n == 1) {
+            base = nos;
+        }
+        printf("%7d  %7.0f  %7.2f  %9.2fx  %6ld  %10ld\n", busca.num_threads, pecas / tempo, nos / 1e6,
+               nos / base, linhas, busca.duplicados);
+        buscaParalelaLiberar(&busca);
+    }
+    return 0;
+}
+
+/**
+ * @brief Joga uma partida escolhendo cada lance com MCTS.
+ *
+ * Uso: tetris mcts [semente] [pecas] [iteracoes] [threads] [profundidade]
+ */
+static int comandoMcts(int argc, char *argv[]) {
+    uint64_t semente = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+    long max_pecas = argc > 2 ? atol(argv[2]) : 100;
+    long iteracoes = argc > 3 ? atol(argv[3]) : 2000;
+    int num_threads = argc > 4 ? atoi(argv[4]) : 1;
+    int profundidade = argc > 5 ? atoi(argv[5]) : MCTS_PROFUNDIDADE_PADRAO;
+    if (max_pecas <= 0 || iteracoes <= 0 || num_threads <= 0 || profundidade <= 0) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+    // cada iteração expande no máximo uma decisão (até 15 filhos) e um
+    // nó de acaso (até 49)
+    uint32_t capacidade = (uint32_t)(iteracoes * (NUM_MACROS * MCTS_LANCES_POR_MACRO + NUM_TIPOS * NUM_TIPOS) + 1);
+    Mcts m;
+    if (mctsCriar(&m, capacidade, NULL) != 0) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+    mctsDefinirProfundidade(&m, profundidade);
+    Sessao sessao;
+    Tabuleiro t;
+    Superficie s;
+    iniciarSessao(&sessao, semente);
+    tabuleiroLimpar(&t);
+    superficieCalcular(&s, &t);
+
+    long pecas = 0, linhas = 0, total_iteracoes = 0, usos_reserva = 0;
+    double nos = 0, tempo = 0;
+    while (pecas < max_pecas) {
+        Lance lance;
+        double inicio = segundosAgora();
+        long feitas = mctsBuscar(&m, &sessao, &t, &s, iteracoes, num_threads, &lance);
+        tempo += segundosAgora() - inicio;
+        if (feitas < 0) {
+            fprintf(stderr, "Falha na busca.\n");
+            mctsLiberar(&m);
+            return 1;
+        }
+        if (feitas == 0) {
+            break;
+        }
+        total_iteracoes += feitas;
+        nos += atomic_load(&m.usados) < m.capacidade ? atomic_load(&m.usados) : m.capacidade;
+        int feitas_linhas = executarLance(&sessao, &t, &s, &lance);
+        if (feitas_linhas < 0) {
+            fprintf(stderr, "Lance recusado na peca %ld.\n", pecas);
+            mctsLiberar(&m);
+            return 1;
+        }
+        linhas += feitas_linhas;
+        usos_reserva += lance.acoes[0] != ACAO_JOGAR;
+        pecas++;
+    }
+
+    printf("%ld pecas, %ld linhas (%s), %ld lances com a reserva\n", pecas, linhas,
+           pecas < max_pecas ? "fim de jogo" : "limite de pecas", usos_reserva);
+    printf("%d threads: %.0f iteracoes/s, %.0f nos por lance, %zu bytes por no\n", num_threads,
+           total_iteracoes / tempo, pecas ? nos / pecas : 0.0, sizeof(NoMcts));
+    mctsLiberar(&m);
+    return 0;
+}
+
+// Reexecuta a solução em cópias e confere que o tabuleiro termina vazio.
+static int conferirPC(const Sessao *sessao, const Tabuleiro *t, const Lance *lances, int n) {
+    Sessao s = *sessao;
+    Tabuleiro copia = *t;
+    Superficie sup;
+    superficieCalcular(&sup, &copia);
+    for (int i = 0; i < n; i++) {
+        if (executarLance(&s, &copia, &sup, &lances[i]) < 0) {
+            return 0;
+        }
+    }
+    for (int y = 0; y < TABULEIRO_ALTURA; y++) {
+        if (copia.linhas[TABULEIRO_BORDA + y] != LINHA_VAZIA) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Lê um tabuleiro de até PC_ALTURA_MAX linhas, de cima para baixo.
+ *
+ * As linhas são separadas por '/' e têm 10 caracteres cada: '.' para
+ * vazia, '#' ou 'X' para ocupada (ex.: "XX......XX/XXX....XXX").
+ */
+static int lerTabuleiroPC(const char *texto, Tabuleiro *t) {
+    uint16_t linhas[PC_ALTURA_MAX];
+    int n = 0;
+    const char *p = texto;
+    for (;;) {
+        if (n == PC_ALTURA_MAX) {
+            return -1;
+        }
+        uint16_t linha = LINHA_VAZIA;
+        for (int c = 0; c < TABULEIRO_LARGURA; c++, p++) {
+            if (*p == '#' || *p == 'X' || *p == 'x') {
+                linha |= (uint16_t)(1u << (c + TABULEIRO_PAREDE));
+            } else if (*p != '.') {
+                return -1;
+            }
+        }
+        if (linha == LINHA_CHEIA) {
+            return -1;
+        }
+        linhas[n++] = linha;
+        if (*p == '\0') {
+            break;
+        }
+        if (*p++ != '/') {
+            return -1;
+        }
+    }
+    tabuleiroLimpar(t);
+    for (int i = 0; i < n; i++) {
+        t->linhas[TABULEIRO_BORDA + n - 1 - i] = linhas[i];
+    }
+    return 0;
+}
+
+static int compararTempos(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Diz se há limpeza total com as peças vistas e mostra os lances.
+ *
+ * Uso: tetris pc <tabuleiro> <fila> [pilha|-] [threads]
+ *
+ * A fila vai da frente para o fim e a pilha do topo para a base, como na
+ * tela do jogo (ex.: tetris pc XX......XX/XXX....XXX IOTLS ZJ).
+ */
+static int comandoPC(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Uso: tetris pc <tabuleiro> <fila> [pilha|-] [threads]\n");
+        return 1;
+    }
+    const char *fila = argv[2];
+    const char *pilha = argc > 3 && strcmp(argv[3], "-") != 0 ? argv[3] : "";
+    int num_threads = argc > 4 ? atoi(argv[4]) : 1;
+    Tabuleiro t;
+    if (lerTabuleiroPC(argv[1], &t) != 0) {
+        fprintf(stderr, "Tabuleiro invalido: use ate %d linhas de 10 caracteres '.' ou 'X' separadas por '/'.\n",
+                PC_ALTURA_MAX);
+        return 1;
+    }
+    int tam_fila = (int)strlen(fila), tam_pilha = (int)strlen(pilha);
+    int valido = tam_fila >= 1 && tam_fila <= FILA_MAX && tam_pilha <= PILHA_MAX && num_threads > 0;
+    for (int i = 0; valido && i < tam_fila + tam_pilha; i++) {
+        char c = i < tam_fila ? fila[i] : pilha[i - tam_fila];
+        valido = c != '\0' && strchr(TIPOS_PECA, c) != NULL;
+    }
+    if (!valido) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+
+    // IDs na ordem em que as peças teriam saído: a pilha primeiro.
+    Sessao sessao;
+    inicializarFila(&sessao.fila);
+    inicializarPilha(&sessao.pilha);
+    semearGerador(&sessao.gerador, 0);
+    int id = 0;
+    for (int i = tam_pilha - 1; i >= 0; i--) {
+        Peca p = {pilha[i], id++};
+        pushPilha(&sessao.pilha, p);
+    }
+    for (int i = 0; i < tam_fila; i++) {
+        Peca p = {fila[i], id++};
+        inserirFila(&sessao.fila, p);
+    }
+    sessao.gerador.proximo_id = id;
+
+    SolucionadorPC sol;
+    if (solucionadorPCCriar(&sol, PC_MEMO_BITS_PADRAO, num_threads) != 0) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+    Lance lances[PC_MAX_PECAS];
+    double inicio = segundosAgora();
+    int n = resolverPC(&sol, &sessao, &t, lances);
+    double tempo = segundosAgora() - inicio;
+    if (n < 0) {
+        fprintf(stderr, "Falha na busca.\n");
+        solucionadorPCLiberar(&sol);
+        return 1;
+    }
+    if (n == 0) {
+        printf("Sem limpeza total com essas pecas (%.3f ms, %ld estados).\n", tempo * 1e3, sol.nos);
+        solucionadorPCLiberar(&sol);
+        return 0;
+    }
+    printf("Limpeza total com %d pecas (%.3f ms, %ld estados, %s):\n", n, tempo * 1e3, sol.nos,
+           conferirPC(&sessao, &t, lances, n) ? "conferida" : "FALHOU NA CONFERENCIA");
+    for (int i = 0; i < n; i++) {
+        const Lance *l = &lances[i];
+        const FormaPeca *f = &FORMAS[l->tipo][l->colocacao.rot];
+        printf("  %d. acoes %d", i + 1, l->acoes[0]);
+        if (l->num_acoes > 1) {
+            printf(",%d", l->acoes[1]);
+        }
+        // canto inferior esquerdo das células, depois das linhas já removidas
+        printf("  peca %c  rotacao %d  coluna %d  linha %d\n", TIPOS_PECA[l->tipo], l->colocacao.rot,
+               l->colocacao.x + f->x_min, l->colocacao.y + f->y_min);
+    }
+    solucionadorPCLiberar(&sol);
+    return 0;
+}
+
+/**
+ * @brief Mede o solucionador em tabuleiros sorteados de até 4 linhas.
+ *
+ * Uso: tetris bench-pc [consultas] [semente] [threads]
+ *
+ * Cada consulta reserva de 1 a 3 peças de uma partida nova e sorteia
+ * peças no tabuleiro, por queda livre e sem completar linhas, até que as
+ * peças vistas possam bastar. A tabela de falhas é mantida entre as
+ * consultas, como num jogo.
+ */
+static int comandoBenchPC(int argc, char *argv[]) {
+    int consultas = argc > 1 ? atoi(argv[1]) : 200;
+    uint64_t semente = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    int num_threads = argc > 3 ? atoi(argv[3]) : 1;
+    if (consultas <= 0 || num_threads <= 0) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+    SolucionadorPC sol;
+    double *tempos = malloc(sizeof(double) * consultas);
+    if (!tempos || solucionadorPCCriar(&sol, PC_MEMO_BITS_PADRAO, num_threads) != 0) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        free(tempos);
+        return 1;
+    }
+    uint64_t x = misturar64(semente ^ 0xA5A5A5A5A5A5A5A5ULL);
+    int resolvidas = 0, erradas = 0;
+    long estados = 0;
+    for (int q = 0; q < consultas; q++) {
+        Sessao sessao;
+        iniciarSessao(&sessao, misturar64(semente + (uint64_t)q * PASSO_GERADOR));
+        x = misturar64(x + PASSO_GERADOR);
+        int reservas = 1 + (int)(x % PILHA_MAX);
+        for (int r = 0; r < reservas; r++) {
+            aplicarAcaoSessao(&sessao, ACAO_RESERVAR);
+        }
+        // o tabuleiro fica com 10 - (peças vistas) a 12 - (peças vistas) peças
+        int colocadas = PC_ALTURA_MAX * TABULEIRO_LARGURA / 4 - FILA_MAX - reservas + (int)((x >> 8) % 3);
+
+        Tabuleiro t;
+        Superficie s;
+        tabuleiroLimpar(&t);
+        superficieCalcular(&s, &t);
+        for (int k = 0, tentativas = 0; k < colocadas && tentativas < 64; tentativas++) {
+            x = misturar64(x + PASSO_GERADOR);
+            int tipo = (int)(x % NUM_TIPOS);
+            Colocacao colocacoes[MAX_COLOCACOES];
+            int n = enumerarColocacoes(&t, &s, tipo, colocacoes);
+            if (n == 0) {
+                break;
+            }
+            const Colocacao *c = &colocacoes[(x >> 8) % (uint64_t)n];
+            if (c->y + FORMAS[tipo][c->rot].y_max >= PC_ALTURA_MAX) {
+                continue;
+            }
+            Tabuleiro nt = t;
+            Superficie ns = s;
+            if (colocarPecaSuperficie(&nt, &ns, tipo, c->rot, c->x, c->y) == 0) {
+                t = nt;
+                s = ns;
+                k++;
+            }
+        }
+
+        Lance lances[PC_MAX_PECAS];
+        double inicio = segundosAgora();
+        int n = resolverPC(&sol, &sessao, &t, lances);
+        tempos[q] = segundosAgora() - inicio;
+        if (n < 0) {
+            fprintf(stderr, "Falha na busca.\n");
+            free(tempos);
+            solucionadorPCLiberar(&sol);
+            return 1;
+        }
+        estados += sol.nos;
+        resolvidas += n > 0;
+        erradas += n > 0 && !conferirPC(&sessao, &t, lances, n);
+    }
+    double soma = 0;
+    for (int q = 0; q < consultas; q++) {
+        soma += tempos[q];
+    }
+    qsort(tempos, consultas, sizeof(double), compararTempos);
+    printf("%d consultas, %d com limpeza total (%d falharam na conferencia)\n", consultas, resolvidas, erradas);
+    printf("%d threads: media %.3f ms, mediana %.3f ms, p99 %.3f ms, maximo %.3f ms, %.0f estados por consulta\n",
+           num_threads, soma / consultas * 1e3, tempos[consultas / 2] * 1e3, tempos[consultas * 99 / 100] * 1e3,
+           tempos[consultas - 1] * 1e3, (double)estados / consultas);
+    free(tempos);
+    solucionadorPCLiberar(&sol);
+    return erradas != 0;
+}
+
+/**
+ * @brief Evolui os pesos da avaliação linear com um algoritmo genético.
+ *
+ * Uso: tetris treinar <checkpoint> [geracoes] [populacao] [jogos] [pecas] [threads] [semente] [largura]
+ *
+ * Se o checkpoint já existe, o treino continua dele com os parâmetros
+ * gravados (só 'geracoes' e 'threads' valem). O checkpoint é regravado a
+ * cada geração.
+ */
+static int comandoTreinar(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: tetris treinar <checkpoint> [geracoes] [populacao] [jogos] [pecas] [threads] "
+                        "[semente] [largura]\n");
+        return 1;
+    }
+    const char *caminho = argv[1];
+    int geracoes = argc > 2 ? atoi(argv[2]) : 10;
+    int populacao = argc > 3 ? atoi(argv[3]) : 32;
+    int jogos = argc > 4 ? atoi(argv[4]) : 8;
+    int max_pecas = argc > 5 ? atoi(argv[5]) : 500;
+    int num_threads = argc > 6 ? atoi(argv[6]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t semente = argc > 7 ? strtoull(argv[7], NULL, 10) : 1;
+    int largura = argc > 8 ? atoi(argv[8]) : 1;
+    if (geracoes <= 0 || num_threads <= 0) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+    CabecalhoGenetico cab;
+    int existe = treinoLerCabecalho(caminho, &cab);
+    if (existe < 0) {
+        fprintf(stderr, "Checkpoint %s invalido.\n", caminho);
+        return 1;
+    }
+    if (existe) {
+        populacao = (int)cab.populacao;
+        jogos = (int)cab.jogos;
+        max_pecas = (int)cab.max_pecas;
+        largura = (int)cab.largura;
+        semente = cab.semente;
+    }
+    TreinoGenetico tr;
+    if (treinoCriar(&tr, populacao, jogos, max_pecas, largura, num_threads, semente) != 0) {
+        fprintf(stderr, "Parametros invalidos ou memoria insuficiente.\n");
+        return 1;
+    }
+    if (existe && treinoCarregar(&tr, caminho) != 0) {
+        fprintf(stderr, "Checkpoint %s invalido.\n", caminho);
+        treinoLiberar(&tr);
+        return 1;
+    }
+    printf("%s na geracao %d: populacao %d, %d partidas de ate %d pecas, largura %d, %d threads\n",
+           existe ? "Retomando" : "Comecando", tr.geracao, populacao, jogos, max_pecas, largura, num_threads);
+
+    double inicio = segundosAgora();
+    for (int g = 0; g < geracoes; g++) {
+        int geracao = tr.geracao;
+        double t0 = segundosAgora();
+        if (treinoGeracao(&tr) != 0) {
+            fprintf(stderr, "Memoria insuficiente.\n");
+            treinoLiberar(&tr);
+            return 1;
+        }
+        if (treinoSalvar(&tr, caminho) != 0) {
+            fprintf(stderr, "Falha ao gravar %s.\n", caminho);
+            treinoLiberar(&tr);
+            return 1;
+        }
+        float soma = 0;
+        for (int i = 0; i < tr.populacao; i++) {
+            soma += tr.aptidao[i];
+        }
+        printf("geracao %4d  melhor %8.1f  media %8.1f linhas  (%.1f s)\n", geracao, tr.aptidao[tr.ordem[0]],
+               soma / tr.populacao, segundosAgora() - t0);
+    }
+    double tempo = segundosAgora() - inicio;
+
+    printf("Melhor aptidao %.1f linhas por partida; pesos (linhas, soma das alturas, altura maxima, buracos, "
+           "irregularidade, pocos):\n ", tr.melhor_aptidao);
+    for (int k = 0; k < NUM_CARACTERISTICAS; k++) {
+        printf(" %.4f", tr.melhor_pesos[k]);
+    }
+    printf("\n%.0f geracoes/hora, %.0f pecas/s\n", geracoes / tempo * 3600, atomic_load(&tr.pecas) / tempo);
+    treinoLiberar(&tr);
+    return 0;
+}
+
+/**
+ * @brief Grava uma rede que reproduz a avaliação linear (PESOS_PADRAO).
+ *
+ * Uso: tetris rede-gerar <arquivo> [semente] [ruido]
+ */
+static int comandoRedeGerar(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: tetris rede-gerar <arquivo> [semente] [ruido]\n");
+        return 1;
+    }
+    uint64_t semente = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    float ruido = argc > 3 ? (float)atof(argv[3]) : 0.02f;
+    RedeAvaliacao *rede = malloc(sizeof(RedeAvaliacao));
+    if (!rede) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        return 1;
+    }
+    redeDaAvaliacaoLinear(rede, PESOS_PADRAO, semente, ruido);
+    int ok = redeSalvar(rede, argv[1]) == 0;
+    if (ok) {
+        printf("Rede %d-%d-%d-1 gravada em %s (desloc %d/%d)\n", REDE_ENTRADAS, REDE_OCULTA1, REDE_OCULTA2,
+               argv[1], rede->desloc1, rede->desloc2);
+    } else {
+        fprintf(stderr, "Falha ao gravar %s.\n", argv[1]);
+    }
+    free(rede);
+    return ok ? 0 : 1;
+}
+
+// Índice da maior nota; empates ficam com o menor índice.
+static int indiceMaior(const float *notas, int n) {
+    int melhor = 0;
+    for (int i = 1; i < n; i++) {
+        if (notas[i] > notas[melhor]) {
+            melhor = i;
+        }
+    }
+    return melhor;
+}
+
+/**
+ * @brief Compara a rede (float e int8) com a avaliação linear.
+ *
+ * Uso: tetris bench-rede <arquivo> [tabuleiros] [partidas] [pecas] [largura]
+ *
+ * Em tabuleiros sorteados, confere os kernels AVX2 contra as versões
+ * escalares, mede avaliações por segundo e quantas vezes cada avaliação
+ * escolhe o mesmo candidato que a linear; depois joga as mesmas
+ * partidas com o bot de busca em feixe usando cada avaliação.
+ */
+static int comandoBenchRede(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: tetris bench-rede <arquivo> [tabuleiros] [partidas] [pecas] [largura]\n");
+        return 1;
+    }
+    int n = argc > 2 ? atoi(argv[2]) : 1024;
+    int partidas = argc > 3 ? atoi(argv[3]) : 8;
+    int max_pecas = argc > 4 ? atoi(argv[4]) : 500;
+    int largura = argc > 5 ? atoi(argv[5]) : 1;
+    if (n <= 0 || partidas < 0 || max_pecas <= 0 || largura <= 0) {
+        fprintf(stderr, "Parametros invalidos.\n");
+        return 1;
+    }
+    RedeAvaliacao *rede = malloc(sizeof(RedeAvaliacao));
+    LoteCandidatos *lotes = calloc(n, sizeof(LoteCandidatos));
+    if (!rede || !lotes) {
+        fprintf(stderr, "Memoria insuficiente.\n");
+        free(rede);
+        free(lotes);
+        return 1;
+    }
+    if (redeCarregar(rede, argv[1]) != 0) {
+        fprintf(stderr, "Rede %s invalida.\n", argv[1]);
+        free(rede);
+        free(lotes);
+        return 1;
+    }
+
+    // Tabuleiros como em bench-avaliacao: jogadas sorteadas a partir do
+    // vazio e, como candidatos, as colocações de duas peças.
+    uint64_t x = 2024;
+    long candidatos = 0;
+    for (int b = 0; b < n; b++) {
+        Tabuleiro t;
+        Superficie s;
+        Colocacao col[MAX_COLOCACOES], col2[MAX_COLOCACOES];
+        tabuleiroLimpar(&t);
+        superficieCalcular(&s, &t);
+        x = misturar64(x + PASSO_GERADOR);
+        int jogadas = (int)(x % 24);
+        for (int k = 0; k < jogadas; k++) {
+            x = misturar64(x + PASSO_GERADOR);
+            int tipo = (int)(x % NUM_TIPOS);
+            int m = enumerarColocacoes(&t, &s, tipo, col);
+            if (m == 0) {
+                break;
+            }
+            const Colocacao *c = &col[(x >> 32) % m];
+            colocarPecaSuperficie(&t, &s, tipo, c->rot, c->x, c->y);
+        }
+        x = misturar64(x + PASSO_GERADOR);
+        int tipo = (int)(x % NUM_TIPOS), tipo2 = (int)((x >> 32) % NUM_TIPOS);
+        int m = enumerarColocacoes(&t, &s, tipo, col);
+        int m2 = enumerarColocacoes(&t, &s, tipo2, col2);
+        if (loteCriar(&lotes[b], m + m2) != 0) {
+            fprintf(stderr, "Memoria insuficiente.\n");
+            return 1;
+        }
+        loteColocacoes(&lotes[b], &t, &s, tipo, col, m);
+        loteColocacoes(&lotes[b], &t, &s, tipo2, col2, m2);
+        candidatos += lotes[b].n;
+    }
+
+    // conferência e concordância com a escolha linear
+    float linear[2 * MAX_COLOCACOES + 8], nf[2 * MAX_COLOCACOES + 8], n8[2 * MAX_COLOCACOES + 8];
+    float ref_f[2 * MAX_COLOCACOES + 8], ref_8[2 * MAX_COLOCACOES + 8];
+    float dif_float = 0;
+    long dif_int8 = 0;
+    int iguais_float = 0, iguais_int8 = 0, iguais_entre = 0;
+    for (int b = 0; b < n; b++) {
+        const LoteCandidatos *l = &lotes[b];
+        loteNotas(l, PESOS_PADRAO, linear);
+        redeNotasLote(rede, l, REDE_FLOAT, nf);
+        redeNotasLote(rede, l, REDE_INT8, n8);
+        redeNotasEscalar(rede, l, REDE_FLOAT, ref_f);
+        redeNotasEscalar(rede, l, REDE_INT8, ref_8);
+        for (int i = 0; i < l->n; i++) {
+            float d = nf[i] - ref_f[i];
+            d = d < 0 ? -d : d;
+            dif_float = d > dif_float ? d : dif_float;
+            dif_int8 += n8[i] != ref_8[i];
+        }
+        int escolha = indiceMaior(linear, l->n);
+        int escolha_f = indiceMaior(nf, l->n), escolha_8 = indiceMaior(n8, l->n);
+        iguais_float += escolha_f == escolha;
+        iguais_int8 += escolha_8 == escolha;
+        iguais_entre += escolha_8 == escolha_f;
+    }
+    printf("%d tabuleiros, %ld candidatos; AVX2 x escalar: float difere ate %.2g, int8 em %ld notas\n", n,
+           candidatos, dif_float, dif_int8);
+    printf("Mesma escolha da linear: float %.1f%%, int8 %.1f%% (int8 = float em %.1f%%)\n",
+           100.0 * iguais_float / n, 100.0 * iguais_int8 / n, 100.0 * iguais_entre / n);
+
+    // avaliações por segundo
+    int repeticoes = (int)(1000000 / candidatos) + 1;
+    const char *nomes[5] = {"linear", "rede float", "rede int8", "float escalar", "int8 escalar"};
+    double tempos[5];
+    volatile float soma = 0;
+    for (int v = 0; v < 5; v++) {
+        double inicio = segundosAgora();
+        for (int rep = 0; rep < repeticoes; rep++) {
+            for (int b = 0; b < n; b++) {
+                if (v == 0) {
+                    loteNotas(&lotes[b], PESOS_PADRAO, nf);
+                } else if (v < 3) {
+                    redeNotasLote(rede, &lotes[b], v == 1 ? REDE_FLOAT : REDE_INT8, nf);
+                } else {
+                    redeNotasEscalar(rede, &lotes[b], v == 3 ? REDE_FLOAT : REDE_INT8, nf);
+                }
+                soma += nf[0];
+            }
+        }
+        tempos[v] = segundosAgora() - inicio;
+    }
+    printf("avaliacao      M aval/s\n");
+    for (int v = 0; v < 5; v++) {
+        printf("%-13s %9.2f\n", nomes[v], (double)candidatos * repeticoes / tempos[v] / 1e6);
+    }
+
+    // qualidade das decisões em partidas iguais
+    if (partidas > 0) {
+        printf("%d partidas de ate %d pecas, largura %d:\n", partidas, max_pecas, largura);
+        printf("avaliacao      linhas/partida  pecas/partida  pecas/s\n");
+    }
+    for (int v = 0; v < 3 && partidas > 0; v++) {
+        BuscaFeixe busca;
+        if (buscaFeixeCriar(&busca, largura, NULL) != 0) {
+            fprintf(stderr, "Memoria insuficiente.\n");
+            return 1;
+        }
+        busca.rede = v == 0 ? NULL : rede;
+        busca.modo_rede = v == 2 ? REDE_INT8 : REDE_FLOAT;
+        long linhas = 0, pecas = 0;
+        double inicio = segundosAgora();
+        for (int p = 0; p < partidas; p++) {
+            linhas += jogarPartida(&busca, (uint64_t)p + 1, max_pecas, &pecas);
+        }
+        double tempo = segundosAgora() - inicio;
+        printf("%-13s %15.1f %14.1f %8.0f\n", nomes[v], (double)linhas / partidas, (double)pecas / partidas,
+               pecas / tempo);
+        buscaFeixeLiberar(&busca);
+    }
+
+    for (int b = 0; b < n; b++) {
+        loteLiberar(&lotes[b]);
+    }
+    free(lotes);
+    free(rede);
+    return 0;
+}
+
+static void exibirUso(void) {
+    printf("Uso: tetris [comando] [argumentos]\n");
+    printf("Sem comando, inicia o jogo interativo.\n\n");
+    printf("Comandos:\n");
+    printf("  jogar [tabela|-] [sequencia]  jogo interativo, com dicas e pecas pre-geradas\n");
+    printf("  gravar <arquivo> [sequencia]  jogo interativo gravando um replay\n");
+    printf("  hospedar <log> [-] [sequencia]\n");
+    printf("                                jogo interativo com log duravel; retoma apos queda\n");
+    printf("  gerar-replay <arquivo> [semente] [turnos] [intervalo]\n");
+    printf("                                grava um replay com jogadas sorteadas\n");
+    printf("  buscar <arquivo> <turno>      mostra o estado de um replay em um turno\n");
+    printf("  verificar [-j n] <arquivo>... reexecuta replays em paralelo\n");
+    printf("  diferenca <a> [b]             primeiro turno divergente entre replays\n");
+    printf("  compactar <replay> <saida>    compacta as acoes com rANS e confere\n");
+    printf("  descompactar <arq> <saida>    reconstroi o replay original\n");
+    printf("  indexar <indice> <replay>...  monta o indice de n-gramas dos replays\n");
+    printf("  consultar <indice> eventos|pecas <simbolo>...\n");
+    printf("                                procura um padrao (ex.: eventos 2I ~2 3I)\n");
+    printf("  analisar [-j n] <saida> <replay|@lista>...\n");
+    printf("                                estatisticas agregadas em formato colunar\n");
+    printf("  recuperar <log> [checkpoint|-] [novo_checkpoint]\n");
+    printf("                                reconstroi as sessoes do checkpoint e do log\n");
+    printf("  bench-log <log> [sessoes] [acoes] [threads] [intervalo_us] [checkpoint] [intervalo_ms]\n");
+    printf("                                simula sessoes hospedadas com fsync em grupo\n");
+    printf("  bench-ambiente [n] [passos]   mede o ambiente vetorizado\n");
+    printf("  bench-gerador [semente] [n]   confere o acesso direto a sequencia de pecas\n");
+    printf("  materializar <arquivo> <semente> <pecas>\n");
+    printf("                                grava uma sequencia de pecas para mmap\n");
+    printf("  bench-indice [repeticoes]     confere e mede o rank/unrank de estados\n");
+    printf("  bench-linhas [tabuleiros] [repeticoes]\n");
+    printf("                                confere e mede a limpeza de linhas\n");
+    printf("  bench-avaliacao [tabuleiros] [repeticoes]\n");
+    printf("                                compara a avaliacao em lote com a por candidato\n");
+    printf("  bot [semente] [pecas] [largura]\n");
+    printf("                                joga uma partida com o bot de busca em feixe\n");
+    printf("  bench-busca [threads] [pecas] [largura] [semente]\n");
+    printf("                                mede a busca paralela de 1 a N threads\n");
+    printf("  mcts [semente] [pecas] [iteracoes] [threads] [profundidade]\n");
+    printf("                                joga uma partida escolhendo os lances com MCTS\n");
+    printf("  pc <tabuleiro> <fila> [pilha|-] [threads]\n");
+    printf("                                procura uma limpeza total de ate 4 linhas\n");
+    printf("  bench-pc [consultas] [semente] [threads]\n");
+    printf("                                mede o solucionador de limpeza total\n");
+    printf("  treinar <checkpoint> [geracoes] [populacao] [jogos] [pecas] [threads] [semente] [largura]\n");
+    printf("                                evolui os pesos da avaliacao com um algoritmo genetico\n");
+    printf("  rede-gerar <arquivo> [semente] [ruido]\n");
+    printf("                                grava uma rede neural equivalente a avaliacao linear\n");
+    printf("  bench-rede <arquivo> [tabuleiros] [partidas] [pecas] [largura]\n");
+    printf("                                compara a rede (float e int8) com a avaliacao linear\n");
+    printf("  resolver [arquivo] [objetivo] [gama]\n");
+    printf("                                gera a tabela de politica otima\n");
+}
+
+/**
+ * @brief Despacha os comandos de linha de comando (argv[0] é o comando).
+ */
+static int executarComando(int argc, char *argv[]) {
+    if (strcmp(argv[0], "bench-ambiente") == 0) {
+        return comandoBenchAmbiente(argc, argv);
+    }
+    if (strcmp(argv[0], "gerar-replay") == 0) {
+        return comandoGerarReplay(argc, argv);
+    }
+    if (strcmp(argv[0], "buscar") == 0) {
+        return comandoBuscar(argc, argv);
+    }
+    if (strcmp(argv[0], "verificar") == 0) {
+        return comandoVerificar(argc, argv);
+    }
+    if (strcmp(argv[0], "diferenca") == 0) {
+        return comandoDiferenca(argc, argv);
+    }
+    if (strcmp(argv[0], "compactar") == 0) {
+        return comandoCompactar(argc, argv);
+    }
+    if (strcmp(argv[0], "descompactar") == 0) {
+        return comandoDescompactar(argc, argv);
+    }
+    if (strcmp(argv[0], "indexar") == 0) {
+        return comandoIndexar(argc, argv);
+    }
+    if (strcmp(argv[0], "consultar") == 0) {
+        return comandoConsultar(argc, argv);
+    }
+    if (strcmp(argv[0], "analisar") == 0) {
+        return comandoAnalisar(argc, argv);
+    }
+    if (strcmp(argv[0], "materializar") == 0) {
+        return comandoMaterializar(argc, argv);
+    }
+    if (strcmp(argv[0], "recuperar") == 0) {
+        return comandoRecuperar(argc, argv);
+    }
+    if (strcmp(argv[0], "bench-log") == 0) {
+        return comandoBenchLog(argc, argv);
+    }
+    if (strcmp(argv[0], "bench-gerador") == 0) {
+        return comandoBenchGerador(argc, argv);
+    }
+    if (strcmp(argv[0], "rede-gerar") == 0) {
+        return comandoRedeGerar(argc, argv);
+    }
+    if (strcmp(argv[0], "bench-rede") == 0) {
+        return comandoBenchRede(argc, argv);
+    }
+    if (strcmp(argv[0], "treinar") == 0) {
+        return comandoTreinar(argc, argv);
+    }
+    if (strcmp(argv[0], "pc") == 0) {
+        return comandoPC(argc, argv);
+    }
+    if (strcmp(argv[0], "bench-pc") == 0) {
+        return comandoBenchPC(argc, argv);
+    }
+    if (strcmp(argv[0], "mcts") == 0) {
+        return comandoMcts(argc, argv);
+    }
+    if (strcmp(argv[0], "bench-busca") == 0) {
+        return comandoBenchBusca(argc, argv);
+    }
+    if (strcmp(argv[0], "bot") == 0) {
+        return comandoBot(argc, argv);
+    }
+    if (strcmp(argv[0], "bench-avaliacao") == 0) {
+        return comandoBenchAvaliacao(argc, argv);
+    }
+    if (strcmp(argv[0], "bench-linhas") == 0) {
+        return comandoBenchLinhas(argc, argv);
+    }
+    if (strcmp(argv[0], "bench-indice") == 0) {
+        return comandoBenchIndice(argc, argv);
+    }
+    if (strcmp(argv[0], "resolver") == 0) {
+        return comandoResolver(argc, argv);
+    }
+    exibirUso();
+    return strcmp(argv[0], "ajuda") == 0 ? 0 : 1;
+}
+
+
+// --- LÓGICA PRINCIPAL ---
+
+int main(int argc, char *argv[]) {
+    int gravando = argc > 1 && strcmp(argv[1], "gravar") == 0;
+    int hospedando = argc > 1 && strcmp(argv[1], "hospedar") == 0;
+    if (argc > 1 && strcmp(argv[1], "jogar") != 0 && !gravando && !hospedando) {
+        return executarComando(argc - 1, argv + 1);
+    }
+    if ((gravando || hospedando) && argc < 3) {
+        fprintf(stderr, "Uso: tetris %s <arquivo> [sequencia]\n", argv[1]);
+        return 1;
+    }
+
+    // "tetris jogar tabela.bin" mostra a jogada sugerida pela tabela
+    // ("-" no lugar da tabela joga sem dicas)
+    TabelaPolitica tabela;
+    int pedeTabela = !gravando && !hospedando && argc > 2 && strcmp(argv[2], "-") != 0;
+    int temTabela = pedeTabela && abrirTabela(&tabela, argv[2]) == 0;
+    if (pedeTabela && !temTabela) {
+        printf("Aviso: tabela %s invalida, jogando sem dicas.\n", argv[2]);
+    }
+
+    // "tetris jogar|gravar <arq> sequencia.seq" usa a semente e as peças
+    // pré-geradas do arquivo
+    SequenciaPecas sequencia;
+    int temSequencia = argc > 3 && sequenciaAbrir(&sequencia, argv[3]) == 0;
+    if (argc > 3 && !temSequencia) {
+        printf("Aviso: sequencia %s invalida, gerando as pecas.\n", argv[3]);
+    }
+
+    // Inicializa o gerador de peças
+    semearGerador(&geradorDoJogo, temSequencia ? sequencia.semente : (uint64_t)time(NULL));
+    if (temSequencia) {
+        usarSequencia(&geradorDoJogo, &sequencia);
+    }
+
+    // Declara e inicializa as estruturas do jogo
+    Fila filaDePecas;
+    Pilha pilhaDeReserva;
+    inicializarFila(&filaDePecas);
+    inicializarPilha(&pilhaDeReserva);
+
+    // Preenche a fila inicial com 5 peças
+    for (int i = 0; i < FILA_MAX; i++) {
+        inserirFila(&filaDePecas, gerarPeca());
+    }
+
+    // "tetris hospedar log" registra cada opção no log antes de mostrar o
+    // resultado e, se o log já existir, retoma a partida gravada nele
+    PoolSessoes pool;
+    LogAcoes log;
+    if (hospedando) {
+        Recuperacao rec;
+        if (recuperarPool(&pool, 1, argv[2], NULL, &rec) != 0 || pool.num_sessoes != 1) {
+            fprintf(stderr, "Log invalido: %s\n", argv[2]);
+            return 1;
+        }
+        if (logAbrir(&log, argv[2], 1, LOG_INTERVALO_PADRAO_US) != 0) {
+            fprintf(stderr, "Erro ao abrir o log %s\n", argv[2]);
+            return 1;
+        }
+        if (pool.lsn[0] > 0) {
+            filaDePecas = pool.sessoes[0].fila;
+            pilhaDeReserva = pool.sessoes[0].pilha;
+            geradorDoJogo = pool.sessoes[0].gerador;
+            if (temSequencia) {
+                usarSequencia(&geradorDoJogo, &sequencia);
+            }
+            printf("Partida retomada do log (%llu acoes).\n", (unsigned long long)(pool.lsn[0] - 1));
+        } else {
+            logAguardarDuravel(&log, 0, poolIniciarSessao(&pool, &log, 0, geradorDoJogo.semente));
+        }
+    }
+
+    // "tetris gravar arquivo" grava cada opção de 1 a 5 em um replay
+    GravadorReplay gravador;
+    if (gravando) {
+        Sessao inicial = {filaDePecas, pilhaDeReserva, geradorDoJogo};
+        if (gravadorAbrir(&gravador, argv[2], &inicial, REPLAY_INTERVALO_PADRAO) != 0) {
+            fprintf(stderr, "Erro ao criar %s\n", argv[2]);
+            return 1;
+        }
+    }
+
+    int opcao;
+    do {
+        exibirEstado(&filaDePecas, &pilhaDeReserva);
+        if (temTabela) {
+            int dica = consultarTabela(&tabela, &filaDePecas, &pilhaDeReserva);
+            if (dica > 0) {
+                printf("Dica: opcao %d\n", dica);
+            }
+        }
+        exibirMenu();
+        scanf("%d", &opcao);
+
+        switch (opcao) {
+            case 1: // Jogar peça
+                if (!filaVazia(&filaDePecas)) {
+                    Peca jogada = removerFila(&filaDePecas);
+                    printf("\nAcao: Peca [%c%d] jogada.\n", jogada.nome, jogada.id);
+                    // Adiciona uma nova peça para manter a fila cheia
+                    inserirFila(&filaDePecas, gerarPeca());
+                } else {
+                    printf("\nAcao: Fila vazia, impossivel jogar.\n");
+                }
+                break;
+
+            case 2: // Reservar peça
+                if (pilhaCheia(&pilhaDeReserva)) {
+                    printf("\nAcao: Pilha de reserva cheia! Impossivel reservar.\n");
+                } else if (filaVazia(&filaDePecas)) {
+                    printf("\nAcao: Fila vazia, impossivel reservar.\n");
+                } else {
+                    Peca reservada = removerFila(&filaDePecas);
+                    pushPilha(&pilhaDeReserva, reservada);
+                    printf("\nAcao: Peca [%c%d] movida para a reserva.\n", reservada.nome, reservada.id);
+                    inserirFila(&filaDePecas, gerarPeca());
+                }
+                break;
+
+            case 3: // Usar peça reservada
+                if (!pilhaVazia(&pilhaDeReserva)) {
+                    Peca usada = popPilha(&pilhaDeReserva);
+                    printf("\nAcao: Peca [%c%d] da reserva foi usada.\n", usada.nome, usada.id);
+                } else {
+                    printf("\nAcao: Pilha de reserva vazia!\n");
+                }
+                break;
+
+            case 4: // Trocar peça atual com topo da pilha
+                if (filaVazia(&filaDePecas) || pilhaVazia(&pilhaDeReserva)) {
+                    printf("\nAcao: E preciso ter pecas na fila E na pilha para trocar.\n");
+                } else {
+                    // Realiza a troca direta nos arrays
+                    trocarFrenteComTopo(&filaDePecas, &pilhaDeReserva);
+                    printf("\nAcao: Troca realizada entre a frente da fila e o topo da pilha.\n");
+                }
+                break;
+
+            case 5: // Troca múltipla
+                // Verifica se ambas as estruturas têm pelo menos 3 peças
+                if (filaDePecas.total < 3 || pilhaDeReserva.topo < 2) {
+                    printf("\nAcao: E preciso ter 3 pecas na fila E 3 na pilha para a troca multipla.\n");
+                } else {
+                    trocarTresPrimeiros(&filaDePecas, &pilhaDeReserva);
+                    printf("\nAcao: Troca realizada entre os 3 primeiros da fila e os 3 da pilha.\n");
+                }
+                break;
+
+            case 0: // Sair
+                printf("\nEncerrando o jogo Tetris Stack. Ate a proxima!\n");
+                break;
+
+            default:
+                printf("\nOpcao invalida. Tente novamente.\n");
+                break;
+        }
+
+        if (gravando && opcao >= ACAO_JOGAR && opcao <= ACAO_TROCA_MULTIPLA) {
+            Sessao atual = {filaDePecas, pilhaDeReserva, geradorDoJogo};
+            gravadorRegistrar(&gravador, opcao, &atual);
+        }
+        if (hospedando && opcao >= ACAO_JOGAR && opcao <= ACAO_TROCA_MULTIPLA) {
+            Sessao atual = {filaDePecas, pilhaDeReserva, geradorDoJogo};
+            if (logAguardarDuravel(&log, 0, poolRegistrar(&pool, &log, 0, opcao, &atual)) != 0) {
+                fprintf(stderr, "Erro de escrita no log.\n");
+            }
+        }
+
+    } while (opcao != 0);
+
+    if (gravando && gravadorFechar(&gravador) != 0) {
+        fprintf(stderr, "Erro ao gravar o replay.\n");
+    }
+    if (temTabela) {
+        fecharTabela(&tabela);
+    }
+    if (hospedando) {
+        logFechar(&log);
+        poolDestruir(&pool);
+    }
+    if (temSequencia) {
+        sequenciaFechar(&sequencia);
+    }
     return 0;
 }
\ No newline at end of file